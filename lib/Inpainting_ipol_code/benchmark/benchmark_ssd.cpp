@@ -0,0 +1,91 @@
+//benchmark of the patch distances : the specialised (vectorised) kernels of ssd_patch_measure against the scalar
+//path ssd_patch_measure_scalar, on random pairs of patches of a random image. Build and run with 'make benchmark'
+//(add NATIVE=1 for the AVX2/AVX-512 kernels of the compiling machine)
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "image_inpainting.h"
+#include "patch_match_measure.h"
+
+#ifndef BENCHMARK_IMAGE_SIZE
+#define BENCHMARK_IMAGE_SIZE 400
+#endif
+
+#ifndef BENCHMARK_N_PAIRS
+#define BENCHMARK_N_PAIRS 2000000
+#endif
+
+//time of one patch distance in nanoseconds, and sum of the distances (the kernels sum in a different order, so the
+//sums of both paths only differ by rounding errors)
+static double time_patch_distances(nTupleImage *img, nTupleImage *occ, const std::vector<int> &positions,
+	const patchMatchParameterStruct *params, bool useScalarPath, double *checksum)
+{
+	*checksum = 0;
+	long startTime = getMilliSecs();
+	for (size_t n=0; n<positions.size(); n+=4)
+	{
+		float ssd;
+		if (useScalarPath)
+			ssd = ssd_patch_measure_scalar(img,img,occ,positions[n],positions[n+1],positions[n+2],positions[n+3],-1,params);
+		else
+			ssd = ssd_patch_measure(img,img,occ,positions[n],positions[n+1],positions[n+2],positions[n+3],-1,params);
+		*checksum += ssd;
+	}
+	return( 1.0e6*(double)(getMilliSecs()-startTime)/(double)(positions.size()/4) );
+}
+
+int main(int argc, char* argv[])
+{
+	int nPairs = (argc > 1) ? atoi(argv[1]) : BENCHMARK_N_PAIRS;
+	const int patchSizes[3] = {5,7,9};
+	const int imgSize = BENCHMARK_IMAGE_SIZE;
+
+	printf("Patch distances of %d random pairs in a %dx%d image (ns per distance)\n",nPairs,imgSize,imgSize);
+	printf("patch  channels  features   scalar   kernel  speed-up  relative difference of the distances\n");
+	for (int sizeInd=0; sizeInd<3; sizeInd++)
+		for (int nTupleSize=1; nTupleSize<=3; nTupleSize+=2)
+			for (int useFeatures=0; useFeatures<=1; useFeatures++)
+			{
+				int patchSize = patchSizes[sizeInd];
+				nTupleImage *img = new nTupleImage(imgSize,imgSize,nTupleSize,patchSize,patchSize,INPAINTING_INDEXING);
+				nTupleImage *normGradX = new nTupleImage(imgSize,imgSize,1,patchSize,patchSize,INPAINTING_INDEXING);
+				nTupleImage *normGradY = new nTupleImage(imgSize,imgSize,1,patchSize,patchSize,INPAINTING_INDEXING);
+				nTupleImage *occ = new nTupleImage(imgSize,imgSize,1,patchSize,patchSize,INPAINTING_INDEXING);
+				occ->set_all_image_values(0);
+				uint64_t randomState = 1;
+				for (int y=0; y<imgSize; y++)
+					for (int x=0; x<imgSize; x++)
+					{
+						for (int c=0; c<nTupleSize; c++)
+							img->set_value(x,y,c,(imageDataType)(mix_random_bits(randomState++)%256));
+						normGradX->set_value(x,y,0,(imageDataType)(mix_random_bits(randomState++)%256));
+						normGradY->set_value(x,y,0,(imageDataType)(mix_random_bits(randomState++)%256));
+					}
+
+				//centres of the pairs of patches, inside the image
+				int hPatchSize = patchSize/2;
+				std::vector<int> positions(4*(size_t)nPairs);
+				for (size_t n=0; n<positions.size(); n++)
+					positions[n] = hPatchSize + (int)(mix_random_bits(randomState++)%(uint64_t)(imgSize-2*hPatchSize));
+
+				patchMatchParameterStruct *params = initialise_patch_match_parameters(patchSize,patchSize,imgSize,imgSize);
+				if (useFeatures)
+				{
+					params->normGradX = normGradX;
+					params->normGradY = normGradY;
+				}
+				double checksumScalar, checksumKernel;
+				double timeScalar = time_patch_distances(img,occ,positions,params,true,&checksumScalar);
+				double timeKernel = time_patch_distances(img,occ,positions,params,false,&checksumKernel);
+				printf("%dx%d  %8d  %8d  %7.1f  %7.1f  %7.2fx  %g\n",patchSize,patchSize,nTupleSize,useFeatures,
+					timeScalar,timeKernel,timeScalar/timeKernel,fabs(checksumKernel-checksumScalar)/checksumScalar);
+
+				delete params;
+				delete img;
+				delete normGradX;
+				delete normGradY;
+				delete occ;
+			}
+	return(0);
+}
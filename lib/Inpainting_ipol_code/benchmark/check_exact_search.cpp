@@ -0,0 +1,110 @@
+//check of the exact nearest neighbour search with FFTs (searchMode 2) : its nearest neighbour field must have the
+//same energy as the brute force search (searchMode 1), on a region of a test image with a square occlusion. Build and
+//run with 'make check'. Returns 0 if the energies are equal for all the patch sizes
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "image_inpainting.h"
+#include "image_operations.h"
+#include "morpho.h"
+#include "patch_match.h"
+
+#ifndef CHECK_IMAGE_FILE
+#define CHECK_IMAGE_FILE "test/barbara.png"
+#endif
+
+#ifndef CHECK_REGION_SIZE
+#define CHECK_REGION_SIZE 80
+#endif
+
+#ifndef CHECK_OCCLUSION_SIZE
+#define CHECK_OCCLUSION_SIZE 16
+#endif
+
+//the FFTs select the best source with correlations in double precision, and the distance of this source is then
+//recalculated with the patch measure : the energies may only differ if two sources are closer than the rounding errors
+#ifndef CHECK_ENERGY_TOLERANCE
+#define CHECK_ENERGY_TOLERANCE 1e-6
+#endif
+
+//energy of the nearest neighbour field of the occluded patches, with the search mode searchMode
+static double search_energy(nTupleImage *img, nTupleImage *occDilate, int searchMode)
+{
+	patchMatchParameterStruct *params = initialise_patch_match_parameters(img->patchSizeX,img->patchSizeY,
+		img->xSize,img->ySize);
+	params->fullSearch = searchMode;
+	activePixelList *activePixels = create_active_pixel_list(occDilate);
+	params->activePixels = activePixels;
+
+	nTupleImage *shiftMap = new nTupleImage(img->xSize,img->ySize,3,img->patchSizeX,img->patchSizeY,img->indexing);
+	shiftMap->set_all_image_values(0);
+	patchMatchStats stats;
+	patch_match_ANN(img,img,shiftMap,occDilate,occDilate,params,NULL,&stats);
+
+	delete shiftMap;
+	delete activePixels;
+	delete params;
+	return(stats.energy);
+}
+
+int main(int argc, char* argv[])
+{
+	const char *fileIn = (argc > 1) ? argv[1] : CHECK_IMAGE_FILE;
+	const int regionSize = CHECK_REGION_SIZE;
+
+	size_t nx,ny,nc;
+	if (read_image_size(fileIn,&nx,&ny,&nc) == -1)
+		return(-1);
+	if ( (nx < (size_t)regionSize) || (ny < (size_t)regionSize) )
+	{
+		printf("Error in check_exact_search, the image %s is smaller than %dx%d pixels.\n",fileIn,regionSize,regionSize);
+		return(-1);
+	}
+	float *inputImage = read_image_region(fileIn,(nx-regionSize)/2,(ny-regionSize)/2,regionSize,regionSize,&nc);
+	if (inputImage == NULL)
+		return(-1);
+
+	printf("Nearest neighbour field energies of the %dx%d centre of %s, with a %dx%d occlusion\n",
+		regionSize,regionSize,fileIn,CHECK_OCCLUSION_SIZE,CHECK_OCCLUSION_SIZE);
+	printf("patch  brute force          FFT  relative difference\n");
+	int nFailures = 0;
+	for (int patchSize=3; patchSize<=9; patchSize+=2)
+	{
+		nTupleImage *imgRegion = new nTupleImage(regionSize,regionSize,(int)nc,patchSize,patchSize,IMAGE_INDEXING,
+			inputImage);
+		nTupleImage *img = copy_image_nTuple(imgRegion,INPAINTING_INDEXING);
+		delete imgRegion;
+
+		//square occlusion in the middle of the region, dilated by the patch size as in the inpainting
+		nTupleImage *occ = new nTupleImage(regionSize,regionSize,1,patchSize,patchSize,INPAINTING_INDEXING);
+		occ->set_all_image_values(0);
+		int occStart = (regionSize-CHECK_OCCLUSION_SIZE)/2;
+		for (int y=occStart; y<occStart+CHECK_OCCLUSION_SIZE; y++)
+			for (int x=occStart; x<occStart+CHECK_OCCLUSION_SIZE; x++)
+				occ->set_value(x,y,0,1);
+		nTupleImage *structEl = create_structuring_element("rectangle",patchSize,patchSize);
+		nTupleImage *occDilate = imdilate(occ,structEl);
+
+		double energyBruteForce = search_energy(img,occDilate,BRUTE_FORCE_SEARCH);
+		double energyFFT = search_energy(img,occDilate,FFT_SEARCH);
+		double relativeDifference = fabs(energyFFT-energyBruteForce)/( (energyBruteForce > 0) ? energyBruteForce : 1.0 );
+		bool equal = (relativeDifference <= CHECK_ENERGY_TOLERANCE);
+		if (equal == false)
+			nFailures++;
+		printf("%dx%d  %11.1f  %11.1f  %g %s\n",patchSize,patchSize,energyBruteForce,energyFFT,relativeDifference,
+			(equal ? "" : "(different)"));
+
+		delete img;
+		delete occ;
+		delete structEl;
+		delete occDilate;
+	}
+	free_image(inputImage);
+
+	if (nFailures > 0)
+		printf("Error, the FFT search and the brute force search give different energies for %d patch sizes.\n",nFailures);
+	else
+		printf("The FFT search and the brute force search give the same energies.\n");
+	return( (nFailures > 0) ? 1 : 0 );
+}
@@ -47,20 +47,50 @@ int max_int(int a, int b)
         return b;
 }
 
-float rand_float_range(float a, float b)
+//seed of the random numbers, and number of random streams (PatchMatch calls) since it was set. They are local
+//to each thread, so the inpainting runs of concurrent threads (connected components) draw reproducible streams
+static thread_local uint64_t randomSeed = 0;
+static thread_local uint64_t randomStreamCount = 0;
+
+void set_random_seed(uint64_t seed)
 {
-	if (a == b)
-		return a;
-	else
-		return ((b-a)*((float)rand()/RAND_MAX))+a;
+	randomSeed = seed;
+	randomStreamCount = 0;
+}
+
+//the key of the stream combines the seed and the stream number, so the worker threads do not read the seed
+uint64_t next_random_stream()
+{
+	uint64_t stream = mix_random_bits(randomSeed + 0x9E3779B97F4A7C15ULL);
+	stream = mix_random_bits(stream ^ randomStreamCount);
+	randomStreamCount++;
+	return(stream);
+}
+
+counterRandomGenerator::counterRandomGenerator(uint64_t stream, int iteration, int x, int y)
+{
+	key = mix_random_bits(stream ^ (uint64_t)(uint32_t)iteration);
+	key = mix_random_bits(key ^ ( ((uint64_t)(uint32_t)y << 32) | (uint64_t)(uint32_t)x ));
+	counter = 0;
 }
 
-int rand_int_range(int a, int b)
+void counterRandomGenerator::next_batch(uint32_t *valuesOut, int nValues)
+{
+	for (int n=0; n<nValues; n++)
+		valuesOut[n] = next_uint32();
+}
+
+int counterRandomGenerator::rand_int_range(int a, int b)
+{
+	return( uniform_int_range(next_uint32(),a,b) );
+}
+
+float counterRandomGenerator::rand_float_range(float a, float b)
 {
 	if (a == b)
 		return a;
 	else
-		return ( rand()%(b-a+1) + a);
+		return ((b-a)*((float)next_uint32()/(float)UINT32_MAX))+a;
 }
 
 float round_float(float a)
@@ -91,6 +121,16 @@ long getMilliSecs()
     return t.tv_sec*1000 + t.tv_usec/1000;
 }
 
+//maximum number of threads available (1 if the code is compiled without OpenMP)
+int get_max_threads()
+{
+#ifdef _OPENMP
+	return(omp_get_max_threads());
+#else
+	return(1);
+#endif
+}
+
 char* int_to_string(int value)
 {
 	std::ostringstream os ;
@@ -157,6 +197,9 @@ void show_patch_match_parameters(patchMatchParameterStruct *patchMatchParams)
 	MY_PRINTF("alpha : %f\n", patchMatchParams->alpha);
 	MY_PRINTF("partialComparison : %d\n", patchMatchParams->partialComparison);
     MY_PRINTF("fullSearch : %d\n", patchMatchParams->fullSearch);
+    MY_PRINTF("nThreads : %d\n", patchMatchParams->nThreads);
+    MY_PRINTF("sequentialScan : %d\n", patchMatchParams->sequentialScan);
+    MY_PRINTF("quantisedMatching : %d\n", patchMatchParams->quantisedMatching);
     
     MY_PRINTF("\n");
 }
@@ -166,12 +209,20 @@ int check_patch_match_parameters(patchMatchParameterStruct *patchMatchParams)
 	//verify that parameters are positive
 	if( (patchMatchParams->patchSizeX <0) || (patchMatchParams->patchSizeY <0) ||
 		 (patchMatchParams->nIters <0) || (patchMatchParams->w <0) ||
-		 (patchMatchParams->alpha <0) )
+		 (patchMatchParams->alpha <0) || (patchMatchParams->nThreads <1) ||
+		 (patchMatchParams->convergenceThreshold <0) )
 	{
 		printf("Error, the parameters should be positive.\n");
 		return(-1);
 	}
 	 
+	//verify the search mode
+	if( (patchMatchParams->fullSearch <0) || (patchMatchParams->fullSearch >3) )
+	{
+		printf("Error, the search mode should be between 0 and 3.\n");
+		return(-1);
+	}
+	 
 	//verify that the patch sizes are odd
 	if( ( (patchMatchParams->patchSizeX)%2 == 0) || ( (patchMatchParams->patchSizeY)%2 == 0) )
 	{
@@ -181,32 +232,6 @@ int check_patch_match_parameters(patchMatchParameterStruct *patchMatchParams)
 	return(1);
 }
 
-int check_in_boundaries( nTupleImage *imgIn, int x, int y)
-{
-    if ( (x>=0) && (y>=0) && (x < ( (imgIn->xSize) )) && (y < ( (imgIn->ySize) )) )
-    {
-            return 1;
-    }
-    else
-        return 0;
-}
-
-//check if the pixel is in the inner boundary : that is, none of the pixels in the patch centred on this pixel are outside of the image boundary 
-int check_in_inner_boundaries( nTupleImage *imgIn, int x, int y, const patchMatchParameterStruct *params)
-{
-
-	int hPatchSizeX = imgIn->hPatchSizeX;
-	int hPatchSizeY = imgIn->hPatchSizeY;
-
-    if ( (x>=hPatchSizeX) && (y>=hPatchSizeY) &&
-	(x < ( (imgIn->xSize)-hPatchSizeX )) && (y < ( (imgIn->ySize)-hPatchSizeY )) )
-    {
-        return 1;
-    }
-    else
-        return 0;
-}
-
 nTupleImage::nTupleImage()    //create empty image
 {
     xSize = 0;
@@ -220,6 +245,7 @@ nTupleImage::nTupleImage()    //create empty image
     nY = 0;
     nC = 0;
 	nElsTotal = 0;
+	nElsBuffer = 0;
 	values = NULL;
     indexing = -1;
     destroyValues = 0;
@@ -243,17 +269,16 @@ nTupleImage::nTupleImage(nTupleImage *imgIn)
 	nC = imgIn->nC;
 
 	nElsTotal = imgIn->nElsTotal;
+	nElsBuffer = imgIn->nElsBuffer;
 	//copy the image info
-	values = new imageDataType[nElsTotal*nTupleSize];
-    memcpy(values,imgIn->get_value_ptr(0, 0, 0),nElsTotal*nTupleSize*sizeof(imageDataType));
+	allocate_values();
+    memcpy(values,imgIn->get_data_ptr(),(size_t)nElsBuffer*sizeof(imageDataType));
 
     destroyValues = 1;
 }
 
 nTupleImage::nTupleImage(int xSizeIn, int ySizeIn, int nTupleSizeIn, int indexingIn)
 {
-    //declarations
-	int i;
 	nTupleSize = nTupleSizeIn;
 
 	xSize = xSizeIn;
@@ -264,29 +289,9 @@ nTupleImage::nTupleImage(int xSizeIn, int ySizeIn, int nTupleSizeIn, int indexin
 	hPatchSizeX = 0;
 	hPatchSizeY = 0;
 
-    if (indexingIn == 0)    //row first
-    {
-	nC = (xSize)*(ySize);
-        nY = (xSize);
-        nX = 1;
-    }
-    else if (indexingIn == 1)   //column first
-    {
-        nC = (ySize)*(xSize);
-        nX = (ySize);
-        nY = 1;
-    }
-    else
-    {
-        MY_PRINTF("Unknown indexing : %d\n", indexingIn);
-    }
-
-	nElsTotal = (xSize)*(ySize);
-	//get dimensions and total number of elements
-	values = new imageDataType[nElsTotal*nTupleSize];
-
-	for (i=0; i<(nElsTotal*nTupleSize); i++)
-		values[i] = 0;
+    set_strides(indexingIn);
+	//allocate the values, set to 0
+	allocate_values();
     
     indexing = indexingIn;
     destroyValues = 1;
@@ -295,8 +300,6 @@ nTupleImage::nTupleImage(int xSizeIn, int ySizeIn, int nTupleSizeIn, int indexin
 nTupleImage::nTupleImage(int xSizeIn, int ySizeIn, int nTupleSizeIn,
             int patchSizeXIn, int patchSizeYIn, int indexingIn)
 {
-	//declarations
-	int i;
 	nTupleSize = nTupleSizeIn;
 
 	xSize = xSizeIn;
@@ -307,31 +310,11 @@ nTupleImage::nTupleImage(int xSizeIn, int ySizeIn, int nTupleSizeIn,
 	hPatchSizeX = (int)floor((float)patchSizeX/2);
 	hPatchSizeY = (int)floor((float)patchSizeY/2);
 
-    if (indexingIn == 0)    //row first
-    {
-		nC = (xSize)*(ySize);
-        nY = (xSize);
-        nX = 1;
-    }
-    else if (indexingIn == 1)   //column first
-    {
-        nC = (ySize)*(xSize);
-        nX = (ySize);
-        nY = 1;
-    }
-    else
-    {
-        MY_PRINTF("Unknown indexing : %d\n", indexingIn);
-    }
-
-	nElsTotal = (xSize)*(ySize);
-	//get dimensions and total number of elements
-	values = new imageDataType[nElsTotal*nTupleSize];
-
-	for (i=0; i<(nElsTotal*nTupleSize); i++)
-		values[i] = 0;
+    set_strides(indexingIn);
+	//allocate the values, set to 0
+	allocate_values();
     
-    indexing = indexingIn;  //row first
+    indexing = indexingIn;
     destroyValues = 1;
 }
 
@@ -350,29 +333,55 @@ nTupleImage::nTupleImage(int xSizeIn, int ySizeIn, int nTupleSizeIn,
 	hPatchSizeX = (int)floor((float)patchSizeX/2);
 	hPatchSizeY = (int)floor((float)patchSizeY/2);
 
-    if (indexingIn == 0)    //row first
+    set_strides(indexingIn);
+	values = valuesIn;
+    
+    indexing = indexingIn;
+    destroyValues = 0;
+}
+
+//set the strides (nX, nY, nC) and the number of elements of the image, for a given memory layout
+void nTupleImage::set_strides(int indexingIn)
+{
+    if (indexingIn == ROW_FIRST)    //row first
     {
-		nC = (xSize)*(ySize);
+		nC = (imageIndexType)(xSize)*(ySize);
         nY = (xSize);
         nX = 1;
     }
-    else if (indexingIn == 1)   //column first
+    else if (indexingIn == COLUMN_FIRST)   //column first
     {
-        nC = (ySize)*(xSize);
+        nC = (imageIndexType)(ySize)*(xSize);
         nX = (ySize);
         nY = 1;
     }
+    else if (indexingIn == PIXEL_INTERLEAVED)	//channels of a pixel are contiguous, rows are aligned
+    {
+    	int alignmentEls = IMAGE_ALIGNMENT/sizeof(imageDataType);
+        nC = 1;
+        nX = nTupleSize;
+        nY = ( ( (imageIndexType)(xSize)*nTupleSize + alignmentEls - 1)/alignmentEls )*alignmentEls;
+    }
     else
     {
         MY_PRINTF("Unknown indexing : %d\n", indexingIn);
     }
 
-	nElsTotal = (xSize)*(ySize);
-	//get dimensions and total number of elements
-	values = valuesIn;
-    
-    indexing = indexingIn;
-    destroyValues = 0;
+	nElsTotal = (imageIndexType)(xSize)*(ySize);
+	if (indexingIn == PIXEL_INTERLEAVED)
+		nElsBuffer = nY*(ySize);
+	else
+		nElsBuffer = nElsTotal*nTupleSize;
+}
+
+//allocate the (aligned) buffer of the image, and set all the values to 0
+void nTupleImage::allocate_values()
+{
+	void *valuesTemp = NULL;
+	if (posix_memalign(&valuesTemp, IMAGE_ALIGNMENT, (size_t)( (nElsBuffer > 1) ? nElsBuffer : 1 )*sizeof(imageDataType)) != 0)
+		throw std::bad_alloc();
+	values = (imageDataType*)valuesTemp;
+	memset(values, 0, (size_t)nElsBuffer*sizeof(imageDataType));
 }
 
 nTupleImage::~nTupleImage()
@@ -380,7 +389,7 @@ nTupleImage::~nTupleImage()
 	if((xSize)> 0)
     {
         if (destroyValues  == 1)
-            delete[] values;
+            free(values);
     }
 }
 
@@ -532,6 +541,14 @@ void nTupleImage::binarise()
 			}
 }
 
+void nTupleImage::set_patch_size(int patchSizeXIn, int patchSizeYIn)
+{
+	patchSizeX = patchSizeXIn;
+	patchSizeY = patchSizeYIn;
+	hPatchSizeX = (int)floor((float)patchSizeX/2);
+	hPatchSizeY = (int)floor((float)patchSizeY/2);
+}
+
 
 void nTupleImage::display_attributes()
 {
@@ -562,37 +579,325 @@ void copy_pixel_values_nTuple_image(nTupleImage *imgA, nTupleImage *imgB, int xA
 }
 
 
+nTupleImage* copy_image_nTuple(nTupleImage *imgIn, int indexingOut)
+{
+	nTupleImage *imgOut = new nTupleImage(imgIn->xSize, imgIn->ySize, imgIn->nTupleSize, imgIn->patchSizeX, imgIn->patchSizeY, indexingOut);
+	
+	for (int y=0; y< (int)imgOut->ySize; y++)
+		for (int x=0; x< (int)imgOut->xSize; x++)
+			for (int c=0; c< (int)imgOut->nTupleSize; c++)
+				imgOut->set_value(x,y,c,imgIn->get_value(x,y,c));
+	return(imgOut);
+}
+
 nTupleImage* copy_image_nTuple(nTupleImage *imgIn)
 {
 	nTupleImage *imgOut = new nTupleImage(imgIn->xSize, imgIn->ySize, imgIn->nTupleSize, imgIn->patchSizeX, imgIn->patchSizeY, imgIn->indexing);
 	
-	for (int x=0; x< (int)imgOut->xSize; x++)
-		for (int y=0; y< (int)imgOut->ySize; y++)
-			for (int c=0; c< (int)imgOut->nTupleSize; c++)
-			{
-				imageDataType valTemp = imgIn->get_value(x,y,c);
-				imgOut->set_value(x,y,c,valTemp);
-			}
+	//same memory layout : copy the whole buffer
+	memcpy(imgOut->get_data_ptr(),imgIn->get_data_ptr(),(size_t)(imgIn->nElsBuffer)*sizeof(imageDataType));
 	return(imgOut);
 }
 
-imageDataType calculate_residual(nTupleImage *imgIn, nTupleImage *imgInPrevious, nTupleImage *occIn)
+//mean absolute difference on the occluded pixels. If activePixels is not NULL, it must contain all the occluded pixels
+imageDataType calculate_residual(nTupleImage *imgIn, nTupleImage *imgInPrevious, nTupleImage *occIn,
+	activePixelList *activePixels)
 {
 	imageDataType residual = 0.0;
 	int sumOcc = 0;
 	
-	for (int x=0; x<(int)imgIn->xSize; x++)
-		for (int y=0; y<(int)imgIn->ySize; y++)
-			for (int c=0; c<(int)imgIn->nTupleSize; c++)
-				if (occIn->get_value(x,y,0) > 0)
+	for (int y=0; y<(int)imgIn->ySize; y++)
+		for (int n=get_row_start(activePixels,y); n<get_row_end(activePixels,y,imgIn->xSize); n++)
+		{
+			int x = get_active_pixel_x(activePixels,n);
+			if (occIn->get_value_fast(x,y,0) > 0)
+				for (int c=0; c<(int)imgIn->nTupleSize; c++)
 				{
-					residual = residual + (imageDataType)fabs( (float)(imgIn->get_value(x,y,c)) - (float)(imgInPrevious->get_value(x,y,c))); 
+					residual = residual + (imageDataType)fabs( (float)(imgIn->get_value_fast(x,y,c)) - (float)(imgInPrevious->get_value_fast(x,y,c))); 
 					sumOcc++;
 				}
+		}
 	return( residual/( (imageDataType)sumOcc));
 }
 
+void get_occluded_values(nTupleImage *imgIn, nTupleImage *occIn, const activePixelList *activePixels,
+	std::vector<imageDataType> &values)
+{
+	values.clear();
+	for (int y=0; y<(int)imgIn->ySize; y++)
+		for (int n=get_row_start(activePixels,y); n<get_row_end(activePixels,y,imgIn->xSize); n++)
+		{
+			int x = get_active_pixel_x(activePixels,n);
+			if (occIn->get_value_fast(x,y,0) > 0)
+				for (int c=0; c<(int)imgIn->nTupleSize; c++)
+					values.push_back(imgIn->get_value_fast(x,y,c));
+		}
+}
+
+//the differences are summed in the same order as the residual of the two images, and the unchanged pixels add zeros,
+//so both residuals are identical
+imageDataType calculate_residual(nTupleImage *imgIn, const std::vector<imageDataType> &previousValues,
+	nTupleImage *occIn, const activePixelList *activePixels, int nOccludedValues)
+{
+	imageDataType residual = 0.0;
+	size_t valueInd = 0;
+	
+	for (int y=0; y<(int)imgIn->ySize; y++)
+		for (int n=get_row_start(activePixels,y); n<get_row_end(activePixels,y,imgIn->xSize); n++)
+		{
+			int x = get_active_pixel_x(activePixels,n);
+			if (occIn->get_value_fast(x,y,0) > 0)
+				for (int c=0; c<(int)imgIn->nTupleSize; c++)
+				{
+					residual = residual + (imageDataType)fabs( (float)(imgIn->get_value_fast(x,y,c)) - (float)(previousValues[valueInd]));
+					valueInd++;
+				}
+		}
+	return( residual/( (imageDataType)nOccludedValues));
+}
+
+activePixelList* create_active_pixel_list(nTupleImage *maskIn)
+{
+	activePixelList *activePixels = new activePixelList;
+	activePixels->rowOffsets.resize(maskIn->ySize+1);
+	
+	for (int y=0; y<(maskIn->ySize); y++)
+	{
+		activePixels->rowOffsets[y] = (int)activePixels->pixels.size();
+		for (int x=0; x<(maskIn->xSize); x++)
+			if (maskIn->get_value_fast(x,y,0) > 0)
+			{
+				coord pixelTemp;
+				pixelTemp.x = x;
+				pixelTemp.y = y;
+				activePixels->pixels.push_back(pixelTemp);
+			}
+	}
+	activePixels->rowOffsets[maskIn->ySize] = (int)activePixels->pixels.size();
+	return(activePixels);
+}
+
+activePixelList* create_covered_pixel_list(nTupleImage *maskIn, nTupleImage *occIn,
+	const activePixelList *activePixels, int hPatchSizeX, int hPatchSizeY)
+{
+	activePixelList *coveredPixels = new activePixelList;
+	coveredPixels->rowOffsets.resize(maskIn->ySize+1);
+	
+	for (int y=0; y<(maskIn->ySize); y++)
+	{
+		coveredPixels->rowOffsets[y] = (int)coveredPixels->pixels.size();
+		for (int n=get_row_start(activePixels,y); n<get_row_end(activePixels,y,maskIn->xSize); n++)
+		{
+			int x = get_active_pixel_x(activePixels,n);
+			if ( (occIn != NULL) && (occIn->get_value_fast(x,y,0) <= 0) )
+				continue;
+			bool covered = false;
+			for (int yy=max_int(y-hPatchSizeY,0); (yy<=min_int(y+hPatchSizeY,(maskIn->ySize)-1)) && (!covered); yy++)
+				for (int xx=max_int(x-hPatchSizeX,0); xx<=min_int(x+hPatchSizeX,(maskIn->xSize)-1); xx++)
+					if (maskIn->get_value_fast(xx,yy,0) > 0)
+					{
+						covered = true;
+						break;
+					}
+			if (covered)
+			{
+				coord pixelTemp;
+				pixelTemp.x = x;
+				pixelTemp.y = y;
+				coveredPixels->pixels.push_back(pixelTemp);
+			}
+		}
+	}
+	coveredPixels->rowOffsets[maskIn->ySize] = (int)coveredPixels->pixels.size();
+	return(coveredPixels);
+}
+
+//create the summed-area table of the unoccluded pixels (occIn == 0) : the value at (x,y) is the number
+//of unoccluded pixels in [0,x-1]x[0,y-1], so the table has one more row and column than occIn
+unoccludedIntegral* create_unoccluded_integral_image(nTupleImage *occIn)
+{
+	unoccludedIntegral *integralImg = new unoccludedIntegral;
+	integralImg->xSize = occIn->xSize;
+	integralImg->ySize = occIn->ySize;
+	size_t integralStride = (size_t)(occIn->xSize)+1;
+	integralImg->sums.assign(integralStride*((size_t)(occIn->ySize)+1),0);
+	imageIndexType *integralPtr = &(integralImg->sums[0]);
+	
+	for (int y=0; y<(occIn->ySize); y++)
+	{
+		imageIndexType rowSum = 0;
+		for (int x=0; x<(occIn->xSize); x++)
+		{
+			rowSum = rowSum + (imageIndexType)(occIn->get_value(x,y,0) == 0);
+			integralPtr[(y+1)*integralStride + x+1] = integralPtr[y*integralStride + x+1] + rowSum;
+		}
+	}
+	return(integralImg);
+}
+
+//number of unoccluded pixels in [xMin,xMax]x[yMin,yMax], clipped to the image boundaries
+int get_integral_image_sum(const unoccludedIntegral *integralImg, int xMin, int yMin, int xMax, int yMax)
+{
+	xMin = max_int(xMin,0);
+	yMin = max_int(yMin,0);
+	xMax = min_int(xMax+1,integralImg->xSize);
+	yMax = min_int(yMax+1,integralImg->ySize);
+	if ( (xMin >= xMax) || (yMin >= yMax) )
+		return(0);
+	
+	const imageIndexType *integralPtr = &(integralImg->sums[0]);
+	size_t integralStride = (size_t)(integralImg->xSize)+1;
+	return( (int)(integralPtr[yMax*integralStride + xMax] - integralPtr[yMin*integralStride + xMax]
+		- integralPtr[yMax*integralStride + xMin] + integralPtr[yMin*integralStride + xMin]) );
+}
+
+//copy an image into a buffer padded with a halo of haloX/haloY pixels on each side. The halo is either
+//filled with zeros (HALO_ZERO) or with the value of the closest pixel of the image (HALO_REPLICATE)
+nTupleImage* create_halo_image(nTupleImage *imgIn, int haloX, int haloY, int haloType, nTupleImagePool *imagePool)
+{
+	nTupleImage *imgHalo = acquire_image(imagePool, imgIn->xSize + 2*haloX, imgIn->ySize + 2*haloY, imgIn->nTupleSize,
+		imgIn->patchSizeX, imgIn->patchSizeY, imgIn->indexing);
+	
+	for (int y=0; y<(imgHalo->ySize); y++)
+		for (int x=0; x<(imgHalo->xSize); x++)
+		{
+			int xIn = x - haloX;
+			int yIn = y - haloY;
+			if ( (haloType == HALO_ZERO) && (!check_in_boundaries(imgIn,xIn,yIn)) )
+				continue;	//the buffer is already set to 0
+			xIn = min_int(max_int(xIn,0),(imgIn->xSize)-1);
+			yIn = min_int(max_int(yIn,0),(imgIn->ySize)-1);
+			for (int c=0; c<(imgIn->nTupleSize); c++)
+				imgHalo->set_value_fast(x,y,c,imgIn->get_value_fast(xIn,yIn,c));
+		}
+	return(imgHalo);
+}
+
+//view on the buffer of imgIn. If imgIn was created by create_halo_image, haloX and haloY must be the sizes
+//of its halo : the view then covers the original image, and (0,0) is the first pixel inside the halo
+nTupleImageView get_image_view(nTupleImage *imgIn, int haloX, int haloY)
+{
+	nTupleImageView viewOut;
+	
+	viewOut.origin = imgIn->get_value_ptr_fast(haloX,haloY,0);
+	viewOut.xSize = (imgIn->xSize) - 2*haloX;
+	viewOut.ySize = (imgIn->ySize) - 2*haloY;
+	viewOut.nTupleSize = imgIn->nTupleSize;
+	viewOut.haloX = haloX;
+	viewOut.haloY = haloY;
+	viewOut.nX = imgIn->nX;
+	viewOut.nY = imgIn->nY;
+	viewOut.nC = imgIn->nC;
+	
+	return(viewOut);
+}
+
+nTupleImagePool::nTupleImagePool()
+{
+	bytesInUse = 0;
+	bytesHighWaterMark = 0;
+	bytesAllocated = 0;
+}
+
+nTupleImagePool::~nTupleImagePool()
+{
+	for (size_t n=0; n<allImages.size(); n++)
+		delete allImages[n];
+}
+
+nTupleImage* nTupleImagePool::acquire(int xSizeIn, int ySizeIn, int nTupleSizeIn, int patchSizeXIn, int patchSizeYIn, int indexingIn)
+{
+	nTupleImage *imgOut = NULL;
+	
+	#pragma omp critical(nTupleImagePool)
+	{
+		//look for a free image with the same size and memory layout
+		for (size_t n=0; n<freeImages.size(); n++)
+		{
+			nTupleImage *imgTemp = freeImages[n];
+			if ( (imgTemp->xSize == xSizeIn) && (imgTemp->ySize == ySizeIn) &&
+				(imgTemp->nTupleSize == nTupleSizeIn) && (imgTemp->indexing == indexingIn) )
+			{
+				imgOut = imgTemp;
+				freeImages[n] = freeImages.back();
+				freeImages.pop_back();
+				break;
+			}
+		}
+		if (imgOut == NULL)
+		{
+			imgOut = new nTupleImage(xSizeIn, ySizeIn, nTupleSizeIn, patchSizeXIn, patchSizeYIn, indexingIn);
+			allImages.push_back(imgOut);
+			bytesAllocated = bytesAllocated + (size_t)(imgOut->nElsBuffer)*sizeof(imageDataType);
+		}
+		bytesInUse = bytesInUse + (size_t)(imgOut->nElsBuffer)*sizeof(imageDataType);
+		bytesHighWaterMark = (bytesInUse > bytesHighWaterMark) ? bytesInUse : bytesHighWaterMark;
+	}
+	
+	imgOut->patchSizeX = patchSizeXIn;
+	imgOut->patchSizeY = patchSizeYIn;
+	imgOut->hPatchSizeX = (int)floor((float)patchSizeXIn/2);
+	imgOut->hPatchSizeY = (int)floor((float)patchSizeYIn/2);
+	memset(imgOut->get_data_ptr(),0,(size_t)(imgOut->nElsBuffer)*sizeof(imageDataType));
+	return(imgOut);
+}
+
+nTupleImage* nTupleImagePool::acquire_copy(nTupleImage *imgIn)
+{
+	nTupleImage *imgOut = acquire(imgIn->xSize, imgIn->ySize, imgIn->nTupleSize,
+		imgIn->patchSizeX, imgIn->patchSizeY, imgIn->indexing);
+	memcpy(imgOut->get_data_ptr(),imgIn->get_data_ptr(),(size_t)(imgIn->nElsBuffer)*sizeof(imageDataType));
+	return(imgOut);
+}
+
+void nTupleImagePool::release(nTupleImage *imgIn)
+{
+	if (imgIn == NULL)
+		return;
+	#pragma omp critical(nTupleImagePool)
+	{
+		freeImages.push_back(imgIn);
+		bytesInUse = bytesInUse - (size_t)(imgIn->nElsBuffer)*sizeof(imageDataType);
+	}
+}
 
+size_t nTupleImagePool::get_high_water_mark()
+{
+	return(bytesHighWaterMark);
+}
 
+size_t nTupleImagePool::get_allocated_bytes()
+{
+	return(bytesAllocated);
+}
 
+void nTupleImagePool::display_statistics()
+{
+	MY_PRINTF("Image pool : %d images allocated (%.2f MB), high-water mark : %.2f MB\n", (int)allImages.size(),
+		(double)bytesAllocated/(1024.0*1024.0), (double)bytesHighWaterMark/(1024.0*1024.0));
+}
 
+nTupleImage* acquire_image(nTupleImagePool *imagePool, int xSizeIn, int ySizeIn, int nTupleSizeIn,
+	int patchSizeXIn, int patchSizeYIn, int indexingIn)
+{
+	if (imagePool == NULL)
+		return( new nTupleImage(xSizeIn, ySizeIn, nTupleSizeIn, patchSizeXIn, patchSizeYIn, indexingIn) );
+	else
+		return( imagePool->acquire(xSizeIn, ySizeIn, nTupleSizeIn, patchSizeXIn, patchSizeYIn, indexingIn) );
+}
+
+nTupleImage* acquire_image_copy(nTupleImagePool *imagePool, nTupleImage *imgIn)
+{
+	if (imagePool == NULL)
+		return( copy_image_nTuple(imgIn) );
+	else
+		return( imagePool->acquire_copy(imgIn) );
+}
+
+void release_image(nTupleImagePool *imagePool, nTupleImage *imgIn)
+{
+	if (imagePool == NULL)
+		delete imgIn;
+	else
+		imagePool->release(imgIn);
+}
@@ -22,9 +22,12 @@
     #include <vector>
     #include <queue>
     #include <bitset>
+    #include <stdint.h>
     #include <unistd.h>
 	//#include <windows.h>
-    //#include <omp.h>
+    #ifdef _OPENMP
+    #include <omp.h>
+    #endif
         
     using std::runtime_error;
 
@@ -61,6 +64,19 @@
 	#define COLUMN_FIRST 1
 	#endif
 	
+	//pixel-major storage : the channels of a pixel are contiguous, rows are padded to IMAGE_ALIGNMENT bytes
+	#ifndef PIXEL_INTERLEAVED
+	#define PIXEL_INTERLEAVED 2
+	#endif
+	
+	#ifndef IMAGE_ALIGNMENT
+	#define IMAGE_ALIGNMENT 64
+	#endif
+	//number of bytes which may be read past the end of a quantised image
+	#ifndef QUANTISED_IMAGE_PADDING
+	#define QUANTISED_IMAGE_PADDING 32
+	#endif
+	
 	#ifndef VERBOSE_MODE
 	#define VERBOSE_MODE 0
 	#endif
@@ -71,6 +87,22 @@
         throw runtime_error(sout.str()); }
     #endif
 
+    //the unchecked accessors only check their indices in debug builds
+    #ifdef IMAGE_BOUNDS_CHECK
+    #define CHECK_IMAGE_INDICES(cond) ASSERT(cond)
+    #else
+    #define CHECK_IMAGE_INDICES(cond)
+    #endif
+    
+    //type of halo padding the image buffers
+    #ifndef HALO_ZERO
+    #define HALO_ZERO 0
+    #endif
+    
+    #ifndef HALO_REPLICATE
+    #define HALO_REPLICATE 1
+    #endif
+
     #define GET_VALUE get_value_nTuple_volume
 	#define NDIMS 2
 	typedef struct coordinate
@@ -85,11 +117,16 @@
     typedef std::vector<pairIntFloat> vectorPairIntFloat;
     
     typedef float imageDataType;
+    //offsets and numbers of elements of the image buffers (64 bits, for images of more than 2^31 values)
+    typedef int64_t imageIndexType;
 
 	class nTupleImage
 	{
         private:
             imageDataType *values;
+            
+            void set_strides(int indexingIn);
+            void allocate_values();
         
         public:
             int nTupleSize;
@@ -99,11 +136,12 @@
             int patchSizeY;
             int hPatchSizeX;
             int hPatchSizeY;
-            int nElsTotal;
+            imageIndexType nElsTotal;
+            imageIndexType nElsBuffer;	//number of elements in the buffer (including the row padding)
 
-            int nX;
-            int nY;
-            int nC;
+            imageIndexType nX;
+            imageIndexType nY;
+            imageIndexType nC;
 
 			int nDims;
                         
@@ -122,6 +160,23 @@
             imageDataType* get_data_ptr();
             void set_value(int x, int y, int c, imageDataType value);
             
+            //unchecked accessors, for the inner loops where the indices are known to be valid
+            inline imageDataType get_value_fast(int x, int y, int c) const
+            {
+                CHECK_IMAGE_INDICES( (x>=0) && (y>=0) && (c>=0) && (x<xSize) && (y<ySize) && (c<nTupleSize) );
+                return( values[ (x*(nX)) + (y*(nY)) + c*(nC)] );
+            }
+            inline imageDataType* get_value_ptr_fast(int x, int y, int c) const
+            {
+                CHECK_IMAGE_INDICES( (x>=0) && (y>=0) && (c>=0) && (x<xSize) && (y<ySize) && (c<nTupleSize) );
+                return( values + ( (x*(nX)) + (y*(nY)) + c*(nC)) );
+            }
+            inline void set_value_fast(int x, int y, int c, imageDataType value)
+            {
+                CHECK_IMAGE_INDICES( (x>=0) && (y>=0) && (c>=0) && (x<xSize) && (y<ySize) && (c<nTupleSize) );
+                values[ (x*(nX)) + (y*(nY)) + c*(nC)] = value;
+            }
+            
             void set_all_image_values(imageDataType value);
             void add(imageDataType addScalar);
             void multiply(imageDataType multiplyFactor);
@@ -132,21 +187,154 @@
             imageDataType mean_value();
             void absolute_value();
             void binarise();
+            //patch size carried by the image (the values are not modified)
+            void set_patch_size(int patchSizeXIn, int patchSizeYIn);
 
             void display_attributes();
 	};
 	
+	//pool of images, for the temporaries of an inpainting run : the images released to the pool are reused by the
+	//following acquisitions of the same size and memory layout, so the iterations do not allocate memory once the
+	//pool is warm. The pool owns all the images it has allocated, and frees them when it is destroyed
+	class nTupleImagePool
+	{
+		private:
+			std::vector<nTupleImage*> freeImages;
+			std::vector<nTupleImage*> allImages;
+			size_t bytesInUse;
+			size_t bytesHighWaterMark;
+			size_t bytesAllocated;
+		
+		public:
+			nTupleImagePool();
+			~nTupleImagePool();
+			
+			//image whose values are set to 0
+			nTupleImage* acquire(int xSizeIn, int ySizeIn, int nTupleSizeIn, int patchSizeXIn, int patchSizeYIn, int indexingIn);
+			//copy of imgIn, in the same memory layout
+			nTupleImage* acquire_copy(nTupleImage *imgIn);
+			void release(nTupleImage *imgIn);
+			
+			size_t get_high_water_mark();
+			size_t get_allocated_bytes();
+			void display_statistics();
+	};
+	
+	//lightweight view on the buffer of an nTupleImage, with raw strides and no bounds checks. If the buffer
+	//is padded with a halo (see create_halo_image), the view may be read up to haloX/haloY pixels outside the image
+	typedef struct nTupleImageView
+	{
+		imageDataType *origin;	//address of the value (0,0,0)
+		int xSize, ySize, nTupleSize;
+		int haloX, haloY;
+		imageIndexType nX, nY, nC;
+		
+		inline imageDataType* get_value_ptr(int x, int y, int c) const
+		{
+			CHECK_IMAGE_INDICES( (x>=-haloX) && (y>=-haloY) && (c>=0) && (x<xSize+haloX) && (y<ySize+haloY) && (c<nTupleSize) );
+			return( origin + ( (x*(nX)) + (y*(nY)) + c*(nC)) );
+		}
+		inline imageDataType get_value(int x, int y, int c) const
+		{
+			return( *get_value_ptr(x,y,c) );
+		}
+		inline void set_value(int x, int y, int c, imageDataType value) const
+		{
+			*get_value_ptr(x,y,c) = value;
+		}
+	}nTupleImageView;
+
+	//8-bit copy of an image, only used to compare patches (with 4 times less memory traffic than the float
+	//values) : the values are round(value*scale), clamped to [0,255], stored with the strides of the source image.
+	//The buffer is padded, so that the ssd kernels may read QUANTISED_IMAGE_PADDING bytes past the last value
+	typedef struct quantisedImageStruct
+	{
+		std::vector<uint8_t> values;
+		int xSize, ySize, nTupleSize;
+		imageIndexType nX, nY, nC;
+		float scale;
+		
+		inline const uint8_t* get_value_ptr(int x, int y, int c) const
+		{
+			CHECK_IMAGE_INDICES( (x>=0) && (y>=0) && (c>=0) && (x<xSize) && (y<ySize) && (c<nTupleSize) );
+			return( &(values[0]) + ( (x*(nX)) + (y*(nY)) + c*(nC)) );
+		}
+	}quantisedImage;
+	
+	//quantised copies of the images compared by a PatchMatch call (imgA and imgB are the float images they
+	//were made from, quantA and quantB may be the same copy) and of the texture features (NULL without features)
+	typedef struct quantisedMatchingImagesStruct
+	{
+		nTupleImage *imgA, *imgB;
+		quantisedImage *quantA, *quantB;
+		quantisedImage *normGradX, *normGradY;
+	}quantisedMatchingImages;
+
+	//list of active pixels (for example the dilated occlusion), in raster order : the pixels of the row y are
+	//pixels[rowOffsets[y]] ... pixels[rowOffsets[y+1]-1]
+	typedef struct activePixelListStruct
+	{
+		std::vector<coord> pixels;
+		std::vector<int> rowOffsets;
+	}activePixelList;
+	
+	//iteration on the pixels of a row : n goes from get_row_start to get_row_end (excluded), and the pixel is
+	//(get_active_pixel_x,y). With a NULL list, all the pixels of the row are active
+	inline int get_row_start(const activePixelList *activePixels, int y)
+	{
+		return( (activePixels == NULL) ? 0 : activePixels->rowOffsets[y] );
+	}
+	inline int get_row_end(const activePixelList *activePixels, int y, int xSize)
+	{
+		return( (activePixels == NULL) ? xSize : activePixels->rowOffsets[y+1] );
+	}
+	inline int get_active_pixel_x(const activePixelList *activePixels, int n)
+	{
+		return( (activePixels == NULL) ? n : activePixels->pixels[n].x );
+	}
+	
+	//index of the valid source positions of an image (unoccluded and in the inner boundaries), used to draw
+	//random candidates which are valid by construction. The positions are stored row by row in an active pixel
+	//list, and integral is their summed-area table : (xSize+1)*(ySize+1) counts, the count at (x,y) being the
+	//number of valid positions in [0,x-1]x[0,y-1]
+	typedef struct validSourceIndexStruct
+	{
+		activePixelList positions;
+		std::vector<int> integral;
+		int xSize;
+		int ySize;
+	}validSourceIndex;
+
+	//summed-area table of the unoccluded pixels of an occlusion : (xSize+1)*(ySize+1) counts, the count at (x,y)
+	//being the number of unoccluded pixels in [0,x-1]x[0,y-1]. The counts are 64-bit, for the large scans
+	typedef struct unoccludedIntegralStruct
+	{
+		std::vector<imageIndexType> sums;
+		int xSize;	//size of the occlusion
+		int ySize;
+	}unoccludedIntegral;
+
     typedef struct paramPM
 	{
 		//patch sizes
         int patchSizeX;
         int patchSizeY;
 		int nIters;	//number of propagation/random search steps in patchMatch
+		float convergenceThreshold;	//stop when the fraction of improved matches in a pass is below this value (0 : always nIters steps)
 		int w;		//maximum search radius
 		float alpha; //search radius shrinkage factor (0.5 in standard PatchMatch)
 		float maxShiftDistance;		//maximum absolute search distance
         int partialComparison;		//indicate whether we only compare partial patches (in the case where some patches are partially occluded)
-        int fullSearch;		//full (exhaustive) search instead of PatchMatch
+        int fullSearch;		//search mode : 0 PatchMatch, 1 brute force, 2 exact with FFTs, 3 kd-tree of PCA descriptors
+        int nThreads;		//number of threads used by PatchMatch (the result does not depend on it)
+        int sequentialScan;	//1 : each pass is a single raster scan of the shift map, as the original PatchMatch (reference, one thread)
+        uint64_t randomStream;	//random number stream of the current PatchMatch call (set by patch_match_ANN)
+        activePixelList *activePixels;	//pixels processed by PatchMatch (NULL : all the pixels)
+        nTupleImage *changedMatches;	//if not NULL, set to 1 at the pixels whose match is changed by patch_match_ANN
+        validSourceIndex *validSources;	//valid source positions for the occlusion given to patch_match_ANN (NULL : created by patch_match_ANN)
+        unoccludedIntegral *unOccludedIntegral;	//summed-area table of the unoccluded pixels of the occlusion used for partial comparison (NULL if not available)
+        int quantisedMatching;	//compare the patches on 8-bit copies of the images (the reconstruction stays in float)
+        quantisedMatchingImages *quantisedImages;	//quantised copies of the current PatchMatch call (set by patch_match_ANN)
         //texture attributes
         nTupleImage *normGradX;
         nTupleImage *normGradY;
@@ -169,19 +357,68 @@ int max_int(int a, int b);
 
 char* int_to_string(int value);
 
-float rand_float_range(float a, float b);
-int rand_int_range(int a, int b);
+//counter-based random numbers (the seed and the streams are local to the calling thread)
+void set_random_seed(uint64_t seed);
+uint64_t next_random_stream();
+
+//splitmix64 finaliser
+inline uint64_t mix_random_bits(uint64_t z)
+{
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return( z ^ (z >> 31) );
+}
+
+//uniform integer in [a,b] from 32 random bits
+inline int uniform_int_range(uint32_t randomBits, int a, int b)
+{
+	if (b <= a)
+		return a;
+	return( a + (int)( ((uint64_t)randomBits * (uint64_t)(b-a+1)) >> 32 ) );
+}
+
+//counter-based random number generator : the n-th number drawn is a hash of the random stream (which combines
+//the seed and the number of the stream), of a counter (iteration, pixel) and of n. The numbers drawn for a pixel therefore do not depend on the
+//order in which the pixels are processed, nor on the number of threads
+class counterRandomGenerator
+{
+	private:
+		uint64_t key;
+		uint64_t counter;
+	
+	public:
+		counterRandomGenerator(uint64_t stream, int iteration, int x, int y);
+		
+		inline uint32_t next_uint32()
+		{
+			counter = counter + 1;
+			return( (uint32_t)(mix_random_bits(key + counter*0x9E3779B97F4A7C15ULL) >> 32) );
+		}
+		void next_batch(uint32_t *valuesOut, int nValues);
+		int rand_int_range(int a, int b);
+		float rand_float_range(float a, float b);
+};
 float round_float(float a);
 
 long getMilliSecs();
 
+int get_max_threads();
+
 float pow_int(float a, int b);
 
 void show_patch_match_parameters(patchMatchParameterStruct *patchMatchParams);
 int check_patch_match_parameters(patchMatchParameterStruct *patchMatchParams);
 
-int check_in_boundaries( nTupleImage *imgIn, int x, int y);
-int check_in_inner_boundaries( nTupleImage *imgIn, int x, int y, const patchMatchParameterStruct *params);
+inline int check_in_boundaries( nTupleImage *imgIn, int x, int y)
+{
+    return( (x>=0) && (y>=0) && (x < (imgIn->xSize)) && (y < (imgIn->ySize)) );
+}
+//check if the pixel is in the inner boundary : that is, none of the pixels in the patch centred on this pixel are outside of the image boundary 
+inline int check_in_inner_boundaries( nTupleImage *imgIn, int x, int y, const patchMatchParameterStruct *)
+{
+    return( (x>=(imgIn->hPatchSizeX)) && (y>=(imgIn->hPatchSizeY)) &&
+	(x < ( (imgIn->xSize)-(imgIn->hPatchSizeX) )) && (y < ( (imgIn->ySize)-(imgIn->hPatchSizeY) )) );
+}
 void clamp_coordinates(nTupleImage* imgInA, int *x, int *y);
 
 //copy nTupleValues from imgA(xA,yA) to imgB(xB,yB)
@@ -190,7 +427,38 @@ void copy_pixel_values_nTuple_image(nTupleImage *imgA, nTupleImage *imgB, int xA
 void copy_pixel_values_nTuple_image(nTupleImage *imgA, nTupleImage *imgB, int x1, int y1, int x2, int y2);
 
 nTupleImage* copy_image_nTuple(nTupleImage *imgIn);
+//copy an image into a (possibly different) memory layout
+nTupleImage* copy_image_nTuple(nTupleImage *imgIn, int indexingOut);
+
+imageDataType calculate_residual(nTupleImage *imgIn, nTupleImage *imgInPrevious, nTupleImage *occIn,
+	activePixelList *activePixels = NULL);
+//values of the occluded pixels of activePixels, in the order of the list
+void get_occluded_values(nTupleImage *imgIn, nTupleImage *occIn, const activePixelList *activePixels,
+	std::vector<imageDataType> &values);
+//same residual, from the previous values of the occluded pixels of activePixels (given by get_occluded_values).
+//The other occluded pixels are unchanged, nOccludedValues counts the values of all the occluded pixels
+imageDataType calculate_residual(nTupleImage *imgIn, const std::vector<imageDataType> &previousValues,
+	nTupleImage *occIn, const activePixelList *activePixels, int nOccludedValues);
+
+//list of the pixels where maskIn > 0
+activePixelList* create_active_pixel_list(nTupleImage *maskIn);
+//list of the pixels of activePixels (only the occluded ones if occIn is not NULL) which are covered by a patch (of half
+//sizes hPatchSizeX, hPatchSizeY) centred on a pixel where maskIn > 0
+activePixelList* create_covered_pixel_list(nTupleImage *maskIn, nTupleImage *occIn,
+	const activePixelList *activePixels, int hPatchSizeX, int hPatchSizeY);
+
+//summed-area table of the unoccluded pixels
+unoccludedIntegral* create_unoccluded_integral_image(nTupleImage *occIn);
+int get_integral_image_sum(const unoccludedIntegral *integralImg, int xMin, int yMin, int xMax, int yMax);
+
+//acquire/release an image from a pool (with new/delete if the pool is NULL)
+nTupleImage* acquire_image(nTupleImagePool *imagePool, int xSizeIn, int ySizeIn, int nTupleSizeIn,
+	int patchSizeXIn, int patchSizeYIn, int indexingIn);
+nTupleImage* acquire_image_copy(nTupleImagePool *imagePool, nTupleImage *imgIn);
+void release_image(nTupleImagePool *imagePool, nTupleImage *imgIn);
 
-imageDataType calculate_residual(nTupleImage *imgIn, nTupleImage *imgInPrevious, nTupleImage *occIn);
+//halo-padded copies of images and unchecked views on their buffers
+nTupleImage* create_halo_image(nTupleImage *imgIn, int haloX, int haloY, int haloType, nTupleImagePool *imagePool = NULL);
+nTupleImageView get_image_view(nTupleImage *imgIn, int haloX = 0, int haloY = 0);
 
 #endif
@@ -0,0 +1,124 @@
+//this file defines the compile-time specialised image structures
+
+#ifndef IMAGE_STRUCTURES_TYPED_H
+#define IMAGE_STRUCTURES_TYPED_H
+
+#include "image_structures.h"
+
+	//the number of channels/patch size is only known at run time
+	#ifndef DYNAMIC_SIZE
+	#define DYNAMIC_SIZE 0
+	#endif
+
+	//typed view on an image buffer : the element type and the number of channels are template parameters, so that
+	//the loops on the channels are unrolled. With N_TUPLE == DYNAMIC_SIZE, the number of channels is read at run time.
+	//The view does not own its buffer, and its accessors are not checked (except in debug builds)
+	template <typename T, int N_TUPLE>
+	class nTupleImageT
+	{
+		private:
+			T *values;
+			int nTupleSizeIn;
+		
+		public:
+			int xSize;
+			int ySize;
+			int patchSizeX;
+			int patchSizeY;
+			int hPatchSizeX;
+			int hPatchSizeY;
+			
+			imageIndexType nX;
+			imageIndexType nY;
+			imageIndexType nC;
+			
+			nTupleImageT(T *valuesIn, int xSizeIn, int ySizeIn, int nTupleSizeIn_, int patchSizeXIn, int patchSizeYIn,
+				imageIndexType nXIn, imageIndexType nYIn, imageIndexType nCIn)
+			{
+				ASSERT( (N_TUPLE == DYNAMIC_SIZE) || (nTupleSizeIn_ == N_TUPLE) );
+				values = valuesIn;
+				nTupleSizeIn = nTupleSizeIn_;
+				xSize = xSizeIn;
+				ySize = ySizeIn;
+				patchSizeX = patchSizeXIn;
+				patchSizeY = patchSizeYIn;
+				hPatchSizeX = (int)floor((float)patchSizeX/2);
+				hPatchSizeY = (int)floor((float)patchSizeY/2);
+				nX = nXIn;
+				nY = nYIn;
+				nC = nCIn;
+			}
+			
+			inline int nTupleSize() const
+			{
+				return( (N_TUPLE == DYNAMIC_SIZE) ? nTupleSizeIn : N_TUPLE );
+			}
+			inline T* get_value_ptr(int x, int y, int c) const
+			{
+				CHECK_IMAGE_INDICES( (x>=0) && (y>=0) && (c>=0) && (x<xSize) && (y<ySize) && (c<nTupleSize()) );
+				return( values + ( (x*(nX)) + (y*(nY)) + c*(nC)) );
+			}
+			inline T get_value(int x, int y, int c) const
+			{
+				return( *get_value_ptr(x,y,c) );
+			}
+			inline void set_value(int x, int y, int c, T value) const
+			{
+				*get_value_ptr(x,y,c) = value;
+			}
+			//copy all the channels of the pixel (x,y)
+			inline void get_pixel(int x, int y, T *pixelOut) const
+			{
+				const T *pixelPtr = get_value_ptr(x,y,0);
+				for (int c=0; c<nTupleSize(); c++)
+					pixelOut[c] = pixelPtr[c*nC];
+			}
+			inline void set_pixel(int x, int y, const T *pixelIn) const
+			{
+				T *pixelPtr = get_value_ptr(x,y,0);
+				for (int c=0; c<nTupleSize(); c++)
+					pixelPtr[c*nC] = pixelIn[c];
+			}
+	};
+	
+	//typed view on the buffer of an nTupleImage
+	template <int N_TUPLE>
+	nTupleImageT<imageDataType,N_TUPLE> get_typed_image(nTupleImage *imgIn)
+	{
+		return( nTupleImageT<imageDataType,N_TUPLE>(imgIn->get_data_ptr(), imgIn->xSize, imgIn->ySize, imgIn->nTupleSize,
+			imgIn->patchSizeX, imgIn->patchSizeY, imgIn->nX, imgIn->nY, imgIn->nC) );
+	}
+	
+	//dispatch layer : KERNEL<N_TUPLE,PATCH_SIZE>::run is instantiated for the common (number of channels, patch size)
+	//combinations (1 or 3 channels, square 5x5, 7x7 and 9x9 patches). Other combinations use the dynamic version
+	//KERNEL<DYNAMIC_SIZE,DYNAMIC_SIZE>::run
+	template < template <int,int> class KERNEL >
+	typename KERNEL<DYNAMIC_SIZE,DYNAMIC_SIZE>::kernelType get_specialised_kernel(int nTupleSize, int patchSizeX, int patchSizeY)
+	{
+		if (patchSizeX == patchSizeY)
+		{
+			if (nTupleSize == 3)
+			{
+				switch (patchSizeX)
+				{
+					case 5: return(KERNEL<3,5>::run);
+					case 7: return(KERNEL<3,7>::run);
+					case 9: return(KERNEL<3,9>::run);
+					default: break;
+				}
+			}
+			else if (nTupleSize == 1)
+			{
+				switch (patchSizeX)
+				{
+					case 5: return(KERNEL<1,5>::run);
+					case 7: return(KERNEL<1,7>::run);
+					case 9: return(KERNEL<1,9>::run);
+					default: break;
+				}
+			}
+		}
+		return(KERNEL<DYNAMIC_SIZE,DYNAMIC_SIZE>::run);
+	}
+
+#endif
@@ -12,8 +12,11 @@
     #include <cstdlib> // C standard library
     #include <fstream> // file I/O
     #include <iostream>
+    #include <vector>
 	//#include <windows.h>
-    //#include <omp.h>
+    #ifdef _OPENMP
+    #include <omp.h>
+    #endif
         
     //CUDA INCLUDES
 //     #include <cuda.h>
@@ -35,6 +38,77 @@
     #ifndef DEBUG_ON
 	#define DEBUG_ON 0
 	#endif
+    
+    //specialised (vectorised) patch distance kernels for 5x5, 7x7 and 9x9 patches
+    #ifndef SSD_USE_SIMD
+	#define SSD_USE_SIMD 1
+	#endif
+    
+    //height (in rows) of the bands of the PatchMatch iterations, independent of the number of threads
+    #ifndef PARALLEL_BAND_HEIGHT
+	#define PARALLEL_BAND_HEIGHT 32
+	#endif
+    
+    //number of random search candidates drawn at once
+    #ifndef RANDOM_BATCH_SIZE
+	#define RANDOM_BATCH_SIZE 16
+	#endif
+    
+    //search modes (paramPM::fullSearch)
+    #define PATCH_MATCH_SEARCH 0
+    #define BRUTE_FORCE_SEARCH 1
+    #define FFT_SEARCH 2
+    #define KD_TREE_SEARCH 3
+    
+    //maximum cost (number of target patches x FFT size) of the exact FFT search which replaces PatchMatch
+    //at the coarsest pyramid level, 0 to always use PatchMatch
+    #ifndef FFT_SEARCH_MAX_COST
+	#define FFT_SEARCH_MAX_COST 4.0e6
+	#endif
+    
+    //kd-tree search : size of the PCA descriptors, number of source patches and of subspace iterations
+    //used to calculate the principal components, size of the leaves, number of leaves visited per target
+    //patch and number of candidates compared with the true patch distance
+    #ifndef KD_TREE_DESCRIPTOR_SIZE
+	#define KD_TREE_DESCRIPTOR_SIZE 16
+	#endif
+    #ifndef KD_TREE_PCA_SAMPLES
+	#define KD_TREE_PCA_SAMPLES 4096
+	#endif
+    #ifndef KD_TREE_PCA_ITERATIONS
+	#define KD_TREE_PCA_ITERATIONS 20
+	#endif
+    #ifndef KD_TREE_LEAF_SIZE
+	#define KD_TREE_LEAF_SIZE 8
+	#endif
+    #ifndef KD_TREE_MAX_LEAVES
+	#define KD_TREE_MAX_LEAVES 32
+	#endif
+    #ifndef KD_TREE_CANDIDATES
+	#define KD_TREE_CANDIDATES 8
+	#endif
+    
+    //maximum number of random draws for the initial match of a pixel. The draws are always valid source
+    //positions, so several draws are only needed to respect the maximum shift distance
+    #ifndef MAX_INITIALISATION_DRAWS
+	#define MAX_INITIALISATION_DRAWS 64
+	#endif
+    
+    //statistics of one propagation/random search pass
+    typedef struct patchMatchPassStatsStruct
+    {
+        long nProcessed;	//number of matches visited
+        long nImproved;		//number of matches whose patch distance decreased
+        double energyDrop;	//decrease of the sum of the patch distances
+    }patchMatchPassStats;
+    
+    //statistics of a call to patch_match_ANN
+    typedef struct patchMatchStatsStruct
+    {
+        std::vector<patchMatchPassStats> passes;
+        bool converged;		//true if the passes were stopped before params->nIters
+        double energy;		//sum of the patch distances of the valid matches at the end of the search
+    }patchMatchStats;
 
 
 #endif
@@ -19,7 +19,7 @@
 //this function calculates a nearest neighbour field, from imgA to imgB
 void patch_match_ANN(nTupleImage *imgA, nTupleImage *imgB, 
         nTupleImage *shiftMap, nTupleImage *imgOcc, nTupleImage *imgMod,
-        const patchMatchParameterStruct *params,nTupleImage *firstGuess)
+        const patchMatchParameterStruct *params,nTupleImage *firstGuess, patchMatchStats *stats)
 {
 	long startTimeTotalPatchMatch = getMilliSecs();
 	//check certain parameters
@@ -39,8 +39,53 @@ void patch_match_ANN(nTupleImage *imgA, nTupleImage *imgB,
 		MY_PRINTF("Error in patch_match_ANN, the patch size is to large for one or more of the dimensions of the image volumes.");
 		return;
 	}
+	
+	if (stats != NULL)
+	{
+		stats->passes.clear();
+		stats->converged = false;
+		stats->energy = 0.0;
+	}
+	
+	//each call draws its random numbers from a new stream
+	patchMatchParameterStruct paramsCall = *params;
+	paramsCall.randomStream = next_random_stream();
+	params = &paramsCall;
+	
+	//index of the valid source positions, if the caller did not provide it
+	validSourceIndex *validSources = NULL;
+	if (params->validSources == NULL)
+	{
+		validSources = create_valid_source_index(imgB, imgOcc, params);
+		paramsCall.validSources = validSources;
+	}
+	
+	//8-bit copies of the images for the patch comparisons
+	quantisedMatchingImages *quantisedImages = NULL;
+	if ( (params->quantisedMatching != 0) && (params->partialComparison == 0) )
+	{
+		quantisedImages = create_quantised_matching_images(imgA, imgB, params);
+		paramsCall.quantisedImages = quantisedImages;
+	}
+	else
+		paramsCall.quantisedImages = NULL;
     
-    if (params->fullSearch == 1)
+    if (params->fullSearch == FFT_SEARCH)
+    {
+        if ( (params->verboseMode) == true)
+        	MY_PRINTF("Exact nearest neighbour search with FFTs\n");
+        patch_match_fft_search(shiftMap, imgA, imgB, imgOcc, imgMod, params);
+    }
+    else if ( (params->fullSearch == KD_TREE_SEARCH) && (params->partialComparison == 0) )
+    {
+        //the kd-tree search only replaces the current matches by better ones
+        if (firstGuess != NULL)
+        	initialise_displacement_field(shiftMap, imgA, imgB, firstGuess, imgOcc, params);
+        if ( (params->verboseMode) == true)
+        	MY_PRINTF("Nearest neighbour search with a kd-tree\n");
+        patch_match_kd_tree_search(shiftMap, imgA, imgB, imgOcc, imgMod, params);
+    }
+    else if (params->fullSearch == BRUTE_FORCE_SEARCH)
     {
         if (firstGuess!= NULL)
     	{
@@ -50,7 +95,7 @@ void patch_match_ANN(nTupleImage *imgA, nTupleImage *imgB,
         startTimeTotalPatchMatch = clock();
         patch_match_full_search(shiftMap, imgA, imgB, imgOcc, imgMod,params);
     }
-    else    //normal patchMatch
+    else    //normal patchMatch (also used by the kd-tree search mode for partial comparisons)
     {
     	if (firstGuess != NULL)
     	{
@@ -63,13 +108,56 @@ void patch_match_ANN(nTupleImage *imgA, nTupleImage *imgB,
 	    }
         //show_nTuple_volume(shiftMap);
         if (check_disp_field(shiftMap, imgA, imgB,imgOcc,params) == -1)
+        {
+            delete validSources;
+            delete_quantised_matching_images(quantisedImages);
             return;
+        }
         for (int i=0; i<(params->nIters); i++)
         {
+        	patchMatchPassStats passStats;
         	patch_match_one_iteration_patch_level(shiftMap, imgA, imgB,
-        	imgOcc, imgMod, params, i);
+        	imgOcc, imgMod, params, i, &passStats);
+        	if (stats != NULL)
+        		stats->passes.push_back(passStats);
+        	if ( (params->verboseMode) == true)
+        		MY_PRINTF("Pass %d : %ld/%ld matches improved, energy drop %f\n",i,
+        			passStats.nImproved,passStats.nProcessed,passStats.energyDrop);
+        	//stop when the pass has (almost) changed nothing
+        	if ( (double)passStats.nImproved < (double)(params->convergenceThreshold)*(double)passStats.nProcessed )
+        	{
+        		if (stats != NULL)
+        			stats->converged = ( i < ((params->nIters)-1) );
+        		break;
+        	}
         }
     }
+    delete validSources;
+    delete_quantised_matching_images(quantisedImages);
+    
+    //the initialisation and the other searches do not report the changed matches : all the matches are marked
+    if ( (params->changedMatches != NULL) && ( (firstGuess != NULL) || (params->fullSearch == FFT_SEARCH) ||
+    	( (params->fullSearch == KD_TREE_SEARCH) && (params->partialComparison == 0) ) || (params->fullSearch == BRUTE_FORCE_SEARCH) ) )
+    	for (int j=0; j<(shiftMap->ySize); j++)
+    		for (int n=get_row_start(params->activePixels,j); n<get_row_end(params->activePixels,j,shiftMap->xSize); n++)
+    			params->changedMatches->set_value_fast(get_active_pixel_x(params->activePixels,n),j,0,1);
+    
+    //energy of the nearest neighbour field, to compare the search modes
+    if ( (stats != NULL) || ((params->verboseMode) == true) )
+    {
+    	double energy = 0.0;
+    	for (int j=0; j<(shiftMap->ySize); j++)
+    		for (int n=get_row_start(params->activePixels,j); n<get_row_end(params->activePixels,j,shiftMap->xSize); n++)
+    		{
+    			float ssd = shiftMap->get_value(get_active_pixel_x(params->activePixels,n),j,2);
+    			if ( (ssd >= 0) && (ssd < FLT_MAX) )
+    				energy += ssd;
+    		}
+    	if (stats != NULL)
+    		stats->energy = energy;
+    	if ( (params->verboseMode) == true)
+    		MY_PRINTF("Nearest neighbour field energy : %f\n",energy);
+    }
     if ( (params->verboseMode) == true)
     {
 		MY_PRINTF("Total PatchMatch execution time in s: %f\n",fabs(startTimeTotalPatchMatch-getMilliSecs())/1000);
@@ -6,8 +6,11 @@
 
 	#include "common_patch_match.h"
 	#include "patch_match_tools.h"
+	#include "patch_match_fft.h"
+	#include "patch_match_kd_tree.h"
 
 	void patch_match_ANN(nTupleImage *imgA, nTupleImage *imgB, nTupleImage *shiftMap,
-        nTupleImage *imgOcc, nTupleImage *imgMod, const patchMatchParameterStruct *params, nTupleImage *firstGuess=NULL);
+        nTupleImage *imgOcc, nTupleImage *imgMod, const patchMatchParameterStruct *params, nTupleImage *firstGuess=NULL,
+        patchMatchStats *stats=NULL);
         
 #endif
@@ -0,0 +1,384 @@
+/**
+ *  Copyright (C) 2017, Alasdair Newson <alasdairnewson.work@gmail.com>
+ *  Copyright (C) 2017, Andrés Almansa <andres.almansa@parisdescartes.fr>
+ *  Copyright (C) 2017, Yann Gousseau <yann.gousseau@telecom-paristech.fr>
+ *  Copyright (C) 2017, Patrick Pérez <patrick.perez@technicolor.com>
+ *
+ * This program is free software: you can use, modify and/or
+ * redistribute it under the terms of the simplified BSD
+ * License. You should have received a copy of this license along
+ * this program. If not, see
+ * <http://www.opensource.org/licenses/bsd-license.html>.
+ */
+
+//exact nearest neighbour search with FFTs. For a target patch at p, with the mask M of its compared pixels
+//(in the image, and unoccluded in the case of partial comparison), the numerator of the patch distance to
+//the source position q is :
+//		sum_k M(p+k).|A(p+k)|^2  -  2 sum_k M(p+k).<A(p+k),B(q+k)>  +  sum_k M(p+k).|B(q+k)|^2
+//where the norms and scalar products are weighted by the channel weights (1 for the colours, beta for
+//the texture features). The first term does not depend on q. The two others are cross-correlations of
+//the target templates (M.A_c and M) with the source channels (B_c and |B|^2), calculated for all the q
+//at once in the Fourier domain. When the target patch is entirely compared, the last term is the
+//precomputed norm of the source patches.
+
+#include "patch_match_fft.h"
+
+//weight of the texture features in the patch distance (same as in ssd_patch_measure)
+#define FFT_FEATURE_WEIGHT 50.0
+
+typedef struct fftPlanStruct
+{
+	int n;
+	std::vector<int> bitReverse;
+	std::vector<fftComplex> twiddles;	//exp(-2i.pi.k/n), k<n/2
+}fftPlan;
+
+//complex products written explicitly (the std::complex operator also handles infinities and NaNs, which
+//is much slower)
+static inline fftComplex complex_multiply(const fftComplex &a, const fftComplex &b)
+{
+	return( fftComplex(a.real()*b.real() - a.imag()*b.imag(), a.real()*b.imag() + a.imag()*b.real()) );
+}
+static inline fftComplex complex_conj_multiply(const fftComplex &a, const fftComplex &b)
+{
+	return( fftComplex(a.real()*b.real() + a.imag()*b.imag(), a.real()*b.imag() - a.imag()*b.real()) );
+}
+
+static int next_power_of_two(int n)
+{
+	int p = 1;
+	while (p < n)
+		p = p*2;
+	return(p);
+}
+
+static void create_fft_plan(fftPlan *plan, int n)
+{
+	int nBits = 0;
+	while ( (1<<nBits) < n)
+		nBits++;
+	plan->n = n;
+	plan->bitReverse.resize(n);
+	for (int i=0; i<n; i++)
+	{
+		int r = 0;
+		for (int b=0; b<nBits; b++)
+			if (i & (1<<b))
+				r = r | (1<<(nBits-1-b));
+		plan->bitReverse[i] = r;
+	}
+	plan->twiddles.resize(max_int(n/2,1));
+	for (int k=0; k<n/2; k++)
+		plan->twiddles[k] = std::polar(1.0,-2.0*M_PI*(double)k/(double)n);
+}
+
+//in-place radix-2 FFT of n contiguous values (the inverse transform is not normalised)
+static void fft_1d(fftComplex *data, const fftPlan *plan, bool inverse)
+{
+	int n = plan->n;
+	for (int i=0; i<n; i++)
+	{
+		int j = plan->bitReverse[i];
+		if (i < j)
+			std::swap(data[i],data[j]);
+	}
+	for (int len=2; len<=n; len=len*2)
+	{
+		int halfLen = len/2;
+		int step = n/len;
+		for (int i=0; i<n; i=i+len)
+			for (int k=0; k<halfLen; k++)
+			{
+				fftComplex w = plan->twiddles[k*step];
+				fftComplex u = data[i+k];
+				fftComplex v = inverse ? complex_conj_multiply(w,data[i+k+halfLen]) : complex_multiply(data[i+k+halfLen],w);
+				data[i+k] = u+v;
+				data[i+k+halfLen] = u-v;
+			}
+	}
+}
+
+//2D FFT of a planX.n x planY.n array, stored row by row. If nonZeroRows is not NULL, the other rows
+//are known to be zero, and their transforms are skipped
+static void fft_2d(fftComplex *data, const fftPlan *planX, const fftPlan *planY, bool inverse,
+	fftComplex *columnBuffer, const std::vector<int> *nonZeroRows)
+{
+	int nX = planX->n;
+	int nY = planY->n;
+	if (nonZeroRows != NULL)
+	{
+		for (size_t r=0; r<nonZeroRows->size(); r++)
+			fft_1d(data + (size_t)((*nonZeroRows)[r])*nX, planX, inverse);
+	}
+	else
+	{
+		for (int y=0; y<nY; y++)
+			fft_1d(data + (size_t)y*nX, planX, inverse);
+	}
+	for (int x=0; x<nX; x++)
+	{
+		for (int y=0; y<nY; y++)
+			columnBuffer[y] = data[(size_t)y*nX + x];
+		fft_1d(columnBuffer, planY, inverse);
+		for (int y=0; y<nY; y++)
+			data[(size_t)y*nX + x] = columnBuffer[y];
+	}
+}
+
+//Z is the spectrum of t1 + i.t2, where t1 and t2 are real. Add weight1.conj(T1).S1 + weight2.conj(T2).S2 to R
+//(S2 may be NULL if there is no second template)
+static void accumulate_packed_correlation(const fftComplex *Z, const fftComplex *S1, double weight1,
+	const fftComplex *S2, double weight2, fftComplex *R, int nX, int nY)
+{
+	for (int wy=0; wy<nY; wy++)
+	{
+		int wyOpp = (nY-wy) & (nY-1);
+		for (int wx=0; wx<nX; wx++)
+		{
+			size_t ind = (size_t)wy*nX + wx;
+			fftComplex zOpp = std::conj(Z[(size_t)wyOpp*nX + ((nX-wx) & (nX-1))]);
+			fftComplex T1 = 0.5*(Z[ind] + zOpp);
+			R[ind] += weight1*complex_conj_multiply(T1,S1[ind]);
+			if (S2 != NULL)
+			{
+				//T2 = (Z - zOpp)/2i
+				fftComplex diff = Z[ind] - zOpp;
+				fftComplex T2 = fftComplex(0.5*diff.imag(), -0.5*diff.real());
+				R[ind] += weight2*complex_conj_multiply(T2,S2[ind]);
+			}
+		}
+	}
+}
+
+//number of target patches of the search
+static int get_fft_search_target_number(nTupleImage *shiftMap, const patchMatchParameterStruct *params)
+{
+	if (params->activePixels != NULL)
+		return( (int)params->activePixels->pixels.size() );
+	else
+		return( (shiftMap->xSize)*(shiftMap->ySize) );
+}
+
+double get_fft_search_cost(nTupleImage *imgB, const patchMatchParameterStruct *params)
+{
+	return( (double)get_fft_search_target_number(imgB,params)*
+		(double)next_power_of_two(imgB->xSize)*(double)next_power_of_two(imgB->ySize) );
+}
+
+void patch_match_fft_search(nTupleImage *shiftMap, nTupleImage *imgA, nTupleImage *imgB,
+	nTupleImage *occIn, nTupleImage *modImg, const patchMatchParameterStruct *params)
+{
+	int nX = next_power_of_two(imgB->xSize);
+	int nY = next_power_of_two(imgB->ySize);
+	size_t fftSize = (size_t)nX*nY;
+	int hPatchSizeX = imgA->hPatchSizeX;
+	int hPatchSizeY = imgA->hPatchSizeY;
+	fftPlan planX, planY;
+	create_fft_plan(&planX,nX);
+	create_fft_plan(&planY,nY);
+	
+	//valid source positions
+	validSourceIndex *validSourcesTemp = NULL;
+	const validSourceIndex *validSources = params->validSources;
+	if (validSources == NULL)
+	{
+		validSourcesTemp = create_valid_source_index(imgB, occIn, params);
+		validSources = validSourcesTemp;
+	}
+	
+	//channels of the patch distance : the colours, then the texture features
+	std::vector<nTupleImage*> channelImagesA, channelImagesB;
+	std::vector<int> channelIndices;
+	std::vector<double> channelWeights;
+	for (int p=0; p<(imgA->nTupleSize); p++)
+	{
+		channelImagesA.push_back(imgA);
+		channelImagesB.push_back(imgB);
+		channelIndices.push_back(p);
+		channelWeights.push_back(1.0);
+	}
+	if (params->normGradX != NULL)
+	{
+		channelImagesA.push_back(params->normGradX);
+		channelImagesA.push_back(params->normGradY);
+		channelImagesB.push_back(params->normGradX);
+		channelImagesB.push_back(params->normGradY);
+		channelIndices.push_back(0);
+		channelIndices.push_back(0);
+		channelWeights.push_back(FFT_FEATURE_WEIGHT);
+		channelWeights.push_back(FFT_FEATURE_WEIGHT);
+	}
+	int nChannels = (int)channelWeights.size();
+	
+	//spectra of the source channels and of the weighted squared norm of the source pixels
+	std::vector<fftComplex> sourceSpectra((size_t)(nChannels+1)*fftSize, fftComplex(0.0,0.0));
+	std::vector<double> sourceNorms((size_t)(imgB->xSize)*(imgB->ySize), 0.0);
+	fftComplex *normSpectrum = &(sourceSpectra[(size_t)nChannels*fftSize]);
+	for (int c=0; c<nChannels; c++)
+	{
+		fftComplex *spectrum = &(sourceSpectra[(size_t)c*fftSize]);
+		for (int y=0; y<(imgB->ySize); y++)
+			for (int x=0; x<(imgB->xSize); x++)
+			{
+				double value = (double)channelImagesB[c]->get_value(x,y,channelIndices[c]);
+				spectrum[(size_t)y*nX + x] = value;
+				sourceNorms[(size_t)y*(imgB->xSize) + x] += channelWeights[c]*value*value;
+			}
+	}
+	for (int y=0; y<(imgB->ySize); y++)
+		for (int x=0; x<(imgB->xSize); x++)
+			normSpectrum[(size_t)y*nX + x] = sourceNorms[(size_t)y*(imgB->xSize) + x];
+	{
+		std::vector<fftComplex> columnBuffer(nY);
+		for (int c=0; c<=nChannels; c++)
+			fft_2d(&(sourceSpectra[(size_t)c*fftSize]), &planX, &planY, false, &(columnBuffer[0]), NULL);
+	}
+	
+	//norms of the (entire) source patches, for the target patches without masked pixels
+	std::vector<double> sourcePatchNorms((size_t)(imgB->xSize)*(imgB->ySize), 0.0);
+	for (int n=0; n<(int)validSources->positions.pixels.size(); n++)
+	{
+		int xB = validSources->positions.pixels[n].x;
+		int yB = validSources->positions.pixels[n].y;
+		double norm = 0.0;
+		for (int ky=-hPatchSizeY; ky<=hPatchSizeY; ky++)
+			for (int kx=-hPatchSizeX; kx<=hPatchSizeX; kx++)
+				norm += sourceNorms[(size_t)(yB+ky)*(imgB->xSize) + xB+kx];
+		sourcePatchNorms[(size_t)yB*(imgB->xSize) + xB] = norm;
+	}
+	
+	//target patches
+	std::vector<coord> targets;
+	for (int j=0; j<(shiftMap->ySize); j++)
+		for (int n=get_row_start(params->activePixels,j); n<get_row_end(params->activePixels,j,shiftMap->xSize); n++)
+		{
+			int i = get_active_pixel_x(params->activePixels,n);
+			if (modImg->xSize >0)
+				if (modImg->get_value(i,j,0) == 0)   //if we don't want to modify this match
+					continue;
+			coord targetTemp;
+			targetTemp.x = i;
+			targetTemp.y = j;
+			targets.push_back(targetTemp);
+		}
+	int nTargets = (int)targets.size();
+	
+	//the targets are processed in pairs : the real correlation maps of two targets are the real and
+	//imaginary parts of a single inverse FFT
+	#pragma omp parallel num_threads(params->nThreads)
+	{
+		std::vector<fftComplex> packedTemplate(fftSize), correlation(fftSize), pairCorrelation(fftSize);
+		std::vector<fftComplex> columnBuffer(nY);
+		std::vector<double> templateValues((size_t)(nChannels+1)*(2*hPatchSizeX+1)*(2*hPatchSizeY+1));
+		std::vector<int> nonZeroRows;
+		for (int ky=-hPatchSizeY; ky<=hPatchSizeY; ky++)
+			nonZeroRows.push_back( (ky+nY) & (nY-1) );
+		
+		#pragma omp for schedule(dynamic,1)
+		for (int pairNb=0; pairNb<(nTargets+1)/2; pairNb++)
+		{
+			int nPair = min_int(2,nTargets-2*pairNb);
+			bool fullPatch[2];
+			
+			for (int t=0; t<nPair; t++)
+			{
+				int xA = targets[2*pairNb+t].x;
+				int yA = targets[2*pairNb+t].y;
+				int templateSize = (2*hPatchSizeX+1)*(2*hPatchSizeY+1);
+				
+				//templates M.A_c (channels 0...nChannels-1) and M (channel nChannels)
+				fullPatch[t] = true;
+				for (int ky=-hPatchSizeY; ky<=hPatchSizeY; ky++)
+					for (int kx=-hPatchSizeX; kx<=hPatchSizeX; kx++)
+					{
+						int k = (ky+hPatchSizeY)*(2*hPatchSizeX+1) + kx+hPatchSizeX;
+						int x = xA+kx, y = yA+ky;
+						bool compared = (x>=0) && (y>=0) && (x<(imgA->xSize)) && (y<(imgA->ySize));
+						if (compared && params->partialComparison && (occIn->xSize >0))
+							compared = (occIn->get_value(x,y,0) <= 0);
+						fullPatch[t] = fullPatch[t] && compared;
+						for (int c=0; c<nChannels; c++)
+							templateValues[(size_t)c*templateSize + k] =
+								compared ? (double)channelImagesA[c]->get_value(x,y,channelIndices[c]) : 0.0;
+						templateValues[(size_t)nChannels*templateSize + k] = compared ? 1.0 : 0.0;
+					}
+				
+				//correlations in the Fourier domain, the templates being packed two by two
+				int nTemplates = fullPatch[t] ? nChannels : nChannels+1;
+				for (size_t ind=0; ind<fftSize; ind++)
+					correlation[ind] = 0.0;
+				for (int c=0; c<nTemplates; c=c+2)
+				{
+					bool hasSecond = (c+1 < nTemplates);
+					for (size_t ind=0; ind<fftSize; ind++)
+						packedTemplate[ind] = 0.0;
+					for (int ky=-hPatchSizeY; ky<=hPatchSizeY; ky++)
+						for (int kx=-hPatchSizeX; kx<=hPatchSizeX; kx++)
+						{
+							int k = (ky+hPatchSizeY)*(2*hPatchSizeX+1) + kx+hPatchSizeX;
+							size_t ind = (size_t)((ky+nY) & (nY-1))*nX + ((kx+nX) & (nX-1));
+							packedTemplate[ind] = fftComplex(templateValues[(size_t)c*templateSize + k],
+								hasSecond ? templateValues[(size_t)(c+1)*templateSize + k] : 0.0);
+						}
+					fft_2d(&(packedTemplate[0]), &planX, &planY, false, &(columnBuffer[0]), &nonZeroRows);
+					accumulate_packed_correlation(&(packedTemplate[0]),
+						&(sourceSpectra[(size_t)c*fftSize]), (c<nChannels) ? -2.0*channelWeights[c] : 1.0,
+						hasSecond ? &(sourceSpectra[(size_t)(c+1)*fftSize]) : NULL,
+						(c+1<nChannels) ? -2.0*channelWeights[c+1] : 1.0,
+						&(correlation[0]), nX, nY);
+				}
+				//the second target is multiplied by i
+				if (t == 0)
+					for (size_t ind=0; ind<fftSize; ind++)
+						pairCorrelation[ind] = correlation[ind];
+				else
+					for (size_t ind=0; ind<fftSize; ind++)
+						pairCorrelation[ind] += fftComplex(-correlation[ind].imag(), correlation[ind].real());
+			}
+			fft_2d(&(pairCorrelation[0]), &planX, &planY, true, &(columnBuffer[0]), NULL);
+			double inverseScale = 1.0/(double)fftSize;
+			
+			//best valid source position of each target
+			for (int t=0; t<nPair; t++)
+			{
+				int xA = targets[2*pairNb+t].x;
+				int yA = targets[2*pairNb+t].y;
+				double minDistance = DBL_MAX;
+				int bestX = 0, bestY = 0;
+				bool found = false;
+				for (int n=0; n<(int)validSources->positions.pixels.size(); n++)
+				{
+					int xB = validSources->positions.pixels[n].x;
+					int yB = validSources->positions.pixels[n].y;
+					if ( (params->maxShiftDistance != -1) && (check_max_shift_distance(xB-xA,yB-yA,params) == false) )
+						continue;
+					fftComplex value = pairCorrelation[(size_t)yB*nX + xB];
+					double distance = inverseScale*( (t == 0) ? value.real() : value.imag() );
+					if (fullPatch[t])
+						distance += sourcePatchNorms[(size_t)yB*(imgB->xSize) + xB];
+					if (distance < minDistance)
+					{
+						minDistance = distance;
+						bestX = xB - xA;
+						bestY = yB - yA;
+						found = true;
+					}
+				}
+				if (found == false)
+				{
+					shiftMap->set_value(xA,yA,0,0);
+					shiftMap->set_value(xA,yA,1,0);
+					shiftMap->set_value(xA,yA,2,FLT_MAX);
+					continue;
+				}
+				//the distance of the best match is recalculated with the patch measure
+				float ssd = ssd_patch_measure(imgA, imgB, occIn, xA, yA, xA+bestX, yA+bestY, -1, params);
+				shiftMap->set_value(xA,yA,0,(imageDataType)bestX);
+				shiftMap->set_value(xA,yA,1,(imageDataType)bestY);
+				shiftMap->set_value(xA,yA,2,(imageDataType)((ssd == -1) ? FLT_MAX : ssd));
+			}
+		}
+	}
+	
+	delete validSourcesTemp;
+}
@@ -0,0 +1,21 @@
+//this file declares the exact nearest neighbour search, where the patch distances to all the
+//source positions are calculated with FFT cross-correlations
+
+#ifndef PATCH_MATCH_FFT_H
+#define PATCH_MATCH_FFT_H
+
+	#include <algorithm>
+	#include <complex>
+	#include "common_patch_match.h"
+	#include "patch_match_tools.h"
+
+	typedef std::complex<double> fftComplex;
+
+	//exact nearest neighbour search of the patches of imgA (the active pixels) in imgB
+	void patch_match_fft_search(nTupleImage *shiftMap, nTupleImage *imgA, nTupleImage *imgB,
+		nTupleImage *occIn, nTupleImage *modImg, const patchMatchParameterStruct *params);
+
+	//cost of the FFT search (number of target patches x size of the FFTs)
+	double get_fft_search_cost(nTupleImage *imgB, const patchMatchParameterStruct *params);
+
+#endif
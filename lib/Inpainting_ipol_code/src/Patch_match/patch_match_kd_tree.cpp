@@ -0,0 +1,368 @@
+/**
+ *  Copyright (C) 2017, Alasdair Newson <alasdairnewson.work@gmail.com>
+ *  Copyright (C) 2017, Andrés Almansa <andres.almansa@parisdescartes.fr>
+ *  Copyright (C) 2017, Yann Gousseau <yann.gousseau@telecom-paristech.fr>
+ *  Copyright (C) 2017, Patrick Pérez <patrick.perez@technicolor.com>
+ *
+ * This program is free software: you can use, modify and/or
+ * redistribute it under the terms of the simplified BSD
+ * License. You should have received a copy of this license along
+ * this program. If not, see
+ * <http://www.opensource.org/licenses/bsd-license.html>.
+ */
+
+//nearest neighbour search with a kd-tree. Every valid source patch is projected on the first principal
+//components of the source patches (the channels being weighted so that the squared euclidean distance
+//between patch vectors is proportional to the patch distance). The descriptors are stored in a kd-tree,
+//which is searched (best bin first) for each target patch. The candidates found are then compared with
+//the true patch distance, as well as the current match of the shift map
+
+#include "patch_match_kd_tree.h"
+
+//weight of the texture features in the patch distance (same as in ssd_patch_measure)
+#define KD_TREE_FEATURE_WEIGHT 50.0
+
+typedef struct kdTreeNodeStruct
+{
+	int splitDim;		//-1 for a leaf
+	float splitValue;
+	int children[2];
+	int start;			//leaf : the points are indices[start] ... indices[end-1]
+	int end;
+}kdTreeNode;
+
+typedef struct pcaKdTreeStruct
+{
+	int patchVectorSize;
+	std::vector<float> mean;
+	std::vector<float> components;		//KD_TREE_DESCRIPTOR_SIZE x patchVectorSize
+	std::vector<float> descriptors;		//KD_TREE_DESCRIPTOR_SIZE values per source position
+	std::vector<int> indices;
+	std::vector<kdTreeNode> nodes;
+}pcaKdTree;
+
+//weighted patch vector of the patch centred on (x,y). The coordinates are clamped to the image
+static void get_patch_vector(nTupleImage *img, const patchMatchParameterStruct *params, int x, int y,
+	float *vectorOut)
+{
+	float featureWeight = (float)sqrt(KD_TREE_FEATURE_WEIGHT);
+	int ind = 0;
+	for (int ky=-(img->hPatchSizeY); ky<=(img->hPatchSizeY); ky++)
+		for (int kx=-(img->hPatchSizeX); kx<=(img->hPatchSizeX); kx++)
+		{
+			int xTemp = x+kx, yTemp = y+ky;
+			clamp_coordinates(img,&xTemp,&yTemp);
+			for (int p=0; p<(img->nTupleSize); p++)
+				vectorOut[ind++] = (float)img->get_value(xTemp,yTemp,p);
+			if (params->normGradX != NULL)
+			{
+				vectorOut[ind++] = featureWeight*(float)(params->normGradX)->get_value(xTemp,yTemp,0);
+				vectorOut[ind++] = featureWeight*(float)(params->normGradY)->get_value(xTemp,yTemp,0);
+			}
+		}
+}
+
+static void project_patch_vector(const pcaKdTree *tree, const float *patchVector, float *descriptorOut)
+{
+	for (int d=0; d<KD_TREE_DESCRIPTOR_SIZE; d++)
+	{
+		const float *component = &(tree->components[(size_t)d*(tree->patchVectorSize)]);
+		float value = 0;
+		for (int k=0; k<(tree->patchVectorSize); k++)
+			value += component[k]*(patchVector[k] - tree->mean[k]);
+		descriptorOut[d] = value;
+	}
+}
+
+//principal components of the source patch vectors (at most KD_TREE_PCA_SAMPLES of them), calculated by
+//subspace iteration on their covariance matrix
+static void calculate_principal_components(pcaKdTree *tree, nTupleImage *imgB, const validSourceIndex *validSources,
+	const patchMatchParameterStruct *params)
+{
+	int vectorSize = tree->patchVectorSize;
+	int nSources = (int)validSources->positions.pixels.size();
+	int step = max_int(1,nSources/KD_TREE_PCA_SAMPLES);
+	std::vector<float> patchVector(vectorSize);
+	std::vector<double> mean(vectorSize,0.0), covariance((size_t)vectorSize*vectorSize,0.0);
+	int nSamples = 0;
+	
+	for (int n=0; n<nSources; n=n+step)
+	{
+		get_patch_vector(imgB,params,validSources->positions.pixels[n].x,validSources->positions.pixels[n].y,&(patchVector[0]));
+		for (int k=0; k<vectorSize; k++)
+			mean[k] += patchVector[k];
+		nSamples++;
+	}
+	for (int k=0; k<vectorSize; k++)
+		mean[k] = mean[k]/max_int(nSamples,1);
+	for (int n=0; n<nSources; n=n+step)
+	{
+		get_patch_vector(imgB,params,validSources->positions.pixels[n].x,validSources->positions.pixels[n].y,&(patchVector[0]));
+		for (int k=0; k<vectorSize; k++)
+		{
+			double centredK = patchVector[k]-mean[k];
+			for (int l=k; l<vectorSize; l++)
+				covariance[(size_t)k*vectorSize+l] += centredK*(patchVector[l]-mean[l]);
+		}
+	}
+	for (int k=0; k<vectorSize; k++)
+		for (int l=0; l<k; l++)
+			covariance[(size_t)k*vectorSize+l] = covariance[(size_t)l*vectorSize+k];
+	
+	//subspace iteration, from a deterministic pseudo-random basis
+	int nComponents = KD_TREE_DESCRIPTOR_SIZE;
+	std::vector<double> basis((size_t)nComponents*vectorSize), basisTemp((size_t)nComponents*vectorSize);
+	for (size_t ind=0; ind<basis.size(); ind++)
+		basis[ind] = (double)(mix_random_bits(ind+1) >> 11)/(double)(1ULL<<53) - 0.5;
+	for (int iter=0; iter<KD_TREE_PCA_ITERATIONS; iter++)
+	{
+		if (iter > 0)
+		{
+			for (int d=0; d<nComponents; d++)
+				for (int k=0; k<vectorSize; k++)
+				{
+					double value = 0.0;
+					const double *covarianceRow = &(covariance[(size_t)k*vectorSize]);
+					const double *basisVector = &(basis[(size_t)d*vectorSize]);
+					for (int l=0; l<vectorSize; l++)
+						value += covarianceRow[l]*basisVector[l];
+					basisTemp[(size_t)d*vectorSize+k] = value;
+				}
+			basis.swap(basisTemp);
+		}
+		//Gram-Schmidt orthonormalisation
+		for (int d=0; d<nComponents; d++)
+		{
+			double *basisVector = &(basis[(size_t)d*vectorSize]);
+			for (int e=0; e<d; e++)
+			{
+				const double *otherVector = &(basis[(size_t)e*vectorSize]);
+				double dot = 0.0;
+				for (int k=0; k<vectorSize; k++)
+					dot += basisVector[k]*otherVector[k];
+				for (int k=0; k<vectorSize; k++)
+					basisVector[k] -= dot*otherVector[k];
+			}
+			double norm = 0.0;
+			for (int k=0; k<vectorSize; k++)
+				norm += basisVector[k]*basisVector[k];
+			norm = sqrt(norm);
+			for (int k=0; k<vectorSize; k++)
+				basisVector[k] = (norm > 0) ? basisVector[k]/norm : 0.0;
+		}
+	}
+	
+	tree->mean.resize(vectorSize);
+	tree->components.resize((size_t)nComponents*vectorSize);
+	for (int k=0; k<vectorSize; k++)
+		tree->mean[k] = (float)mean[k];
+	for (size_t ind=0; ind<basis.size(); ind++)
+		tree->components[ind] = (float)basis[ind];
+}
+
+//comparison of two source indices by their descriptor value along a dimension
+struct descriptorLess
+{
+	const float *descriptors;
+	int dim;
+	bool operator()(int a, int b) const
+	{
+		return( descriptors[(size_t)a*KD_TREE_DESCRIPTOR_SIZE + dim] < descriptors[(size_t)b*KD_TREE_DESCRIPTOR_SIZE + dim] );
+	}
+};
+
+//build the node of the points indices[start] ... indices[end-1], split along the dimension of largest spread
+static int build_kd_tree_node(pcaKdTree *tree, int start, int end)
+{
+	int nodeInd = (int)tree->nodes.size();
+	tree->nodes.push_back(kdTreeNode());
+	tree->nodes[nodeInd].splitDim = -1;
+	tree->nodes[nodeInd].start = start;
+	tree->nodes[nodeInd].end = end;
+	if ( (end-start) <= KD_TREE_LEAF_SIZE)
+		return(nodeInd);
+	
+	int splitDim = 0;
+	float maxSpread = 0;
+	for (int d=0; d<KD_TREE_DESCRIPTOR_SIZE; d++)
+	{
+		float minValue = FLT_MAX, maxValue = -FLT_MAX;
+		for (int n=start; n<end; n++)
+		{
+			float value = tree->descriptors[(size_t)(tree->indices[n])*KD_TREE_DESCRIPTOR_SIZE + d];
+			minValue = min_float(minValue,value);
+			maxValue = max_float(maxValue,value);
+		}
+		if ( (maxValue-minValue) > maxSpread)
+		{
+			maxSpread = maxValue-minValue;
+			splitDim = d;
+		}
+	}
+	if (maxSpread <= 0)
+		return(nodeInd);	//all the points are equal
+	
+	int middle = (start+end)/2;
+	descriptorLess comparison;
+	comparison.descriptors = &(tree->descriptors[0]);
+	comparison.dim = splitDim;
+	std::nth_element(tree->indices.begin()+start, tree->indices.begin()+middle, tree->indices.begin()+end, comparison);
+	
+	float splitValue = tree->descriptors[(size_t)(tree->indices[middle])*KD_TREE_DESCRIPTOR_SIZE + splitDim];
+	int leftChild = build_kd_tree_node(tree, start, middle);
+	int rightChild = build_kd_tree_node(tree, middle, end);
+	tree->nodes[nodeInd].splitDim = splitDim;
+	tree->nodes[nodeInd].splitValue = splitValue;
+	tree->nodes[nodeInd].children[0] = leftChild;
+	tree->nodes[nodeInd].children[1] = rightChild;
+	return(nodeInd);
+}
+
+//best bin first search : the KD_TREE_CANDIDATES nearest descriptors found in the first KD_TREE_MAX_LEAVES
+//leaves visited. Returns the number of candidates (source indices, by increasing descriptor distance)
+static int search_kd_tree(const pcaKdTree *tree, const float *descriptor, int *candidatesOut)
+{
+	float candidateDistances[KD_TREE_CANDIDATES];
+	int nCandidates = 0;
+	int nLeaves = 0;
+	//branches to visit, by increasing distance to the splitting hyperplane
+	std::priority_queue< std::pair<float,int>, std::vector< std::pair<float,int> >,
+		std::greater< std::pair<float,int> > > branches;
+	branches.push(std::make_pair(0.0f,0));
+	
+	while ( (!branches.empty()) && (nLeaves < KD_TREE_MAX_LEAVES) )
+	{
+		std::pair<float,int> branch = branches.top();
+		branches.pop();
+		if ( (nCandidates == KD_TREE_CANDIDATES) && (branch.first >= candidateDistances[nCandidates-1]) )
+			break;
+		int nodeInd = branch.second;
+		//go down to a leaf, storing the other branches
+		while (tree->nodes[nodeInd].splitDim != -1)
+		{
+			const kdTreeNode &node = tree->nodes[nodeInd];
+			float diff = descriptor[node.splitDim] - node.splitValue;
+			int nearChild = (diff < 0) ? 0 : 1;
+			branches.push(std::make_pair(diff*diff, node.children[1-nearChild]));
+			nodeInd = node.children[nearChild];
+		}
+		//compare the points of the leaf
+		const kdTreeNode &leaf = tree->nodes[nodeInd];
+		for (int n=leaf.start; n<leaf.end; n++)
+		{
+			const float *otherDescriptor = &(tree->descriptors[(size_t)(tree->indices[n])*KD_TREE_DESCRIPTOR_SIZE]);
+			float distance = 0;
+			for (int d=0; d<KD_TREE_DESCRIPTOR_SIZE; d++)
+				distance += (descriptor[d]-otherDescriptor[d])*(descriptor[d]-otherDescriptor[d]);
+			if ( (nCandidates == KD_TREE_CANDIDATES) && (distance >= candidateDistances[nCandidates-1]) )
+				continue;
+			//insertion in the sorted candidate list
+			int pos = (nCandidates < KD_TREE_CANDIDATES) ? nCandidates++ : nCandidates-1;
+			while ( (pos > 0) && (candidateDistances[pos-1] > distance) )
+			{
+				candidateDistances[pos] = candidateDistances[pos-1];
+				candidatesOut[pos] = candidatesOut[pos-1];
+				pos--;
+			}
+			candidateDistances[pos] = distance;
+			candidatesOut[pos] = tree->indices[n];
+		}
+		nLeaves++;
+	}
+	return(nCandidates);
+}
+
+void patch_match_kd_tree_search(nTupleImage *shiftMap, nTupleImage *imgA, nTupleImage *imgB,
+	nTupleImage *occIn, nTupleImage *modImg, const patchMatchParameterStruct *params)
+{
+	//valid source positions
+	validSourceIndex *validSourcesTemp = NULL;
+	const validSourceIndex *validSources = params->validSources;
+	if (validSources == NULL)
+	{
+		validSourcesTemp = create_valid_source_index(imgB, occIn, params);
+		validSources = validSourcesTemp;
+	}
+	int nSources = (int)validSources->positions.pixels.size();
+	if (nSources == 0)
+	{
+		MY_PRINTF("Error in patch_match_kd_tree_search, there is no valid source patch.\n");
+		delete validSourcesTemp;
+		return;
+	}
+	
+	pcaKdTree tree;
+	tree.patchVectorSize = (imgB->patchSizeX)*(imgB->patchSizeY)*
+		( (imgB->nTupleSize) + ((params->normGradX != NULL) ? 2 : 0) );
+	calculate_principal_components(&tree, imgB, validSources, params);
+	
+	//descriptors of the source patches, and kd-tree
+	tree.descriptors.resize((size_t)nSources*KD_TREE_DESCRIPTOR_SIZE);
+	tree.indices.resize(nSources);
+	#pragma omp parallel num_threads(params->nThreads)
+	{
+		std::vector<float> patchVector(tree.patchVectorSize);
+		#pragma omp for schedule(static)
+		for (int n=0; n<nSources; n++)
+		{
+			get_patch_vector(imgB,params,validSources->positions.pixels[n].x,validSources->positions.pixels[n].y,&(patchVector[0]));
+			project_patch_vector(&tree,&(patchVector[0]),&(tree.descriptors[(size_t)n*KD_TREE_DESCRIPTOR_SIZE]));
+			tree.indices[n] = n;
+		}
+	}
+	build_kd_tree_node(&tree, 0, nSources);
+	
+	//queries
+	#pragma omp parallel num_threads(params->nThreads)
+	{
+		std::vector<float> patchVector(tree.patchVectorSize);
+		float descriptor[KD_TREE_DESCRIPTOR_SIZE];
+		int candidates[KD_TREE_CANDIDATES];
+		
+		#pragma omp for schedule(dynamic,16)
+		for (int j=0; j<(shiftMap->ySize); j++)
+			for (int n=get_row_start(params->activePixels,j); n<get_row_end(params->activePixels,j,shiftMap->xSize); n++)
+			{
+				int i = get_active_pixel_x(params->activePixels,n);
+				if (modImg->xSize >0)
+					if (modImg->get_value(i,j,0) == 0)   //if we don't want to modify this match
+						continue;
+				
+				//current match, if it is valid
+				int bestX = (int)shiftMap->get_value(i,j,0);
+				int bestY = (int)shiftMap->get_value(i,j,1);
+				float bestSsd = FLT_MAX;
+				if ( check_in_inner_boundaries(imgB,i+bestX,j+bestY,params) && (!check_is_occluded(occIn,i+bestX,j+bestY)) &&
+					check_max_shift_distance(bestX,bestY,params) )
+				{
+					bestSsd = ssd_patch_measure(imgA, imgB, occIn, i, j, i+bestX, j+bestY, -1, params);
+					if (bestSsd == -1)
+						bestSsd = FLT_MAX;
+				}
+				
+				get_patch_vector(imgA,params,i,j,&(patchVector[0]));
+				project_patch_vector(&tree,&(patchVector[0]),descriptor);
+				int nCandidates = search_kd_tree(&tree,descriptor,candidates);
+				for (int c=0; c<nCandidates; c++)
+				{
+					int xB = validSources->positions.pixels[candidates[c]].x;
+					int yB = validSources->positions.pixels[candidates[c]].y;
+					if ( check_max_shift_distance(xB-i,yB-j,params) == false )
+						continue;
+					float ssdTemp = ssd_patch_measure(imgA, imgB, occIn, i, j, xB, yB,
+						(bestSsd < FLT_MAX) ? bestSsd : -1, params);
+					if ( (ssdTemp != -1) && (ssdTemp < bestSsd) )
+					{
+						bestSsd = ssdTemp;
+						bestX = xB-i;
+						bestY = yB-j;
+					}
+				}
+				shiftMap->set_value(i,j,0,(imageDataType)bestX);
+				shiftMap->set_value(i,j,1,(imageDataType)bestY);
+				shiftMap->set_value(i,j,2,(imageDataType)bestSsd);
+			}
+	}
+	
+	delete validSourcesTemp;
+}
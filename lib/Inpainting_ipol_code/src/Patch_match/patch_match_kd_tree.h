@@ -0,0 +1,17 @@
+//this file declares the nearest neighbour search with a kd-tree of PCA patch descriptors, an
+//alternative to PatchMatch which fills the same shift map
+
+#ifndef PATCH_MATCH_KD_TREE_H
+#define PATCH_MATCH_KD_TREE_H
+
+	#include <algorithm>
+	#include <queue>
+	#include "common_patch_match.h"
+	#include "patch_match_tools.h"
+
+	//approximate nearest neighbour search of the patches of imgA (the active pixels) in imgB. The current
+	//matches of the shift map are only replaced by better ones
+	void patch_match_kd_tree_search(nTupleImage *shiftMap, nTupleImage *imgA, nTupleImage *imgB,
+		nTupleImage *occIn, nTupleImage *modImg, const patchMatchParameterStruct *params);
+
+#endif
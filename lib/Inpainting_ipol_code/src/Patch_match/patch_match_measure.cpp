@@ -16,8 +16,411 @@
 
 #include "patch_match_measure.h"
 
+#if SSD_USE_SIMD && (defined(__SSE2__) || defined(__AVX2__) || defined(__AVX512F__))
+	#include <immintrin.h>
+#endif
+
+//vector type and operations used by the specialised ssd kernels (widest instruction set available at compile time)
+#if SSD_USE_SIMD && defined(__AVX512F__)
+	#define SSD_SIMD_WIDTH 16
+	typedef __m512 ssdVector;
+	#define SSD_ZERO() _mm512_setzero_ps()
+	#define SSD_LOAD(ptr) _mm512_loadu_ps(ptr)
+	#define SSD_LOAD_PARTIAL(ptr,n) _mm512_maskz_loadu_ps((__mmask16)((1<<(n))-1),ptr)
+	#define SSD_SUB(a,b) _mm512_sub_ps(a,b)
+	#define SSD_MUL_ADD(a,b,acc) _mm512_fmadd_ps(a,b,acc)
+	#define SSD_MASKED_TAIL 1
+	static inline float ssd_horizontal_sum(ssdVector v)
+	{
+		__m256 sum8 = _mm512_castps512_ps256(_mm512_add_ps(v,_mm512_shuffle_f32x4(v,v,0x4E)));
+		__m128 sum4 = _mm_add_ps(_mm256_castps256_ps128(sum8),_mm256_extractf128_ps(sum8,1));
+		__m128 sum2 = _mm_add_ps(sum4,_mm_movehl_ps(sum4,sum4));
+		return(_mm_cvtss_f32(_mm_add_ss(sum2,_mm_shuffle_ps(sum2,sum2,1))));
+	}
+#elif SSD_USE_SIMD && defined(__AVX2__)
+	#define SSD_SIMD_WIDTH 8
+	typedef __m256 ssdVector;
+	#define SSD_ZERO() _mm256_setzero_ps()
+	#define SSD_LOAD(ptr) _mm256_loadu_ps(ptr)
+	#define SSD_LOAD_PARTIAL(ptr,n) _mm256_maskload_ps(ptr, \
+		_mm256_cmpgt_epi32(_mm256_set1_epi32(n),_mm256_setr_epi32(0,1,2,3,4,5,6,7)))
+	#define SSD_SUB(a,b) _mm256_sub_ps(a,b)
+	#define SSD_MUL_ADD(a,b,acc) _mm256_add_ps(_mm256_mul_ps(a,b),acc)
+	#define SSD_MASKED_TAIL 1
+	static inline float ssd_horizontal_sum(ssdVector v)
+	{
+		__m128 sum4 = _mm_add_ps(_mm256_castps256_ps128(v),_mm256_extractf128_ps(v,1));
+		__m128 sum2 = _mm_add_ps(sum4,_mm_movehl_ps(sum4,sum4));
+		return(_mm_cvtss_f32(_mm_add_ss(sum2,_mm_shuffle_ps(sum2,sum2,1))));
+	}
+#elif SSD_USE_SIMD && defined(__SSE2__)
+	#define SSD_SIMD_WIDTH 4
+	typedef __m128 ssdVector;
+	#define SSD_ZERO() _mm_setzero_ps()
+	#define SSD_LOAD(ptr) _mm_loadu_ps(ptr)
+	#define SSD_SUB(a,b) _mm_sub_ps(a,b)
+	#define SSD_MUL_ADD(a,b,acc) _mm_add_ps(_mm_mul_ps(a,b),acc)
+	#define SSD_MASKED_TAIL 0
+	static inline float ssd_horizontal_sum(ssdVector v)
+	{
+		__m128 sum2 = _mm_add_ps(v,_mm_movehl_ps(v,v));
+		return(_mm_cvtss_f32(_mm_add_ss(sum2,_mm_shuffle_ps(sum2,sum2,1))));
+	}
+#else
+	#define SSD_SIMD_WIDTH 1
+	typedef float ssdVector;
+	#define SSD_ZERO() 0.0f
+	#define SSD_LOAD(ptr) (*(ptr))
+	#define SSD_SUB(a,b) ((a)-(b))
+	#define SSD_MUL_ADD(a,b,acc) ((a)*(b)+(acc))
+	#define SSD_MASKED_TAIL 0
+	static inline float ssd_horizontal_sum(ssdVector v)
+	{
+		return(v);
+	}
+#endif
+
+//accumulate the squared differences of ROW_LENGTH contiguous values
+template <int ROW_LENGTH>
+static inline void ssd_row_accumulate(const imageDataType *rowA, const imageDataType *rowB,
+	ssdVector &ssdAcc, float &ssdTail)
+{
+	int k=0;
+	for (; k+SSD_SIMD_WIDTH <= ROW_LENGTH; k=k+SSD_SIMD_WIDTH)
+	{
+		ssdVector diff = SSD_SUB(SSD_LOAD(rowA+k),SSD_LOAD(rowB+k));
+		ssdAcc = SSD_MUL_ADD(diff,diff,ssdAcc);
+	}
+#if SSD_MASKED_TAIL
+	if (k < ROW_LENGTH)
+	{
+		ssdVector diff = SSD_SUB(SSD_LOAD_PARTIAL(rowA+k,ROW_LENGTH-k),SSD_LOAD_PARTIAL(rowB+k,ROW_LENGTH-k));
+		ssdAcc = SSD_MUL_ADD(diff,diff,ssdAcc);
+	}
+	(void)ssdTail;
+#else
+	for (; k<ROW_LENGTH; k++)
+	{
+		float diff = rowA[k] - rowB[k];
+		ssdTail = ssdTail + diff*diff;
+	}
+#endif
+}
+
+//ssd kernel specialised for square PATCH_SIZE x PATCH_SIZE patches with N_TUPLE channels, for
+//patches which lie entirely inside the images, without partial comparison. The images must
+//be stored either row first (nX = 1), or pixel interleaved, in which case a patch row is a single
+//run of PATCH_SIZE*N_TUPLE values. The early termination test is carried out once per row
+template <int PATCH_SIZE, int N_TUPLE, bool INTERLEAVED>
+static float ssd_patch_measure_fixed(nTupleImage *imgA, nTupleImage *imgB, int xA, int yA,
+	int xB, int yB, float minVal, const patchMatchParameterStruct *params)
+{
+	const int hPatchSize = PATCH_SIZE/2;
+	const float sumOcc = (float)(PATCH_SIZE*PATCH_SIZE);
+	const float beta = 50.0;
+	//maximum (unnormalised) ssd before we stop the comparison
+	const float maxSsd = (minVal != -1) ? minVal*sumOcc : FLT_MAX;
+	float ssd = 0;
+
+	const imageDataType *ptrA = imgA->get_value_ptr(xA-hPatchSize, yA-hPatchSize, 0);
+	const imageDataType *ptrB = imgB->get_value_ptr(xB-hPatchSize, yB-hPatchSize, 0);
+	const imageDataType *gradXA=NULL, *gradXB=NULL, *gradYA=NULL, *gradYB=NULL;
+	if (params->normGradX != NULL)
+	{
+		gradXA = (params->normGradX)->get_value_ptr(xA-hPatchSize, yA-hPatchSize, 0);
+		gradXB = (params->normGradX)->get_value_ptr(xB-hPatchSize, yB-hPatchSize, 0);
+		gradYA = (params->normGradY)->get_value_ptr(xA-hPatchSize, yA-hPatchSize, 0);
+		gradYB = (params->normGradY)->get_value_ptr(xB-hPatchSize, yB-hPatchSize, 0);
+	}
+
+	for (int j=0; j<PATCH_SIZE; j++)
+	{
+		ssdVector ssdAcc = SSD_ZERO();
+		float ssdTail = 0;
+		if (INTERLEAVED)
+			ssd_row_accumulate<PATCH_SIZE*N_TUPLE>(ptrA + j*(imgA->nY), ptrB + j*(imgB->nY), ssdAcc, ssdTail);
+		else
+			for (int p=0; p<N_TUPLE; p++)
+				ssd_row_accumulate<PATCH_SIZE>(ptrA + j*(imgA->nY) + p*(imgA->nC),
+					ptrB + j*(imgB->nY) + p*(imgB->nC), ssdAcc, ssdTail);
+		ssd = ssd + ssd_horizontal_sum(ssdAcc) + ssdTail;
+
+		if (gradXA != NULL)
+		{
+			ssdVector gradAcc = SSD_ZERO();
+			float gradTail = 0;
+			ssd_row_accumulate<PATCH_SIZE>(gradXA + j*((params->normGradX)->nY),
+				gradXB + j*((params->normGradX)->nY), gradAcc, gradTail);
+			ssd_row_accumulate<PATCH_SIZE>(gradYA + j*((params->normGradY)->nY),
+				gradYB + j*((params->normGradY)->nY), gradAcc, gradTail);
+			ssd = ssd + beta*(ssd_horizontal_sum(gradAcc) + gradTail);
+		}
+
+		if (ssd > maxSsd)
+			return(-1);
+	}
+	return(ssd/sumOcc);
+}
+
+//sum of the squared differences of ROW_LENGTH contiguous 8-bit values : the differences are calculated on 16 bits
+//and their squares are summed on 32 bits. The last vector may read past the end of the row (the quantised images
+//are padded), the lanes beyond ROW_LENGTH are masked
+template <int ROW_LENGTH>
+static inline int ssd_row_quantised(const uint8_t *rowA, const uint8_t *rowB)
+{
+#if SSD_USE_SIMD && defined(__AVX2__)
+	__m256i ssdAcc = _mm256_setzero_si256();
+	for (int k=0; k<ROW_LENGTH; k=k+16)
+	{
+		__m256i diff = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(rowA+k))),
+			_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(rowB+k))));
+		if (k+16 > ROW_LENGTH)
+			diff = _mm256_and_si256(diff, _mm256_cmpgt_epi16(_mm256_set1_epi16((short)(ROW_LENGTH-k)),
+				_mm256_setr_epi16(0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15)));
+		ssdAcc = _mm256_add_epi32(ssdAcc,_mm256_madd_epi16(diff,diff));
+	}
+	__m128i sum4 = _mm_add_epi32(_mm256_castsi256_si128(ssdAcc),_mm256_extracti128_si256(ssdAcc,1));
+#elif SSD_USE_SIMD && defined(__SSE2__)
+	const __m128i zero = _mm_setzero_si128();
+	__m128i sum4 = zero;
+	for (int k=0; k<ROW_LENGTH; k=k+8)
+	{
+		__m128i diff = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(rowA+k)),zero),
+			_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(rowB+k)),zero));
+		if (k+8 > ROW_LENGTH)
+			diff = _mm_and_si128(diff, _mm_cmpgt_epi16(_mm_set1_epi16((short)(ROW_LENGTH-k)),
+				_mm_setr_epi16(0,1,2,3,4,5,6,7)));
+		sum4 = _mm_add_epi32(sum4,_mm_madd_epi16(diff,diff));
+	}
+#else
+	int ssd = 0;
+	for (int k=0; k<ROW_LENGTH; k++)
+	{
+		int diff = (int)rowA[k] - (int)rowB[k];
+		ssd = ssd + diff*diff;
+	}
+	return(ssd);
+#endif
+#if SSD_USE_SIMD && (defined(__AVX2__) || defined(__SSE2__))
+	sum4 = _mm_add_epi32(sum4,_mm_shuffle_epi32(sum4,0x4E));
+	sum4 = _mm_add_epi32(sum4,_mm_shuffle_epi32(sum4,0xB1));
+	return(_mm_cvtsi128_si32(sum4));
+#endif
+}
+
+//same as ssd_patch_measure_fixed, on the quantised copies of the images : the squared differences are summed
+//on integers, and converted back to the scale of the float images once per row
+template <int PATCH_SIZE, int N_TUPLE, bool INTERLEAVED>
+static float ssd_patch_measure_quantised(const quantisedMatchingImages *quantisedImages, int xA, int yA,
+	int xB, int yB, float minVal, const patchMatchParameterStruct *)
+{
+	const int hPatchSize = PATCH_SIZE/2;
+	const float sumOcc = (float)(PATCH_SIZE*PATCH_SIZE);
+	const float beta = 50.0;
+	const quantisedImage *quantA = quantisedImages->quantA;
+	const quantisedImage *quantB = quantisedImages->quantB;
+	const quantisedImage *gradX = quantisedImages->normGradX;
+	const quantisedImage *gradY = quantisedImages->normGradY;
+	//maximum (unnormalised) ssd before we stop the comparison
+	const float maxSsd = (minVal != -1) ? minVal*sumOcc : FLT_MAX;
+	const float colourFactor = 1.0f/((quantA->scale)*(quantA->scale));
+	float ssd = 0;
+
+	const uint8_t *ptrA = quantA->get_value_ptr(xA-hPatchSize, yA-hPatchSize, 0);
+	const uint8_t *ptrB = quantB->get_value_ptr(xB-hPatchSize, yB-hPatchSize, 0);
+	const uint8_t *gradXA=NULL, *gradXB=NULL, *gradYA=NULL, *gradYB=NULL;
+	float gradFactor = 0;
+	if (gradX != NULL)
+	{
+		gradXA = gradX->get_value_ptr(xA-hPatchSize, yA-hPatchSize, 0);
+		gradXB = gradX->get_value_ptr(xB-hPatchSize, yB-hPatchSize, 0);
+		gradYA = gradY->get_value_ptr(xA-hPatchSize, yA-hPatchSize, 0);
+		gradYB = gradY->get_value_ptr(xB-hPatchSize, yB-hPatchSize, 0);
+		gradFactor = beta/((gradX->scale)*(gradX->scale));
+	}
+
+	for (int j=0; j<PATCH_SIZE; j++)
+	{
+		int colourSsd = 0;
+		if (INTERLEAVED)
+			colourSsd = ssd_row_quantised<PATCH_SIZE*N_TUPLE>(ptrA + j*(quantA->nY), ptrB + j*(quantB->nY));
+		else
+			for (int p=0; p<N_TUPLE; p++)
+				colourSsd = colourSsd + ssd_row_quantised<PATCH_SIZE>(ptrA + j*(quantA->nY) + p*(quantA->nC),
+					ptrB + j*(quantB->nY) + p*(quantB->nC));
+		ssd = ssd + colourFactor*(float)colourSsd;
+
+		if (gradXA != NULL)
+		{
+			int gradSsd = ssd_row_quantised<PATCH_SIZE>(gradXA + j*(gradX->nY), gradXB + j*(gradX->nY)) +
+				ssd_row_quantised<PATCH_SIZE>(gradYA + j*(gradY->nY), gradYB + j*(gradY->nY));
+			ssd = ssd + gradFactor*(float)gradSsd;
+		}
+
+		if (ssd > maxSsd)
+			return(-1);
+	}
+	return(ssd/sumOcc);
+}
+
+//returns the specialised ssd kernel for the patch and image, or NULL if there is none
+typedef float (*ssdKernelFunction)(nTupleImage*, nTupleImage*, int, int, int, int, float, const patchMatchParameterStruct*);
+
+static ssdKernelFunction get_ssd_kernel(nTupleImage *imgA, nTupleImage *imgB, const patchMatchParameterStruct *params)
+{
+	bool planar = (imgA->nX == 1) && (imgB->nX == 1);
+	bool interleaved = (imgA->indexing == PIXEL_INTERLEAVED) && (imgB->indexing == PIXEL_INTERLEAVED);
+	if ( (imgA->patchSizeX != imgA->patchSizeY) || ( (!planar) && (!interleaved) ) )
+		return(NULL);
+	if ( (params->normGradX != NULL) && ( ((params->normGradX)->nX != 1) || ((params->normGradY)->nX != 1) ) )
+		return(NULL);
+
+	#define SSD_KERNEL_CASE(patchSize) \
+		case patchSize : \
+			if (imgA->nTupleSize == 1) \
+				return(&ssd_patch_measure_fixed<patchSize,1,false>); \
+			else if (imgA->nTupleSize == 3 && planar) \
+				return(&ssd_patch_measure_fixed<patchSize,3,false>); \
+			else if (imgA->nTupleSize == 3) \
+				return(&ssd_patch_measure_fixed<patchSize,3,true>); \
+			return(NULL);
+
+	switch (imgA->patchSizeX)
+	{
+		SSD_KERNEL_CASE(5)
+		SSD_KERNEL_CASE(7)
+		SSD_KERNEL_CASE(9)
+		default :
+			return(NULL);
+	}
+	#undef SSD_KERNEL_CASE
+}
+
+//returns the ssd kernel on the quantised copies of the images, or NULL if there is none
+typedef float (*quantisedSsdKernelFunction)(const quantisedMatchingImages*, int, int, int, int, float, const patchMatchParameterStruct*);
+
+static quantisedSsdKernelFunction get_ssd_kernel_quantised(nTupleImage *imgA, nTupleImage *imgB,
+	const patchMatchParameterStruct *params)
+{
+	const quantisedMatchingImages *quantisedImages = params->quantisedImages;
+	if ( (quantisedImages->imgA != imgA) || (quantisedImages->imgB != imgB) ||
+		( (params->normGradX != NULL) != (quantisedImages->normGradX != NULL) ) )
+		return(NULL);
+	if (get_ssd_kernel(imgA, imgB, params) == NULL)	//same memory layouts as the float kernels
+		return(NULL);
+	bool planar = (imgA->nX == 1) && (imgB->nX == 1);
+
+	#define SSD_QUANTISED_KERNEL_CASE(patchSize) \
+		case patchSize : \
+			if (imgA->nTupleSize == 1) \
+				return(&ssd_patch_measure_quantised<patchSize,1,false>); \
+			else if (planar) \
+				return(&ssd_patch_measure_quantised<patchSize,3,false>); \
+			return(&ssd_patch_measure_quantised<patchSize,3,true>);
+
+	switch (imgA->patchSizeX)
+	{
+		SSD_QUANTISED_KERNEL_CASE(5)
+		SSD_QUANTISED_KERNEL_CASE(7)
+		SSD_QUANTISED_KERNEL_CASE(9)
+		default :
+			return(NULL);
+	}
+	#undef SSD_QUANTISED_KERNEL_CASE
+}
+
+//quantisation scale of a set of images : the largest value is mapped to 255
+static float get_quantisation_scale(nTupleImage *img1, nTupleImage *img2)
+{
+	float maxValue = max_float(img1->max_value(), img2->max_value());
+	return( (maxValue > 0) ? (255.0f/maxValue) : 1.0f );
+}
+
+//8-bit copy of imgIn, in the same memory layout
+static quantisedImage* create_quantised_image(nTupleImage *imgIn, float scale,
+	const patchMatchParameterStruct *params)
+{
+	quantisedImage *quantImg = new quantisedImage;
+	quantImg->xSize = imgIn->xSize;
+	quantImg->ySize = imgIn->ySize;
+	quantImg->nTupleSize = imgIn->nTupleSize;
+	quantImg->nX = imgIn->nX;
+	quantImg->nY = imgIn->nY;
+	quantImg->nC = imgIn->nC;
+	quantImg->scale = scale;
+	quantImg->values.assign((size_t)(imgIn->nElsBuffer) + QUANTISED_IMAGE_PADDING, 0);
+	
+	uint8_t *valuesPtr = &(quantImg->values[0]);
+	(void)params;	//without OpenMP
+	#pragma omp parallel for schedule(static) num_threads(params->nThreads)
+	for (int y=0; y<(imgIn->ySize); y++)
+		for (int x=0; x<(imgIn->xSize); x++)
+			for (int c=0; c<(imgIn->nTupleSize); c++)
+			{
+				float value = (imgIn->get_value_fast(x,y,c))*scale + 0.5f;
+				valuesPtr[ x*(imgIn->nX) + y*(imgIn->nY) + c*(imgIn->nC) ] =
+					(uint8_t)( (value <= 0) ? 0 : ( (value >= 255) ? 255 : (int)value ) );
+			}
+	return(quantImg);
+}
+
+quantisedMatchingImages* create_quantised_matching_images(nTupleImage *imgA, nTupleImage *imgB,
+	const patchMatchParameterStruct *params)
+{
+	quantisedMatchingImages *quantisedImages = new quantisedMatchingImages;
+	float scale = get_quantisation_scale(imgA, imgB);
+	quantisedImages->imgA = imgA;
+	quantisedImages->imgB = imgB;
+	quantisedImages->quantA = create_quantised_image(imgA, scale, params);
+	quantisedImages->quantB = (imgB == imgA) ? quantisedImages->quantA : create_quantised_image(imgB, scale, params);
+	quantisedImages->normGradX = NULL;
+	quantisedImages->normGradY = NULL;
+	if ( (params->normGradX != NULL) && (params->normGradY != NULL) )
+	{
+		float gradScale = get_quantisation_scale(params->normGradX, params->normGradY);
+		quantisedImages->normGradX = create_quantised_image(params->normGradX, gradScale, params);
+		quantisedImages->normGradY = create_quantised_image(params->normGradY, gradScale, params);
+	}
+	return(quantisedImages);
+}
+
+void delete_quantised_matching_images(quantisedMatchingImages *quantisedImages)
+{
+	if (quantisedImages == NULL)
+		return;
+	if (quantisedImages->quantB != quantisedImages->quantA)
+		delete quantisedImages->quantB;
+	delete quantisedImages->quantA;
+	delete quantisedImages->normGradX;
+	delete quantisedImages->normGradY;
+	delete quantisedImages;
+}
+
 float ssd_patch_measure(nTupleImage *imgA, nTupleImage *imgB, nTupleImage *occIn, int xA, int yA,
 int xB, int yB, float minVal, const patchMatchParameterStruct *params)
+{
+	//fast path : specialised kernel, when both patches are entirely inside the images
+	if ( (params->partialComparison == 0) && (imgA->nTupleSize == imgB->nTupleSize) &&
+		(imgA->patchSizeX == imgB->patchSizeX) && (imgA->patchSizeY == imgB->patchSizeY) &&
+		check_in_inner_boundaries(imgA, xA, yA, params) && check_in_inner_boundaries(imgB, xB, yB, params) )
+	{
+		if (params->quantisedImages != NULL)
+		{
+			quantisedSsdKernelFunction quantisedSsdKernel = get_ssd_kernel_quantised(imgA, imgB, params);
+			if (quantisedSsdKernel != NULL)
+				return(quantisedSsdKernel(params->quantisedImages, xA, yA, xB, yB, minVal, params));
+		}
+		ssdKernelFunction ssdKernel = get_ssd_kernel(imgA, imgB, params);
+		if (ssdKernel != NULL)
+			return(ssdKernel(imgA, imgB, xA, yA, xB, yB, minVal, params));
+	}
+	return(ssd_patch_measure_scalar(imgA, imgB, occIn, xA, yA, xB, yB, minVal, params));
+}
+
+//generic (scalar) patch distance, used for partial comparisons, patches on the image borders
+//and patch sizes without a specialised kernel
+float ssd_patch_measure_scalar(nTupleImage *imgA, nTupleImage *imgB, nTupleImage *occIn, int xA, int yA,
+int xB, int yB, float minVal, const patchMatchParameterStruct *params)
 {
 	//declarations
 	int i,j, p,xAtemp, yAtemp, xBtemp, yBtemp;
@@ -42,7 +445,14 @@ int xB, int yB, float minVal, const patchMatchParameterStruct *params)
     
     sumOcc = 0;
     
-    if (params->partialComparison)
+    if (params->partialComparison && (params->unOccludedIntegral != NULL) &&
+        ((params->unOccludedIntegral->xSize) == (occIn->xSize)) && ((params->unOccludedIntegral->ySize) == (occIn->ySize)))
+    {
+        //count the unoccluded pixels with the summed-area table of the occlusion
+        sumOcc = get_integral_image_sum(params->unOccludedIntegral, xMinA, yMinA,
+        	xMinA + imgA->patchSizeX - 1, yMinA + imgA->patchSizeY - 1);
+    }
+    else if (params->partialComparison)
     {
         for (j=0; j<imgA->patchSizeY; j++)
             for (i=0; i<imgA->patchSizeX; i++)
@@ -86,15 +496,15 @@ int xB, int yB, float minVal, const patchMatchParameterStruct *params)
                 continue;   //we do not wish to compare this pixel
             /*if we want partial patch comparison*/
             if (params->partialComparison && occIn->xSize >0)
-                occA = (int)(*(occIn->get_value_ptr(xAtemp, yAtemp,0)) == 1);
+                occA = (int)(*(occIn->get_value_ptr_fast(xAtemp, yAtemp,0)) == 1);
             if (occA == 1)
                 continue;   //we do not wish to compare this pixel
             
             /* similarity */
 			for (p=0; p<imgA->nTupleSize; p++)
 			{
-				imageDataType imgAval = imgA->get_value(xAtemp, yAtemp,p);
-				imageDataType imgBval = imgB->get_value(xBtemp, yBtemp,p);
+				imageDataType imgAval = imgA->get_value_fast(xAtemp, yAtemp,p);
+				imageDataType imgBval = imgB->get_value_fast(xBtemp, yBtemp,p);
 				tempVal = (imgAval) - (imgBval);
 				ssd = ssd + (imageDataType)(((tempVal)*(tempVal))/sumOcc);
                 //ssd = ssd + (abs(tempFloat))/sumOcc;
@@ -102,11 +512,11 @@ int xB, int yB, float minVal, const patchMatchParameterStruct *params)
             
             if( params->normGradX != NULL)
             {            
-                imageDataType normGradXtemp = (params->normGradX)->get_value(xAtemp,yAtemp,0) 
-                							- (params->normGradX)->get_value(xBtemp,yBtemp,0);
+                imageDataType normGradXtemp = (params->normGradX)->get_value_fast(xAtemp,yAtemp,0) 
+                							- (params->normGradX)->get_value_fast(xBtemp,yBtemp,0);
                                     
-                imageDataType normGradYtemp = (params->normGradY)->get_value(xAtemp,yAtemp,0) 
-                							- (params->normGradY)->get_value(xBtemp,yBtemp,0);
+                imageDataType normGradYtemp = (params->normGradY)->get_value_fast(xAtemp,yAtemp,0) 
+                							- (params->normGradY)->get_value_fast(xBtemp,yBtemp,0);
 
                 ssd = ssd + beta*normGradXtemp*normGradXtemp/sumOcc;
                 ssd = ssd + beta*normGradYtemp*normGradYtemp/sumOcc;
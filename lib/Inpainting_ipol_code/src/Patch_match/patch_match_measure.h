@@ -9,5 +9,13 @@
 
     float ssd_patch_measure(nTupleImage *imgA, nTupleImage *imgB,
     nTupleImage *occIn, int xA, int yA, int xB, int yB, float minVal, const patchMatchParameterStruct *params);
+    float ssd_patch_measure_scalar(nTupleImage *imgA, nTupleImage *imgB,
+    nTupleImage *occIn, int xA, int yA, int xB, int yB, float minVal, const patchMatchParameterStruct *params);
+    
+    //quantised copies of imgA, imgB and of the features of params, used by ssd_patch_measure when they are
+    //attached to params->quantisedImages
+    quantisedMatchingImages* create_quantised_matching_images(nTupleImage *imgA, nTupleImage *imgB,
+    const patchMatchParameterStruct *params);
+    void delete_quantised_matching_images(quantisedMatchingImages *quantisedImages);
 
 #endif
@@ -55,12 +55,146 @@ int check_is_occluded( nTupleImage *imgOcc, int x, int y)
 		return 0;
 }
 
+//create the index of the positions of arrivalImage which are valid sources : unoccluded, and in the inner
+//boundaries. The rows are independent, so the index is built in parallel. The rows of lowerSources (an index of
+//the bottom of the image, which may be narrower) are copied
+validSourceIndex* create_valid_source_index(nTupleImage *arrivalImage, nTupleImage *occIn,
+	const patchMatchParameterStruct *params, const validSourceIndex *lowerSources)
+{
+	validSourceIndex *validSources = new validSourceIndex;
+	int xSize = arrivalImage->xSize;
+	int ySize = arrivalImage->ySize;
+	size_t stride = (size_t)xSize+1;
+	std::vector<int> &integral = validSources->integral;
+	std::vector<int> &rowOffsets = validSources->positions.rowOffsets;
+	
+	validSources->xSize = xSize;
+	validSources->ySize = ySize;
+	integral.assign(stride*((size_t)ySize+1),0);
+	rowOffsets.resize(ySize+1);
+	int yLower = (lowerSources != NULL) ? ySize-(lowerSources->ySize) : ySize;
+	
+	//prefix counts of each row, in the row y+1 of the table
+	#pragma omp parallel for schedule(static) num_threads(params->nThreads)
+	for (int y=0; y<ySize; y++)
+	{
+		int *rowPtr = &(integral[((size_t)y+1)*stride]);
+		if (y >= yLower)
+		{
+			size_t lowerStride = (size_t)(lowerSources->xSize)+1;
+			const int *lowerPtr = &(lowerSources->integral[((size_t)(y-yLower)+1)*lowerStride]);
+			const int *lowerPrevPtr = &(lowerSources->integral[(size_t)(y-yLower)*lowerStride]);
+			for (int x=0; x<xSize; x++)
+			{
+				int xLower = min_int(x+1,lowerSources->xSize);
+				rowPtr[x+1] = lowerPtr[xLower] - lowerPrevPtr[xLower];
+			}
+			continue;
+		}
+		for (int x=0; x<xSize; x++)
+			rowPtr[x+1] = rowPtr[x] +
+				( (check_in_inner_boundaries(arrivalImage,x,y,params) && (!check_is_occluded(occIn,x,y))) ? 1 : 0 );
+	}
+	
+	rowOffsets[0] = 0;
+	for (int y=0; y<ySize; y++)
+		rowOffsets[y+1] = rowOffsets[y] + integral[((size_t)y+1)*stride + xSize];
+	validSources->positions.pixels.resize(rowOffsets[ySize]);
+	
+	//list of the valid positions
+	#pragma omp parallel for schedule(static) num_threads(params->nThreads)
+	for (int y=0; y<ySize; y++)
+	{
+		const int *rowPtr = &(integral[((size_t)y+1)*stride]);
+		int n = rowOffsets[y];
+		for (int x=0; x<xSize; x++)
+			if (rowPtr[x+1] > rowPtr[x])
+			{
+				validSources->positions.pixels[n].x = x;
+				validSources->positions.pixels[n].y = y;
+				n++;
+			}
+	}
+	
+	//accumulate the row prefix counts to get the summed-area table
+	for (int y=1; y<=ySize; y++)
+	{
+		int *rowPtr = &(integral[(size_t)y*stride]);
+		const int *rowPrevPtr = &(integral[((size_t)y-1)*stride]);
+		for (size_t x=0; x<stride; x++)
+			rowPtr[x] += rowPrevPtr[x];
+	}
+	
+	return(validSources);
+}
+
+//number of valid positions in [xMin,xMax]x[yMin,yMax], the window being already clipped to the image
+static inline int count_valid_sources_clipped(const validSourceIndex *validSources, int xMin, int yMin, int xMax, int yMax)
+{
+	const int *integralPtr = &(validSources->integral[0]);
+	size_t stride = (size_t)(validSources->xSize)+1;
+	return( integralPtr[((size_t)yMax+1)*stride + xMax+1] - integralPtr[(size_t)yMin*stride + xMax+1]
+		- integralPtr[((size_t)yMax+1)*stride + xMin] + integralPtr[(size_t)yMin*stride + xMin] );
+}
+
+//number of valid positions in [xMin,xMax]x[yMin,yMax] (the window is clipped to the image)
+int count_valid_sources(const validSourceIndex *validSources, int xMin, int yMin, int xMax, int yMax)
+{
+	xMin = max_int(xMin,0);
+	yMin = max_int(yMin,0);
+	xMax = min_int(xMax,(validSources->xSize)-1);
+	yMax = min_int(yMax,(validSources->ySize)-1);
+	if ( (xMin > xMax) || (yMin > yMax) )
+		return(0);
+	return(count_valid_sources_clipped(validSources,xMin,yMin,xMax,yMax));
+}
+
+//draw a position uniformly among the valid positions of the window [xMin,xMax]x[yMin,yMax], with one random
+//number. The row of the position is found by a binary search on the summed-area table, and its column is
+//read in the position list. Returns false if there is no valid position in the window
+bool draw_valid_source(const validSourceIndex *validSources, uint32_t randomBits,
+	int xMin, int yMin, int xMax, int yMax, int *xOut, int *yOut)
+{
+	xMin = max_int(xMin,0);
+	yMin = max_int(yMin,0);
+	xMax = min_int(xMax,(validSources->xSize)-1);
+	yMax = min_int(yMax,(validSources->ySize)-1);
+	if ( (xMin > xMax) || (yMin > yMax) )
+		return(false);
+	int nValid = count_valid_sources_clipped(validSources,xMin,yMin,xMax,yMax);
+	if (nValid == 0)
+		return(false);
+	
+	int k = uniform_int_range(randomBits,0,nValid-1);
+	//first row yLow such that there are more than k valid positions in the rows [yMin,yLow]
+	int yLow = yMin, yHigh = yMax;
+	while (yLow < yHigh)
+	{
+		int yMid = (yLow+yHigh)/2;
+		if (count_valid_sources_clipped(validSources,xMin,yMin,xMax,yMid) > k)
+			yHigh = yMid;
+		else
+			yLow = yMid+1;
+	}
+	if (yLow > yMin)
+		k = k - count_valid_sources_clipped(validSources,xMin,yMin,xMax,yLow-1);
+	
+	//index of the first valid position of the row which is in the window
+	size_t stride = (size_t)(validSources->xSize)+1;
+	int n = validSources->positions.rowOffsets[yLow] + validSources->integral[((size_t)yLow+1)*stride + xMin]
+		- validSources->integral[(size_t)yLow*stride + xMin];
+	*xOut = validSources->positions.pixels[n+k].x;
+	*yOut = yLow;
+	return(true);
+}
+
 void calclulate_patch_distances(nTupleImage *departImage, nTupleImage *arrivalImage, nTupleImage *shiftMap, nTupleImage *occIn,
 		const patchMatchParameterStruct *params)
 {
 	for (int j=0; j< (shiftMap->ySize); j++)
-		for (int i=0; i< (shiftMap->xSize); i++)
+		for (int n=get_row_start(params->activePixels,j); n<get_row_end(params->activePixels,j,shiftMap->xSize); n++)
 		{
+			int i = get_active_pixel_x(params->activePixels,n);
 			if (check_in_inner_boundaries(departImage, i, j, params) == 1)
 			{
 				int xShift,yShift;
@@ -102,8 +236,11 @@ int check_disp_field(nTupleImage *shiftMap, nTupleImage *departImage, nTupleImag
 
 	returnVal = 0;
 	for (j=hPatchSizeY; j< ((shiftMap->ySize) -hPatchSizeY); j++)
-		for (i=hPatchSizeX; i< ((shiftMap->xSize) -hPatchSizeX); i++)
+		for (int n=get_row_start(params->activePixels,j); n<get_row_end(params->activePixels,j,shiftMap->xSize); n++)
 		{
+			i = get_active_pixel_x(params->activePixels,n);
+			if ( (i < hPatchSizeX) || (i >= ((shiftMap->xSize) -hPatchSizeX)) )
+				continue;
 			dispValX = (int)shiftMap->get_value(i,j,0);
 			dispValY = (int)shiftMap->get_value(i,j,1);
 
@@ -184,108 +321,80 @@ void patch_match_full_search(nTupleImage *shiftMap, nTupleImage *imgA, nTupleIma
 void initialise_displacement_field(nTupleImage *shiftMap, nTupleImage *departImage, 
             nTupleImage *arrivalImage, nTupleImage *firstGuess, nTupleImage *occIn, const patchMatchParameterStruct *params)
 {
-	//declarations
-	int xDisp, yDisp;
-	int xMin,xMax,yMin,yMax;
-	int xFirst,yFirst;
-	int isNotOcc;
-    float ssdTemp;
-
-	int hPatchSizeX = (int)floor(((float)arrivalImage->patchSizeX)/2);
-	int hPatchSizeY = (int)floor(((float)arrivalImage->patchSizeY)/2);
-
-	int hPatchSizeCeilX = (int)ceil(((float)arrivalImage->patchSizeX)/2);
-	int hPatchSizeCeilY = (int)ceil(((float)arrivalImage->patchSizeY)/2);
-
+	//the pixels are independent, and their random numbers do not depend on the processing order.
+	//The random positions are drawn among the valid source positions
+	#pragma omp parallel for schedule(dynamic,1) num_threads(params->nThreads)
 	for (int i=0; i< (shiftMap->xSize); i++)
 		for (int j=0; j< (shiftMap->ySize); j++)
 		{
-			isNotOcc = 0;
-            //if there is a valid first guess
-            while(isNotOcc == 0)
-            {
-                //if there is a first guess, and it is in the inner boundaries, and respects the minimum shift distance
-                if ( (firstGuess->xSize >0) && (check_in_inner_boundaries(arrivalImage,i+(int)firstGuess->get_value(i,j,0),
-                    j+(int)firstGuess->get_value(i,j,1),params )) &&
-                    (check_max_shift_distance((int)firstGuess->get_value(i,j,0),
-                    (int)firstGuess->get_value(i,j,1),params ))
-                    )
-                {
-                    //if it is not occluded, we take the initial first guess and continue
-                    if (!check_is_occluded(occIn,i+(int)firstGuess->get_value(i,j,0),j+(int)firstGuess->get_value(i,j,1) ) )
-                    {
-                        xDisp = (int)firstGuess->get_value(i,j,0);
-                        yDisp = (int)firstGuess->get_value(i,j,1);
-                        isNotOcc = 1;
-                        continue;
-                    }
-                    else    //otherwise, we set up the calculation of a random initial starting point, centred on the initial guess
-                    {
-                        xFirst = i+(int)firstGuess->get_value(i,j,0);
-                        yFirst = j+(int)firstGuess->get_value(i,j,1);
-                        xMin = max_int(xFirst-params->w,hPatchSizeX);
-                        xMax = min_int(xFirst+params->w,arrivalImage->xSize - hPatchSizeX -1);
-                        yMin = max_int(yFirst-params->w,hPatchSizeY);
-                        yMax = min_int(yFirst+params->w,arrivalImage->ySize - hPatchSizeY -1);
-                        shiftMap->set_value(i,j,0,-1);
-                        shiftMap->set_value(i,j,1,-1);
-                        shiftMap->set_value(i,j,2,-1);
-                        
-                    }
-                }
-                else    //by default, set the displacement to float_max
-                {
-                    shiftMap->set_value(i,j,0,(imageDataType)FLT_MAX);
-                    shiftMap->set_value(i,j,1,(imageDataType)FLT_MAX);
-                }   
-                if (arrivalImage->xSize == arrivalImage->patchSizeX)	//special case where the patch size is the size of the dimension
-                {
-                    xDisp = 0;
-                }
-                else{
-                    if ( (shiftMap->get_value(i,j,0) == FLT_MAX) || (firstGuess->xSize == 0))  //default behaviour
-                    {
-                        xDisp = ((rand()%( (arrivalImage->xSize) -2*hPatchSizeCeilX-1)) + hPatchSizeX)-i;
-                    }
-                    else    //based on an initial guess
-                    {
-                        xDisp = (int)((int)round_float(rand_float_range((float)(xMin),(float)(xMax))) - i);
-                    }
-                }
-                if (arrivalImage->ySize == arrivalImage->patchSizeY)	//special case where the patch size is the size of the dimension
-                {
-                    yDisp = 0;
-                }
-                else{
-                    if ( (shiftMap->get_value(i,j,1) == FLT_MAX) || (firstGuess->xSize == 0))  //default behaviour
-                    {
-                        yDisp = ((rand()%( (arrivalImage->ySize) -2*hPatchSizeCeilY-1)) + hPatchSizeY)-j;
-                    }
-                    else    //based on an initial guess
-                    {
-                        yDisp = (int)(round_float(rand_float_range((float)(yMin),(float)(yMax))) - j);
-                    }
-                }
-
-                isNotOcc = (!(check_is_occluded(occIn,xDisp+i,yDisp+j))
-                         &&(check_in_inner_boundaries(arrivalImage,xDisp+i,yDisp+j,params))
-                         &&(check_max_shift_distance(xDisp,yDisp,params))
-                         );
-            }
-            //if everything is all right, set the displacements
-            shiftMap->set_value(i,j,0, (imageDataType)(xDisp));
-            shiftMap->set_value(i,j,1, (imageDataType)(yDisp));
+			//declarations
+			int xDisp = 0, yDisp = 0;
+			int xRand,yRand;
+			bool isValid = false;
+			float ssdTemp;
+			counterRandomGenerator randomGenerator(params->randomStream, -1, i, j);
+			//window of the random draws, the whole image by default
+			int xMin = 0, xMax = (arrivalImage->xSize)-1;
+			int yMin = 0, yMax = (arrivalImage->ySize)-1;
+			
+			//if there is a first guess, and it is in the inner boundaries, and respects the minimum shift distance
+			if ( (firstGuess->xSize >0) && (check_in_inner_boundaries(arrivalImage,i+(int)firstGuess->get_value(i,j,0),
+				j+(int)firstGuess->get_value(i,j,1),params )) &&
+				(check_max_shift_distance((int)firstGuess->get_value(i,j,0),
+				(int)firstGuess->get_value(i,j,1),params ))
+				)
+			{
+				//if it is not occluded, we take the initial first guess
+				if (!check_is_occluded(occIn,i+(int)firstGuess->get_value(i,j,0),j+(int)firstGuess->get_value(i,j,1) ) )
+				{
+					xDisp = (int)firstGuess->get_value(i,j,0);
+					yDisp = (int)firstGuess->get_value(i,j,1);
+					isValid = true;
+				}
+				else    //otherwise, the random initial starting point is centred on the initial guess
+				{
+					int xFirst = i+(int)firstGuess->get_value(i,j,0);
+					int yFirst = j+(int)firstGuess->get_value(i,j,1);
+					xMin = xFirst-params->w;
+					xMax = xFirst+params->w;
+					yMin = yFirst-params->w;
+					yMax = yFirst+params->w;
+				}
+			}
+			if (params->maxShiftDistance != -1)
+			{
+				int maxShift = (int)floor(params->maxShiftDistance);
+				xMin = max_int(xMin,i-maxShift);
+				xMax = min_int(xMax,i+maxShift);
+				yMin = max_int(yMin,j-maxShift);
+				yMax = min_int(yMax,j+maxShift);
+			}
+			for (int drawNb=0; (isValid == false) && (drawNb < MAX_INITIALISATION_DRAWS); drawNb++)
+			{
+				if (draw_valid_source(params->validSources, randomGenerator.next_uint32(),
+					xMin, yMin, xMax, yMax, &xRand, &yRand) == false)
+					break;	//there is no valid position in the window
+				if (check_max_shift_distance(xRand-i,yRand-j,params))
+				{
+					xDisp = xRand-i;
+					yDisp = yRand-j;
+					isValid = true;
+				}
+			}
+			//set the displacements
+			shiftMap->set_value(i,j,0, (imageDataType)(xDisp));
+			shiftMap->set_value(i,j,1, (imageDataType)(yDisp));
 
-            if (check_in_inner_boundaries(departImage,i,j,params))
-            {
-                ssdTemp = ssd_patch_measure(departImage, arrivalImage,occIn, i, j, i+xDisp, j+yDisp, -1,params);
-                if(ssdTemp ==-1)
-                    ssdTemp = FLT_MAX;
-            }
-            else
-                ssdTemp = FLT_MAX;
-            shiftMap->set_value(i,j,2,(imageDataType)ssdTemp); //set the ssd error
-        }
+			if ( isValid && check_in_inner_boundaries(departImage,i,j,params))
+			{
+				ssdTemp = ssd_patch_measure(departImage, arrivalImage,occIn, i, j, i+xDisp, j+yDisp, -1,params);
+				if(ssdTemp ==-1)
+					ssdTemp = FLT_MAX;
+			}
+			else
+				ssdTemp = FLT_MAX;
+			shiftMap->set_value(i,j,2,(imageDataType)ssdTemp); //set the ssd error
+		}
 }
 
 
@@ -298,7 +407,8 @@ void initialise_displacement_field(nTupleImage *shiftMap, nTupleImage *departIma
 /******************************************/
 
 void patch_match_one_iteration_patch_level(nTupleImage *shiftMap, nTupleImage *departImage, nTupleImage *arrivalImage,
-        nTupleImage *occIn, nTupleImage *modImg, const patchMatchParameterStruct *params, int iterationNb)
+        nTupleImage *occIn, nTupleImage *modImg, const patchMatchParameterStruct *params, int iterationNb,
+        patchMatchPassStats *passStats)
 {
 	int wMax, zMax;
 	//calculate the maximum z (patch search index)
@@ -314,43 +424,147 @@ void patch_match_one_iteration_patch_level(nTupleImage *shiftMap, nTupleImage *d
                 );
     }
 
+    patchMatchPassStats passStatsTemp;
+    if (passStats == NULL)
+    	passStats = &passStatsTemp;
+    if (params->sequentialScan == 0)
+    	patch_match_one_iteration_parallel(shiftMap, departImage, arrivalImage,
+    		occIn, modImg, params, iterationNb, wValues, passStats);
+    else	//sequential reference : a single raster scan of the whole shift map
+    {
+    	passStats->nProcessed = 0;
+    	passStats->nImproved = 0;
+    	passStats->energyDrop = 0.0;
+    	patch_match_scan_rows(shiftMap, departImage, arrivalImage,
+    		occIn, modImg, params, iterationNb, 0, shiftMap->ySize, wValues, passStats);
+    }
+	delete wValues;
+}
+
+//count the match of one pixel in the statistics of the current pass. A match whose
+//previous distance was not valid (FLT_MAX) is counted as improved, without energy drop
+static inline void update_pass_stats(patchMatchPassStats *passStats, float errorBefore, float errorAfter)
+{
+	passStats->nProcessed++;
+	if (errorAfter < errorBefore)
+	{
+		passStats->nImproved++;
+		if (errorBefore < FLT_MAX)
+			passStats->energyDrop += (double)(errorBefore - errorAfter);
+	}
+}
+
+//mark the match of a pixel in params->changedMatches if the propagation or the random search changed it
+static inline void update_changed_matches(nTupleImage *shiftMap, const patchMatchParameterStruct *params, int i, int j,
+	imageDataType xShiftBefore, imageDataType yShiftBefore, float errorBefore)
+{
+	if ( (params->changedMatches != NULL) && ( (shiftMap->get_value(i,j,0) != xShiftBefore) ||
+		(shiftMap->get_value(i,j,1) != yShiftBefore) || (shiftMap->get_value(i,j,2) != errorBefore) ) )
+		params->changedMatches->set_value_fast(i,j,0,1);
+}
+
+//propagation and random search on the rows [jMin,jMax) of the shift map, in raster order
+//(forwards on even iterations, backwards on odd iterations). Only the active pixels are processed.
+//The number of processed and improved matches, and the energy drop, are added to passStats
+void patch_match_scan_rows(nTupleImage *shiftMap, nTupleImage *departImage, nTupleImage *arrivalImage,
+        nTupleImage *occIn, nTupleImage *modImg, const patchMatchParameterStruct *params, int iterationNb,
+        int jMin, int jMax, nTupleImage *wValues, patchMatchPassStats *passStats)
+{
+    const activePixelList *activePixels = params->activePixels;
+    float errorBefore,errorAfter;
+    
     if (iterationNb&1)  //if we are on an odd iteration
     {
-        for (int j=((shiftMap->ySize) -1); j>= 0; j--)
-            for (int i=((shiftMap->xSize) -1); i>= 0; i--)
+        for (int j=(jMax-1); j>= jMin; j--)
+            for (int n=(get_row_end(activePixels,j,shiftMap->xSize) -1); n>= get_row_start(activePixels,j); n--)
             {
-                                //propagation
+                int i = get_active_pixel_x(activePixels,n);
+                errorBefore = shiftMap->get_value(i,j,2);
+                imageDataType xShiftBefore = shiftMap->get_value(i,j,0), yShiftBefore = shiftMap->get_value(i,j,1);
+                //propagation
                 patch_match_propagation_patch_level(shiftMap, departImage, arrivalImage, occIn,  
                 params, iterationNb, i, j);
                 
                 //random search
                 patch_match_random_search_patch_level(shiftMap, departImage, arrivalImage,
-                occIn, modImg, params, i, j, wValues);
+                occIn, modImg, params, iterationNb, i, j, wValues);
+                errorAfter = shiftMap->get_value(i,j,2);
+                update_pass_stats(passStats, errorBefore, errorAfter);
+                update_changed_matches(shiftMap, params, i, j, xShiftBefore, yShiftBefore, errorBefore);
             }
     }
     else    //if we are on an even iteration
     {
 
-    	for (int j=0; j< ((shiftMap->ySize) ); j++)
-    		for (int i=0; i< ((shiftMap->xSize) ); i++)
+    	for (int j=jMin; j< jMax; j++)
+    		for (int n=get_row_start(activePixels,j); n< get_row_end(activePixels,j,shiftMap->xSize); n++)
     		{
+    			int i = get_active_pixel_x(activePixels,n);
+    			errorBefore = shiftMap->get_value(i,j,2);
+    			imageDataType xShiftBefore = shiftMap->get_value(i,j,0), yShiftBefore = shiftMap->get_value(i,j,1);
     			//propagation
     			patch_match_propagation_patch_level(shiftMap, departImage, arrivalImage, occIn,  
         		params, iterationNb, i, j);
     			
     			//random search
     			patch_match_random_search_patch_level(shiftMap, departImage, arrivalImage,
-        		occIn, modImg, params, i, j, wValues);
+        		occIn, modImg, params, iterationNb, i, j, wValues);
+    			errorAfter = shiftMap->get_value(i,j,2);
+    			update_pass_stats(passStats, errorBefore, errorAfter);
+    			update_changed_matches(shiftMap, params, i, j, xShiftBefore, yShiftBefore, errorBefore);
     		}
     }
-	delete wValues
-;}
+}
+
+//parallel version of one PatchMatch iteration. The shift map is cut into horizontal bands,
+//and each band is scanned in raster order by one thread. Propagation only reads the row
+//above (even iterations) or below (odd iterations) the current pixel, so the bands are
+//processed in two phases : first the even bands, then the odd bands. During a phase, the
+//halo row read at the border of a band belongs to a band which is not being modified, and
+//the matches found in the first phase are propagated into the bands of the second phase.
+//The bands have a fixed height, and the random numbers are drawn per pixel, so the result
+//is the same whatever the number of threads (including the sequential case)
+void patch_match_one_iteration_parallel(nTupleImage *shiftMap, nTupleImage *departImage, nTupleImage *arrivalImage,
+        nTupleImage *occIn, nTupleImage *modImg, const patchMatchParameterStruct *params, int iterationNb,
+        nTupleImage *wValues, patchMatchPassStats *passStats)
+{
+	int nBands = ((shiftMap->ySize) + PARALLEL_BAND_HEIGHT - 1)/PARALLEL_BAND_HEIGHT;
+	//statistics of each band, summed in band order so that they do not depend on the number of threads
+	std::vector<patchMatchPassStats> bandStats(nBands);
+	
+	for (int phase=0; phase<2; phase++)
+	{
+		#pragma omp parallel for schedule(dynamic,1) num_threads(params->nThreads)
+		for (int band=phase; band<nBands; band=band+2)
+		{
+			int jMin = band*PARALLEL_BAND_HEIGHT;
+			int jMax = min_int((band+1)*PARALLEL_BAND_HEIGHT, shiftMap->ySize);
+			bandStats[band].nProcessed = 0;
+			bandStats[band].nImproved = 0;
+			bandStats[band].energyDrop = 0.0;
+			patch_match_scan_rows(shiftMap, departImage, arrivalImage,
+				occIn, modImg, params, iterationNb, jMin, jMax, wValues, &(bandStats[band]));
+		}
+	}
+	
+	passStats->nProcessed = 0;
+	passStats->nImproved = 0;
+	passStats->energyDrop = 0.0;
+	for (int band=0; band<nBands; band++)
+	{
+		passStats->nProcessed += bandStats[band].nProcessed;
+		passStats->nImproved += bandStats[band].nImproved;
+		passStats->energyDrop += bandStats[band].energyDrop;
+	}
+}
 
 void patch_match_random_search_patch_level(nTupleImage *shiftMap, nTupleImage *imgA, nTupleImage *imgB,
-        nTupleImage *occIn, nTupleImage *modImg, const patchMatchParameterStruct *params, int i, int j,
+        nTupleImage *occIn, nTupleImage *modImg, const patchMatchParameterStruct *params, int iterationNb, int i, int j,
         nTupleImage *wValues)
 {
-	//create random number seed
+	//random numbers of this pixel, drawn in batches
+	counterRandomGenerator randomGenerator(params->randomStream, iterationNb, i, j);
+	uint32_t randomValues[RANDOM_BATCH_SIZE];
 	int xRand,yRand;
 	int randMinX,randMaxX,randMinY,randMaxY;
 	int hPatchSizeX,hPatchSizeY;
@@ -377,15 +591,21 @@ void patch_match_random_search_patch_level(nTupleImage *shiftMap, nTupleImage *i
 		// Y values
 		randMinY = max_int(yTemp - wTemp,hPatchSizeY);
 		randMaxY = min_int(yTemp + wTemp,imgB->ySize - hPatchSizeY - 1);
+		if (params->maxShiftDistance != -1)
+		{
+			int maxShift = (int)floor(params->maxShiftDistance);
+			randMinX = max_int(randMinX,i-maxShift);
+			randMaxX = min_int(randMaxX,i+maxShift);
+			randMinY = max_int(randMinY,j-maxShift);
+			randMaxY = min_int(randMaxY,j+maxShift);
+		}
 
-		//new positions in the image imgB
-		xRand = rand_int_range(randMinX, randMaxX);	//random values between xMin and xMax, clamped to the sizes of the image B
-		yRand = rand_int_range(randMinY, randMaxY);	//random values between yMin and yMax, clamped to the sizes of the image B
-
-		if (check_is_occluded(occIn,xRand,yRand))
-			continue;	//the new position is occluded
-		if (check_in_inner_boundaries(imgB,xRand,yRand,params) == 0)
-			continue;	//the new position is not in the inner boundaries
+		//new position in the image imgB, drawn among the valid (unoccluded, inner) positions of the window
+		if ( (z%RANDOM_BATCH_SIZE) == 0)
+			randomGenerator.next_batch(randomValues, RANDOM_BATCH_SIZE);
+		if (draw_valid_source(params->validSources, randomValues[z%RANDOM_BATCH_SIZE],
+			randMinX, randMinY, randMaxX, randMaxY, &xRand, &yRand) == false)
+			continue;	//there is no valid position in the window
 		if (check_max_shift_distance( (xRand-i),(yRand-j),params) == false)
 			continue;	//the new position is too far away
 
@@ -407,34 +627,29 @@ void patch_match_propagation_patch_level(nTupleImage *shiftMap, nTupleImage *dep
         const patchMatchParameterStruct *params, int iterationNb, int i, int j)
 {
 	//declarations
-	int *correctInd;
-	float currentError, *minVector;
-	
-	correctInd = new int;
-	minVector = new float[2];
+	int correctInd;
+	float currentError, minVector[NDIMS];
 
 	//calculate the error of the current displacement
 	currentError = shiftMap->get_value(i,j,2);
                     
 	get_min_correct_error(shiftMap,departImage,arrivalImage,occIn,
-	i, j, iterationNb&1, correctInd,minVector,currentError,params);
+	i, j, iterationNb&1, &correctInd,minVector,currentError,params);
 	
 	//if the best displacement is the current one. Note : we have taken into account the case
 	//where none of the diplacements around the current pixel are valid
-	if (*correctInd == -1)	//if the best displacement is the current one
+	if (correctInd == -1)	//if the best displacement is the current one
 	{
 		shiftMap->set_value(i,j,2,currentError);
-        delete correctInd;
-        delete[] minVector;
 		return;
 	}
 	if (iterationNb&1)	//if we are on an odd iteration
 	{
-		if ((*correctInd) == 0){
+		if (correctInd == 0){
 			copy_pixel_values_nTuple_image(shiftMap,shiftMap, min_int(i+1,((int)shiftMap->xSize)-1), j, i, j);
 		}
 
-		else if((*correctInd) == 1){
+		else if(correctInd == 1){
 			copy_pixel_values_nTuple_image(shiftMap,shiftMap, i, min_int(j+1,((int)shiftMap->ySize)-1), i, j);
 		}
 		else
@@ -445,11 +660,11 @@ void patch_match_propagation_patch_level(nTupleImage *shiftMap, nTupleImage *dep
 	}
 	else		//even iteration
 	{
-		if ( (*correctInd) == 0){
+		if ( correctInd == 0){
 			copy_pixel_values_nTuple_image(shiftMap,shiftMap, max_int(i-1,0), j, i, j);
 		}
 
-		else if( (*correctInd) == 1){
+		else if( correctInd == 1){
 			copy_pixel_values_nTuple_image(shiftMap,shiftMap, i, max_int(j-1,0), i, j);
 		}
 		else
@@ -458,10 +673,7 @@ void patch_match_propagation_patch_level(nTupleImage *shiftMap, nTupleImage *dep
 		currentError = calclulate_patch_error(departImage,arrivalImage,shiftMap,occIn,i,j, -1,params);
 		shiftMap->set_value(i,j,2,currentError);
 	}
-	
-	delete correctInd;
-	delete[] minVector;
-	
+
 }
 
 
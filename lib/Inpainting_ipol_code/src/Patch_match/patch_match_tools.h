@@ -10,6 +10,14 @@
 
     int check_is_occluded( nTupleImage *imgOcc, int x, int y);
     
+    //index of the valid source positions, and uniform random draws among the valid positions of a window. If
+    //lowerSources is not NULL, it is the index of the bottom rows of arrivalImage, whose positions are copied
+    validSourceIndex* create_valid_source_index(nTupleImage *arrivalImage, nTupleImage *occIn,
+        const patchMatchParameterStruct *params, const validSourceIndex *lowerSources = NULL);
+    int count_valid_sources(const validSourceIndex *validSources, int xMin, int yMin, int xMax, int yMax);
+    bool draw_valid_source(const validSourceIndex *validSources, uint32_t randomBits,
+        int xMin, int yMin, int xMax, int yMax, int *xOut, int *yOut);
+    
     void calclulate_patch_distances(nTupleImage *departImage, nTupleImage *arrivalImage, nTupleImage *shiftMap, nTupleImage *occImg,
 		const patchMatchParameterStruct *params);
 
@@ -31,12 +39,20 @@
 	/*** PATCH LEVEL INTERLEAVING **/
 	/*******************************/
 	void patch_match_one_iteration_patch_level(nTupleImage *shiftMap, nTupleImage *departImage, nTupleImage *arrivalImage,
-        nTupleImage *occIn, nTupleImage *modImg, const patchMatchParameterStruct *params, int iterationNb);
+        nTupleImage *occIn, nTupleImage *modImg, const patchMatchParameterStruct *params, int iterationNb,
+        patchMatchPassStats *passStats=NULL);
+	void patch_match_scan_rows(nTupleImage *shiftMap, nTupleImage *departImage, nTupleImage *arrivalImage,
+        nTupleImage *occIn, nTupleImage *modImg, const patchMatchParameterStruct *params, int iterationNb,
+        int jMin, int jMax, nTupleImage *wValues, patchMatchPassStats *passStats);
+	//multi-threaded iteration (bands of rows, processed in two phases)
+	void patch_match_one_iteration_parallel(nTupleImage *shiftMap, nTupleImage *departImage, nTupleImage *arrivalImage,
+        nTupleImage *occIn, nTupleImage *modImg, const patchMatchParameterStruct *params, int iterationNb,
+        nTupleImage *wValues, patchMatchPassStats *passStats);
 	
 	//random search and propagation interleaving at patch levels
 	//Random search
 	void patch_match_random_search_patch_level(nTupleImage *shiftMap, nTupleImage *imgA, nTupleImage *imgB,
-        nTupleImage *occIn, nTupleImage *modImg, const patchMatchParameterStruct *params, int i, int j,
+        nTupleImage *occIn, nTupleImage *modImg, const patchMatchParameterStruct *params, int iterationNb, int i, int j,
         nTupleImage *wValues);
     //propagation functions
     void patch_match_propagation_patch_level(nTupleImage *shiftMap, nTupleImage *departImage, nTupleImage *arrivalImage,
@@ -22,9 +22,21 @@
 	#define BEST_PATCH 3
 	#endif
 	
+	//aggregation of the patches by scattering : each patch is weighted once, with a sigma common to all the
+	//patches, and added to the pixels it covers
+	#ifndef SCATTERED_PATCHES
+	#define SCATTERED_PATCHES 4
+	#endif
+	
     #ifndef SIGMA_COLOUR
     #define SIGMA_COLOUR 75
     #endif
+    
+    //compute the exponential of the patch weights with SSE2/AVX2 instructions (0 : scalar code). The results
+    //do not depend on it
+    #ifndef RECONSTRUCTION_USE_SIMD
+    #define RECONSTRUCTION_USE_SIMD 1
+    #endif
 
 
 #endif
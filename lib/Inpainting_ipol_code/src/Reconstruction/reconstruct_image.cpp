@@ -15,236 +15,389 @@
 showing the nearest neighbours of patches*/
 
 #include "reconstruct_image.h"
+#include "image_structures_typed.h"
 
-/*this function calculates a nearest neighbour field, from imgA to imgB*/
-void reconstruct_image(nTupleImage* imgIn, nTupleImage* occIn,
-        nTupleImage* shiftMap, float sigmaColour, int reconstructionType, bool initialisation)
+/*whether the patch centred on a pixel is used for the reconstruction during the initialisation :
+the unoccluded patches, and the already reconstructed ones (-1) when the features are not reconstructed*/
+static inline bool check_reconstruction_patch(imageDataType occValue, bool reconstructFeatures)
 {
-	int useAllPatches;
-	if (initialisation==true)
-		useAllPatches = 0;
-	else
-		useAllPatches = 1;
-	
-	/*decalarations*/
-    int iMin,iMax,jMin,jMax;
-    int weightInd;
-    int xDisp, yDisp,xDispShift,yDispShift;
-    int hPatchSizeX,hPatchSizeY;
-    int nbNeighbours;
-    int correctInfo;
-    float alpha, adaptiveSigma;
-    float *weights,sumWeights, *colours, *avgColours;
+	return( (occValue == 0) || ( (!reconstructFeatures) && (occValue == -1) ) );
+}
 
-    hPatchSizeX = imgIn->hPatchSizeX;
-    hPatchSizeY = imgIn->hPatchSizeY;
-    
-    /*allocate the (maximum) memory for the weights*/
-    nbNeighbours = (imgIn->patchSizeX)*(imgIn->patchSizeY);
-    weights = new float[nbNeighbours];
-    colours = new float[(imgIn->nTupleSize)*nbNeighbours];
-    avgColours = new float[imgIn->nTupleSize];
-    
-	/*check certain parameters*/
-	if( (imgIn->patchSizeX != (imgIn->patchSizeX)) || (imgIn->patchSizeY != (imgIn->patchSizeY)) )	/*check that the patch sizes are equal*/
-	{
-		MY_PRINTF("Error in estimate_colour, the size of the patches are not equal in the two image volumes.");
-		return;
-	}
-	if ( ( imgIn->patchSizeX > imgIn->xSize) || ( imgIn->patchSizeY > imgIn->ySize) )	/*check that the patch size is less or equal to each dimension in the images*/
+/*scratch buffers of a thread, kept from one reconstruction to the next, so that the pixels are reconstructed
+without allocating memory*/
+typedef struct reconstructionScratchStruct
+{
+	std::vector<float> distances;	/*patch distances of the valid covering patches*/
+	std::vector<float> weights;
+	std::vector<float> selection;	/*copy of the distances, reordered by the percentile selection*/
+	std::vector<int> xSources;	/*positions of the pixel in the nearest neighbours of the covering patches*/
+	std::vector<int> ySources;
+	std::vector<float> avgColours;
+}reconstructionScratch;
+
+static reconstructionScratch* get_reconstruction_scratch(int nbNeighbours, int nTupleSize)
+{
+	static thread_local reconstructionScratch scratch;
+	if ((int)scratch.avgColours.size() < nTupleSize)
+		scratch.avgColours.resize(nTupleSize);
+	if ((int)scratch.distances.size() < nbNeighbours)
 	{
-		MY_PRINTF("Error in estimate_colour, the patch size is to large for one or more of the dimensions of the image volume.");
-		return;
+		scratch.distances.resize(nbNeighbours);
+		scratch.weights.resize(nbNeighbours);
+		scratch.selection.resize(nbNeighbours);
+		scratch.xSources.resize(nbNeighbours);
+		scratch.ySources.resize(nbNeighbours);
 	}
+	return(&scratch);
+}
 
-    for (int j=0; j<(occIn->ySize); j++)
-        for (int i=0; i<(occIn->xSize); i++)
-        {    
-            if ( ((occIn->get_value(i,j,0)) == 0) || ((occIn->get_value(i,j,0) == 2) )  )
-                continue;
-            else    /*an occluded pixel (therefore to be modified)*/
-            {
-                if (reconstructionType == 1 )
-                {
-                    xDisp = i + (int)shiftMap->get_value(i,j,0);
-                    yDisp = j + (int)shiftMap->get_value(i,j,1);
-
-                    ////if pure replacing of pixels
-                    copy_pixel_values_nTuple_image(imgIn, imgIn,xDisp, yDisp, i, j);
-                    continue;
-                }
-                 
-                //initialisation of the weight and colour vectors
-                for (int ii=0;ii<(imgIn->patchSizeX)*(imgIn->patchSizeY); ii++)
+/*reconstruction kernel, specialised on the number of channels and the patch size (see get_specialised_kernel).
+The normalised gradients (texture features) are reconstructed along with the colours if they are not NULL.
+The rows are reconstructed in parallel : the new values are written once all the pixels are reconstructed, so the
+result does not depend on the order of the pixels nor on the number of threads*/
+template <int N_TUPLE, int PATCH_SIZE>
+struct reconstructionKernel
+{
+	typedef void (*kernelType)(nTupleImage*, nTupleImage*, nTupleImage*, nTupleImage*, nTupleImage*, float, int, bool,
+		activePixelList*, int);
+	
+	static void run(nTupleImage* imgInDynamic, nTupleImage* occInDynamic, nTupleImage *normGradX, nTupleImage *normGradY,
+		nTupleImage* shiftMapDynamic, float sigmaColour, int reconstructionType, bool initialisation,
+		activePixelList *activePixels, int nThreads)
+	{
+		int useAllPatches;
+		if (initialisation==true)
+			useAllPatches = 0;
+		else
+			useAllPatches = 1;
+		bool reconstructFeatures = (normGradX != NULL) && (normGradY != NULL);
+		(void)nThreads;	//without OpenMP
+		if (reconstructionType == SCATTERED_PATCHES)
+		{
+			scatter(imgInDynamic, occInDynamic, normGradX, normGradY, shiftMapDynamic, sigmaColour, useAllPatches,
+				activePixels, nThreads);
+			return;
+		}
+		
+		nTupleImageT<imageDataType,N_TUPLE> imgIn = get_typed_image<N_TUPLE>(imgInDynamic);
+		nTupleImageT<imageDataType,DYNAMIC_SIZE> occIn = get_typed_image<DYNAMIC_SIZE>(occInDynamic);
+		nTupleImageT<imageDataType,DYNAMIC_SIZE> shiftMap = get_typed_image<DYNAMIC_SIZE>(shiftMapDynamic);
+		
+		const int nTupleSize = imgIn.nTupleSize();
+		const int patchSizeX = (PATCH_SIZE == DYNAMIC_SIZE) ? imgIn.patchSizeX : PATCH_SIZE;
+		const int patchSizeY = (PATCH_SIZE == DYNAMIC_SIZE) ? imgIn.patchSizeY : PATCH_SIZE;
+		const int hPatchSizeX = patchSizeX/2;
+		const int hPatchSizeY = patchSizeY/2;
+		
+		/*check certain parameters*/
+		if ( ( patchSizeX > imgIn.xSize) || ( patchSizeY > imgIn.ySize) )	/*check that the patch size is less or equal to each dimension in the images*/
+		{
+			MY_PRINTF("Error in estimate_colour, the patch size is to large for one or more of the dimensions of the image volume.");
+			return;
+		}
+		
+		/*new values of the pixels (colours, then features), indexed as the active pixels*/
+		const int nbNeighbours = patchSizeX*patchSizeY;
+		const int nValues = nTupleSize + (reconstructFeatures ? 2 : 0);
+		size_t nPixels = (activePixels == NULL) ? (size_t)(occIn.xSize)*(occIn.ySize) : activePixels->pixels.size();
+		std::vector<imageDataType> newValues(nPixels*nValues);
+		std::vector<unsigned char> reconstructed(nPixels,0);
+		
+		#pragma omp parallel for schedule(dynamic,8) num_threads(nThreads)
+		for (int j=0; j<(occIn.ySize); j++)
+		{
+			reconstructionScratch *scratch = get_reconstruction_scratch(nbNeighbours,nTupleSize);
+			float *distances = &(scratch->distances[0]);
+			float *weights = &(scratch->weights[0]);
+			int *xSources = &(scratch->xSources[0]);
+			int *ySources = &(scratch->ySources[0]);
+			float *avgColours = &(scratch->avgColours[0]);
+			for (int n=get_row_start(activePixels,j); n<get_row_end(activePixels,j,occIn.xSize); n++)
+			{
+				int i = get_active_pixel_x(activePixels,n);
+				imageDataType occValue = occIn.get_value(i,j,0);
+				if ( (occValue == 0) || (occValue == 2) )
+					continue;
+				/*an occluded pixel (therefore to be modified)*/
+				size_t pixelInd = (activePixels == NULL) ? (size_t)j*(occIn.xSize) + n : (size_t)n;
+				imageDataType *pixelValues = &(newValues[pixelInd*nValues]);
+				if (reconstructionType == 1 )
 				{
-					weights[ii] = (float)-1;
-					for (int colourInd=0; colourInd<(imgIn->nTupleSize); colourInd++)
+					int xDisp = i + (int)shiftMap.get_value(i,j,0);
+					int yDisp = j + (int)shiftMap.get_value(i,j,1);
+					
+					////if pure replacing of pixels
+					for (int colourInd=0; colourInd<nTupleSize; colourInd++)
+						pixelValues[colourInd] = imgIn.get_value(xDisp,yDisp,colourInd);
+					reconstructed[pixelInd] = 1;
+					continue;
+				}
+				
+				int iMin = max_int(i - hPatchSizeX,0);
+				int iMax = min_int(i + hPatchSizeX,(imgIn.xSize)-1 );
+				int jMin = max_int(j - hPatchSizeY,0);
+				int jMax = min_int(j + hPatchSizeY,(imgIn.ySize)-1 );
+				
+				/*distances of the covering patches, and positions of the pixel in their nearest neighbours*/
+				int nValid = 0;
+				for (int jj=jMin; jj<=jMax;jj++)
+					for (int ii=iMin; ii<=iMax;ii++)
 					{
-						colours[ii + colourInd*nbNeighbours] = (float)-1;
+						/*only use some of the patches during the initialisation*/
+						if ( (useAllPatches == 0) && (!check_reconstruction_patch(occIn.get_value(ii,jj,0),reconstructFeatures)) )
+							continue;
+						/*(spatio-temporally) shifted values of the covering patches*/
+						distances[nValid] = shiftMap.get_value(ii,jj,2);
+						xSources[nValid] = ii + (int)shiftMap.get_value(ii,jj,0) - (ii-i);
+						ySources[nValid] = jj + (int)shiftMap.get_value(ii,jj,1) - (jj-j);
+						nValid++;
 					}
-				}
-				for (int colourInd=0; colourInd<(imgIn->nTupleSize); colourInd++)
+				
+				if (nValid == 0)
+					continue;
+				reconstructed[pixelInd] = 1;
+				
+				if (reconstructionType == 3)
 				{
+					int bestInd = get_best_patch_index(distances,nValid);
+					for (int colourInd=0; colourInd<nTupleSize; colourInd++)
+						pixelValues[colourInd] = imgIn.get_value(xSources[bestInd],ySources[bestInd],colourInd);
+					continue;
+				}
+				//get the 75th percentile of the distances for setting the adaptive sigma
+				float adaptiveSigma = get_adaptive_sigma(distances,nValid,sigmaColour,&(scratch->selection[0]));
+				adaptiveSigma = max_float(adaptiveSigma,(float)0.1);
+				
+				/*weights = exp( -weights/(2*sigma*alpha))*/
+				get_patch_weights(distances,nValid,adaptiveSigma,weights);
+				float sumWeights = 0.0;
+				for (int k=0; k<nValid; k++)
+					sumWeights = (float)(sumWeights+weights[k]);
+				
+				/*now calculate the pixel value(s)*/
+				for (int colourInd=0; colourInd<nTupleSize; colourInd++)
 					avgColours[colourInd] = (float)0.0;
+				float avgNormGradX = 0.0, avgNormGradY = 0.0;
+				for (int k=0; k<nValid; k++)
+				{
+					for (int colourInd=0; colourInd<nTupleSize; colourInd++)
+						avgColours[colourInd] = avgColours[colourInd] + (float)(weights[k])*(imgIn.get_value(xSources[k],ySources[k],colourInd));
+					if (reconstructFeatures)
+					{
+						avgNormGradX = avgNormGradX + (float)(weights[k])*(normGradX->get_value_fast(xSources[k],ySources[k],0));
+						avgNormGradY = avgNormGradY + (float)(weights[k])*(normGradY->get_value_fast(xSources[k],ySources[k],0));
+					}
 				}
-
-                sumWeights = 0.0;
-                alpha = FLT_MAX;
-                correctInfo = 0;
-                
-                iMin = max_int(i - hPatchSizeX,0);
-                iMax = min_int(i + hPatchSizeX,(imgIn->xSize)-1 );
-                jMin = max_int(j - hPatchSizeY,0);
-                jMax = min_int(j + hPatchSizeY,(imgIn->ySize)-1 );
-                
-                /*
-                MY_PRINTF("iMin : %d, iMax : %d\n",iMin,iMax);
-                MY_PRINTF("jMin : %d, jMax : %d\n",jMin,jMax);*/
-                /*first calculate the weights*/
-                for (int jj=jMin; jj<=jMax;jj++)
-                    for (int ii=iMin; ii<=iMax;ii++)
-                    {
-                        /*get ssd similarity*/
-                        xDisp = ii + (int)shiftMap->get_value(ii,jj,0);
-                        yDisp = jj + (int)shiftMap->get_value(ii,jj,1);
-                        /*(spatio-temporally) shifted values of the covering patches*/
-                        xDispShift = xDisp - (ii-i);
-                        yDispShift = yDisp - (jj-j);
-                
-                         if (useAllPatches == 1)
-                         {
-                             
-                            alpha = (float)min_float(shiftMap->get_value(ii,jj,2),alpha); 
-                            weightInd = (int)((jj-jMin)*(imgIn->patchSizeX) + ii-iMin);
-                            weights[weightInd] = shiftMap->get_value(ii,jj,2);
-                            
-                            
-                            for (int colourInd=0; colourInd<(imgIn->nTupleSize); colourInd++)
+				for (int colourInd=0; colourInd<nTupleSize; colourInd++)
+					pixelValues[colourInd] = (imageDataType)((avgColours[colourInd])/(sumWeights));
+				if (reconstructFeatures)
+				{
+					pixelValues[nTupleSize] = (imageDataType)(avgNormGradX/(sumWeights));
+					pixelValues[nTupleSize+1] = (imageDataType)(avgNormGradY/(sumWeights));
+				}
+			}
+		}
+		
+		/*write the new values*/
+		#pragma omp parallel for schedule(static) num_threads(nThreads)
+		for (int j=0; j<(occIn.ySize); j++)
+			for (int n=get_row_start(activePixels,j); n<get_row_end(activePixels,j,occIn.xSize); n++)
+			{
+				size_t pixelInd = (activePixels == NULL) ? (size_t)j*(occIn.xSize) + n : (size_t)n;
+				if (reconstructed[pixelInd] == 0)
+					continue;
+				int i = get_active_pixel_x(activePixels,n);
+				const imageDataType *pixelValues = &(newValues[pixelInd*nValues]);
+				for (int colourInd=0; colourInd<nTupleSize; colourInd++)
+					imgIn.set_value(i,j,colourInd,pixelValues[colourInd]);
+				if ( reconstructFeatures && (reconstructionType != 1) && (reconstructionType != 3) )
+				{
+					normGradX->set_value_fast(i,j,0,pixelValues[nTupleSize]);
+					normGradY->set_value_fast(i,j,0,pixelValues[nTupleSize+1]);
+				}
+			}
+		return;
+	}
+	
+	/*the patches which cover the pixels to reconstruct are weighted with the same adaptive sigma (percentile of all
+	their distances), and added to accumulation buffers of the pixels they cover. The centre rows are split in bands of
+	patchSizeY rows : the even bands, then the odd bands, are processed in parallel without overlapping, so the order of
+	the sums does not depend on the number of threads*/
+	static void scatter(nTupleImage* imgInDynamic, nTupleImage* occInDynamic, nTupleImage *normGradX,
+		nTupleImage *normGradY, nTupleImage* shiftMapDynamic, float sigmaColour, int useAllPatches,
+		activePixelList *activePixels, int nThreads)
+	{
+		bool reconstructFeatures = (normGradX != NULL) && (normGradY != NULL);
+		(void)nThreads;	//without OpenMP
+		nTupleImageT<imageDataType,N_TUPLE> imgIn = get_typed_image<N_TUPLE>(imgInDynamic);
+		nTupleImageT<imageDataType,DYNAMIC_SIZE> occIn = get_typed_image<DYNAMIC_SIZE>(occInDynamic);
+		nTupleImageT<imageDataType,DYNAMIC_SIZE> shiftMap = get_typed_image<DYNAMIC_SIZE>(shiftMapDynamic);
+		
+		const int nTupleSize = imgIn.nTupleSize();
+		const int patchSizeX = (PATCH_SIZE == DYNAMIC_SIZE) ? imgIn.patchSizeX : PATCH_SIZE;
+		const int patchSizeY = (PATCH_SIZE == DYNAMIC_SIZE) ? imgIn.patchSizeY : PATCH_SIZE;
+		const int hPatchSizeX = patchSizeX/2;
+		const int hPatchSizeY = patchSizeY/2;
+		const int nValues = nTupleSize + (reconstructFeatures ? 2 : 0);
+		const int nAccumulated = nValues+1;	/*values, then the sum of the weights*/
+		
+		/*bounding box of the pixels to reconstruct*/
+		int xMin = occIn.xSize, xMax = -1, yMin = occIn.ySize, yMax = -1;
+		for (int j=0; j<(occIn.ySize); j++)
+			for (int n=get_row_start(activePixels,j); n<get_row_end(activePixels,j,occIn.xSize); n++)
+			{
+				int i = get_active_pixel_x(activePixels,n);
+				imageDataType occValue = occIn.get_value(i,j,0);
+				if ( (occValue == 0) || (occValue == 2) )
+					continue;
+				xMin = min_int(xMin,i);
+				xMax = max_int(xMax,i);
+				yMin = min_int(yMin,j);
+				yMax = max_int(yMax,j);
+			}
+		if (xMax < 0)
+			return;
+		const int boxSizeX = xMax-xMin+1;
+		const int boxSizeY = yMax-yMin+1;
+		
+		/*the patches are centred in the box enlarged by half a patch. Summed area table of the pixels to reconstruct, to
+		keep the patches which cover one of them*/
+		const int cxMin = max_int(xMin-hPatchSizeX,0), cxMax = min_int(xMax+hPatchSizeX,(occIn.xSize)-1);
+		const int cyMin = max_int(yMin-hPatchSizeY,0), cyMax = min_int(yMax+hPatchSizeY,(occIn.ySize)-1);
+		const int centreSizeX = cxMax-cxMin+1;
+		const int centreSizeY = cyMax-cyMin+1;
+		std::vector<int> occludedSums((size_t)(centreSizeX+1)*(centreSizeY+1),0);
+		for (int j=cyMin; j<=cyMax; j++)
+		{
+			int rowSum = 0;
+			for (int i=cxMin; i<=cxMax; i++)
+			{
+				imageDataType occValue = occIn.get_value(i,j,0);
+				if ( (occValue != 0) && (occValue != 2) )
+					rowSum++;
+				size_t ind = (size_t)(j-cyMin+1)*(centreSizeX+1) + (i-cxMin+1);
+				occludedSums[ind] = occludedSums[ind-(centreSizeX+1)] + rowSum;
+			}
+		}
+		std::vector<unsigned char> scatteredPatches((size_t)centreSizeX*centreSizeY,0);
+		std::vector<float> patchDistances;
+		for (int jj=cyMin; jj<=cyMax; jj++)
+			for (int ii=cxMin; ii<=cxMax; ii++)
+			{
+				if ( (useAllPatches == 0) && (!check_reconstruction_patch(occIn.get_value(ii,jj,0),reconstructFeatures)) )
+					continue;
+				int x0 = max_int(ii-hPatchSizeX,cxMin)-cxMin, x1 = min_int(ii+hPatchSizeX,cxMax)-cxMin+1;
+				int y0 = max_int(jj-hPatchSizeY,cyMin)-cyMin, y1 = min_int(jj+hPatchSizeY,cyMax)-cyMin+1;
+				int nOccluded = occludedSums[(size_t)y1*(centreSizeX+1)+x1] - occludedSums[(size_t)y0*(centreSizeX+1)+x1]
+					- occludedSums[(size_t)y1*(centreSizeX+1)+x0] + occludedSums[(size_t)y0*(centreSizeX+1)+x0];
+				if (nOccluded == 0)
+					continue;
+				scatteredPatches[(size_t)(jj-cyMin)*centreSizeX + (ii-cxMin)] = 1;
+				patchDistances.push_back(shiftMap.get_value(ii,jj,2));
+			}
+		if (patchDistances.size() == 0)
+			return;
+		
+		std::vector<float> selection(patchDistances.size());
+		float adaptiveSigma = get_adaptive_sigma(&(patchDistances[0]),(int)patchDistances.size(),sigmaColour,&(selection[0]));
+		adaptiveSigma = max_float(adaptiveSigma,(float)0.1);
+		
+		/*weighted sums of the values of the pixels of the box*/
+		std::vector<float> accumulation((size_t)boxSizeX*boxSizeY*nAccumulated,(float)0.0);
+		const int nBands = (centreSizeY+patchSizeY-1)/patchSizeY;
+		for (int parity=0; parity<2; parity++)
+		{
+			#pragma omp parallel for schedule(dynamic,1) num_threads(nThreads)
+			for (int band=parity; band<nBands; band+=2)
+			{
+				reconstructionScratch *scratch = get_reconstruction_scratch(centreSizeX,nTupleSize);
+				float *distances = &(scratch->distances[0]);
+				float *weights = &(scratch->weights[0]);
+				int *xCentres = &(scratch->xSources[0]);
+				for (int jj=cyMin+band*patchSizeY; jj<=min_int(cyMin+(band+1)*patchSizeY-1,cyMax); jj++)
+				{
+					/*weights of the patches of the row*/
+					int nPatches = 0;
+					for (int ii=cxMin; ii<=cxMax; ii++)
+						if (scatteredPatches[(size_t)(jj-cyMin)*centreSizeX + (ii-cxMin)] == 1)
+						{
+							distances[nPatches] = shiftMap.get_value(ii,jj,2);
+							xCentres[nPatches] = ii;
+							nPatches++;
+						}
+					get_patch_weights(distances,nPatches,adaptiveSigma,weights);
+					
+					for (int k=0; k<nPatches; k++)
+					{
+						int ii = xCentres[k];
+						float weight = weights[k];
+						int xShift = (int)shiftMap.get_value(ii,jj,0);
+						int yShift = (int)shiftMap.get_value(ii,jj,1);
+						int iMin = max_int(ii-hPatchSizeX,xMin), iMax = min_int(ii+hPatchSizeX,xMax);
+						for (int j=max_int(jj-hPatchSizeY,yMin); j<=min_int(jj+hPatchSizeY,yMax); j++)
+						{
+							float *accumulatedValues = &(accumulation[((size_t)(j-yMin)*boxSizeX + (iMin-xMin))*nAccumulated]);
+							for (int i=iMin; i<=iMax; i++)
 							{
-								colours[weightInd + colourInd*nbNeighbours] = (float)(imgIn->get_value(xDispShift,yDispShift,colourInd));
-							}
-                            correctInfo = 1;
-                         }
-                         else   /*only use some of the patches*/
-                         {
-                             if (((occIn->get_value(ii,jj,0)) == 0) || (occIn->get_value(ii,jj,0) ==-1))
-                             {
-                                alpha = (float)min_float(shiftMap->get_value(ii,jj,2),alpha); 
-                                weightInd = (int)((jj-jMin)*(imgIn->patchSizeX) + ii-iMin);
-                                weights[weightInd] = shiftMap->get_value(ii,jj,2);
-                                
-                                for (int colourInd=0; colourInd<(imgIn->nTupleSize); colourInd++)
-								{
-									colours[weightInd + colourInd*nbNeighbours] = (float)(imgIn->get_value(xDispShift,yDispShift,colourInd));
-								}
-                                correctInfo = 1;
-                             }
-                             else
-                             {
-                                weightInd = (int)( (jj-jMin)*(imgIn->patchSizeX) + ii-iMin);
-                                weights[weightInd] = -1;
-                                 
-                                for (int colourInd=0; colourInd<(imgIn->nTupleSize); colourInd++)
+								for (int colourInd=0; colourInd<nTupleSize; colourInd++)
+									accumulatedValues[colourInd] = accumulatedValues[colourInd] +
+										weight*(imgIn.get_value(i+xShift,j+yShift,colourInd));
+								if (reconstructFeatures)
 								{
-									colours[weightInd + colourInd*nbNeighbours] = (float)-1;
+									accumulatedValues[nTupleSize] = accumulatedValues[nTupleSize] +
+										weight*(normGradX->get_value_fast(i+xShift,j+yShift,0));
+									accumulatedValues[nTupleSize+1] = accumulatedValues[nTupleSize+1] +
+										weight*(normGradY->get_value_fast(i+xShift,j+yShift,0));
 								}
-                                continue;
-                             }
-                         }
-                    }
-                
-                alpha = max_float(alpha,1);
-                if (correctInfo == 0)
-                    continue;
-
-                if (reconstructionType == 3)
-                {
-                    estimate_best_colour(imgIn, weights, nbNeighbours, colours, i, j);
-                    continue;
-                }
-                //get the 75th percentile of the distances for setting the adaptive sigma
-                adaptiveSigma = get_adaptive_sigma(weights,(imgIn->patchSizeX)*(imgIn->patchSizeY),sigmaColour);
-				adaptiveSigma = max_float(adaptiveSigma,(float)0.1);
-                
-                /* ///MY_PRINTF("alpha : %f\n",alpha);
-                //adjust the weights : note, the indices which are outside the image boundaries
-                //will have no influence on the final weights (they are initialised to 0)  */
-                for (int jj=jMin; jj<=jMax;jj++)
-                    for (int ii=iMin; ii<=iMax;ii++)
-                    {
-                        if (useAllPatches)
-                        {
-                            /*weights = exp( -weights/(2*sigma*alpha))*/
-                            weightInd = (int)((jj-jMin)*(imgIn->patchSizeX) + ii-iMin);
-                            weights[weightInd] = (float)(exp( - ((weights[weightInd])/(2*adaptiveSigma*adaptiveSigma)) ));/*exp( - ((weights[ii])/(2*sigmaColour*sigmaColour*alpha)) );*/
-                            //
-                            sumWeights = (float)(sumWeights+weights[weightInd]);
-                        }
-                        else   /*only use some of the patches*/
-                        {
-                             if (((occIn->get_value(ii,jj,0)) == 0) || (occIn->get_value(ii,jj,0) ==-1))
-                             {
-                                /*weights = exp( -weights/(2*sigma*alpha))*/
-                                weightInd = (int)((jj-jMin)*(imgIn->patchSizeX) + ii-iMin);
-                                weights[weightInd] = (float)(exp( - ((weights[weightInd])/(2*adaptiveSigma*adaptiveSigma)) ));/*exp( - ((weights[ii])/(2*sigmaColour*sigmaColour*alpha)) );*/
-                                //
-                                sumWeights = (float)(sumWeights+weights[weightInd]);
-                             }
-                             else
-                                 continue;
-                        }
-                    }
-
-                /*now calculate the pixel value(s)*/
-                for (int jj=jMin; jj<=jMax;jj++)
-                    for (int ii=iMin; ii<=iMax;ii++)
-                    {
-                        if (useAllPatches)
-                        {
-                            weightInd = (int)( (jj-jMin)*(imgIn->patchSizeX) + ii-iMin);
-                            /*get ssd similarity*/
-                            xDisp = ii + (int)shiftMap->get_value(ii,jj,0);
-                            yDisp = jj + (int)shiftMap->get_value(ii,jj,1);
-                            /*(spatio-temporally) shifted values of the covering patches*/
-                            xDispShift = xDisp - (ii-i);
-                            yDispShift = yDisp - (jj-j);
-                            
-                            for (int colourInd=0; colourInd<(imgIn->nTupleSize); colourInd++)
-							{
-								avgColours[colourInd] = avgColours[colourInd] + (float)(weights[weightInd])*(imgIn->get_value(xDispShift,yDispShift,colourInd));
+								accumulatedValues[nValues] = accumulatedValues[nValues] + weight;
+								accumulatedValues += nAccumulated;
 							}
-                        }
-                        else
-                        {
-                             if (((occIn->get_value(ii,jj,0)) == 0) || (occIn->get_value(ii,jj,0) ==-1))
-                             {
-                                weightInd = (int)((jj-jMin)*(imgIn->patchSizeX) + ii-iMin);
-                                /*get ssd similarity*/
-                                xDisp = ii + (int)shiftMap->get_value(ii,jj,0);
-                                yDisp = jj + (int)shiftMap->get_value(ii,jj,1);
-                                /*(spatio-temporally) shifted values of the covering patches*/
-                                xDispShift = xDisp - (ii-i);
-                                yDispShift = yDisp - (jj-j);
-                                for (int colourInd=0; colourInd<(imgIn->nTupleSize); colourInd++)
-								{
-									avgColours[colourInd] = avgColours[colourInd] + (float)(weights[weightInd])*(imgIn->get_value(xDispShift,yDispShift,colourInd));
-								}
-                             }
-                             else
-                                 continue;
-                        }
-                    }
-                     /*MY_PRINTF("SumWeights : %f\n",sumWeights);*/
-                for (int colourInd=0; colourInd<(imgIn->nTupleSize); colourInd++)
+						}
+					}
+				}
+			}
+		}
+		
+		/*write the new values*/
+		#pragma omp parallel for schedule(static) num_threads(nThreads)
+		for (int j=yMin; j<=yMax; j++)
+			for (int n=get_row_start(activePixels,j); n<get_row_end(activePixels,j,occIn.xSize); n++)
+			{
+				int i = get_active_pixel_x(activePixels,n);
+				imageDataType occValue = occIn.get_value(i,j,0);
+				if ( (occValue == 0) || (occValue == 2) )
+					continue;
+				const float *accumulatedValues = &(accumulation[((size_t)(j-yMin)*boxSizeX + (i-xMin))*nAccumulated]);
+				float sumWeights = accumulatedValues[nValues];
+				if (sumWeights <= 0)
+					continue;
+				for (int colourInd=0; colourInd<nTupleSize; colourInd++)
+					imgIn.set_value(i,j,colourInd,(imageDataType)(accumulatedValues[colourInd]/sumWeights));
+				if (reconstructFeatures)
 				{
-					imgIn->set_value(i,j,colourInd,(imageDataType)((avgColours[colourInd])/(sumWeights)));
+					normGradX->set_value_fast(i,j,0,(imageDataType)(accumulatedValues[nTupleSize]/sumWeights));
+					normGradY->set_value_fast(i,j,0,(imageDataType)(accumulatedValues[nTupleSize+1]/sumWeights));
 				}
-                /*set_value_nTuple_volume(occVol,i,j,k,0,0);*/
-            }
-        }
+			}
+	}
+};
 
-        delete[] weights;
-        delete[] colours;
-        delete[] avgColours;
-        return;
+void reconstruct_image_specialised(nTupleImage* imgIn, nTupleImage* occIn, nTupleImage *normGradX, nTupleImage *normGradY,
+        nTupleImage* shiftMap, float sigmaColour, int reconstructionType, bool initialisation, activePixelList *activePixels,
+        int nThreads)
+{
+	reconstructionKernel<DYNAMIC_SIZE,DYNAMIC_SIZE>::kernelType reconstructionFunction =
+		get_specialised_kernel<reconstructionKernel>(imgIn->nTupleSize, imgIn->patchSizeX, imgIn->patchSizeY);
+	
+	reconstructionFunction(imgIn, occIn, normGradX, normGradY, shiftMap, sigmaColour, reconstructionType, initialisation,
+		activePixels, nThreads);
+}
+
+void reconstruct_image(nTupleImage* imgIn, nTupleImage* occIn,
+        nTupleImage* shiftMap, float sigmaColour, int reconstructionType, bool initialisation, activePixelList *activePixels,
+        int nThreads)
+{
+	reconstruct_image_specialised(imgIn, occIn, NULL, NULL, shiftMap, sigmaColour, reconstructionType, initialisation,
+		activePixels, nThreads);
 }
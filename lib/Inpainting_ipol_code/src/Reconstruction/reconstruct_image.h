@@ -12,7 +12,15 @@
 
     int check_shift_map(nTupleImage *shiftMap, nTupleImage *departImg, nTupleImage *arrivalImg, nTupleImage *occImg);
 	
+    //reconstruction with the kernel specialised for the number of channels and patch size of imgIn,
+    //the texture features are reconstructed as well if normGradX and normGradY are not NULL.
+    //If activePixels is not NULL, only these pixels are reconstructed (it must contain all the occluded pixels).
+    //The rows are reconstructed on nThreads threads, the result does not depend on it
+    void reconstruct_image_specialised(nTupleImage* imgIn, nTupleImage* occIn, nTupleImage *normGradX, nTupleImage *normGradY,
+            nTupleImage* shiftMap, float sigmaColour, int reconstructionType, bool initialisation, activePixelList *activePixels,
+            int nThreads);
     void reconstruct_image(nTupleImage* imgIn, nTupleImage* occIn,
-            nTupleImage* shiftMap, float sigmaColour, int reconstructionType=0, bool initialisation=false);
+            nTupleImage* shiftMap, float sigmaColour, int reconstructionType=0, bool initialisation=false,
+            activePixelList *activePixels=NULL, int nThreads=1);
 
 #endif
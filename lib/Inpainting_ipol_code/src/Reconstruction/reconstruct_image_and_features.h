@@ -14,6 +14,7 @@
 	
     void reconstruct_image_and_features(nTupleImage* imgIn, nTupleImage* occIn,
         nTupleImage *normGradX, nTupleImage *normGradY,
-        nTupleImage* shiftMap, float sigmaColour, int reconstructionType=0, bool initialisation=false);
+        nTupleImage* shiftMap, float sigmaColour, int reconstructionType=0, bool initialisation=false,
+        activePixelList *activePixels=NULL, int nThreads=1);
 
 #endif
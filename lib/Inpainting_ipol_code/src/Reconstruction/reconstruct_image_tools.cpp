@@ -17,6 +17,106 @@ colour estimation*/
 
 #include "reconstruct_image_tools.h"
 
+#if RECONSTRUCTION_USE_SIMD && (defined(__SSE2__) || defined(__AVX2__))
+	#include <immintrin.h>
+#endif
+
+/*exponential of a float (Cephes expf) : exp(x) = 2^n exp(r), with n = floor(x/log(2) + 1/2), and exp(r) given by a
+polynomial. The relative error is below 2e-7, and the arguments are bounded so that the result is a normalised float*/
+#define EXP_MIN_ARGUMENT -87.3365447f
+#define EXP_MAX_ARGUMENT 88.0f
+#define EXP_LOG2E 1.44269504088896341f
+#define EXP_LN2_HIGH 0.693359375f
+#define EXP_LN2_LOW -2.12194440e-4f
+#define EXP_P0 1.9875691500e-4f
+#define EXP_P1 1.3981999507e-3f
+#define EXP_P2 8.3334519073e-3f
+#define EXP_P3 4.1665795894e-2f
+#define EXP_P4 1.6666665459e-1f
+#define EXP_P5 5.0000001201e-1f
+
+/*vector operations of the exponential (widest instruction set available at compile time). The vector and scalar
+versions carry out the same operations, without fused multiply-adds, so the results are identical*/
+#if RECONSTRUCTION_USE_SIMD && defined(__AVX2__)
+	#define EXP_SIMD_WIDTH 8
+	typedef __m256 expVector;
+	#define EXP_SET1(a) _mm256_set1_ps(a)
+	#define EXP_LOAD(ptr) _mm256_loadu_ps(ptr)
+	#define EXP_STORE(ptr,a) _mm256_storeu_ps(ptr,a)
+	#define EXP_ADD(a,b) _mm256_add_ps(a,b)
+	#define EXP_SUB(a,b) _mm256_sub_ps(a,b)
+	#define EXP_MUL(a,b) _mm256_mul_ps(a,b)
+	#define EXP_DIV(a,b) _mm256_div_ps(a,b)
+	#define EXP_MIN(a,b) _mm256_min_ps(a,b)
+	#define EXP_MAX(a,b) _mm256_max_ps(a,b)
+	#define EXP_AND(a,b) _mm256_and_ps(a,b)
+	#define EXP_GREATER(a,b) _mm256_cmp_ps(a,b,_CMP_GT_OQ)
+	#define EXP_TRUNCATE(a) _mm256_cvttps_epi32(a)
+	#define EXP_TO_FLOAT(n) _mm256_cvtepi32_ps(n)
+	#define EXP_POWER_OF_2(n) _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(n,_mm256_set1_epi32(127)),23))
+#elif RECONSTRUCTION_USE_SIMD && defined(__SSE2__)
+	#define EXP_SIMD_WIDTH 4
+	typedef __m128 expVector;
+	#define EXP_SET1(a) _mm_set1_ps(a)
+	#define EXP_LOAD(ptr) _mm_loadu_ps(ptr)
+	#define EXP_STORE(ptr,a) _mm_storeu_ps(ptr,a)
+	#define EXP_ADD(a,b) _mm_add_ps(a,b)
+	#define EXP_SUB(a,b) _mm_sub_ps(a,b)
+	#define EXP_MUL(a,b) _mm_mul_ps(a,b)
+	#define EXP_DIV(a,b) _mm_div_ps(a,b)
+	#define EXP_MIN(a,b) _mm_min_ps(a,b)
+	#define EXP_MAX(a,b) _mm_max_ps(a,b)
+	#define EXP_AND(a,b) _mm_and_ps(a,b)
+	#define EXP_GREATER(a,b) _mm_cmpgt_ps(a,b)
+	#define EXP_TRUNCATE(a) _mm_cvttps_epi32(a)
+	#define EXP_TO_FLOAT(n) _mm_cvtepi32_ps(n)
+	#define EXP_POWER_OF_2(n) _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(n,_mm_set1_epi32(127)),23))
+#else
+	#define EXP_SIMD_WIDTH 1
+#endif
+
+static inline float exp_scalar(float x)
+{
+	x = (x > EXP_MIN_ARGUMENT) ? x : EXP_MIN_ARGUMENT;
+	x = (x < EXP_MAX_ARGUMENT) ? x : EXP_MAX_ARGUMENT;
+	/*n = floor(x/log(2) + 1/2)*/
+	float fx = x*EXP_LOG2E + 0.5f;
+	float nFloat = (float)((int)fx);
+	if (nFloat > fx)
+		nFloat = nFloat - 1.0f;
+	float r = (x - nFloat*EXP_LN2_HIGH) - nFloat*EXP_LN2_LOW;
+	float y = EXP_P0;
+	y = y*r + EXP_P1;
+	y = y*r + EXP_P2;
+	y = y*r + EXP_P3;
+	y = y*r + EXP_P4;
+	y = y*r + EXP_P5;
+	y = (y*(r*r) + r) + 1.0f;
+	/*2^n, from the exponent bits*/
+	union { int32_t i; float f; } powerOf2;
+	powerOf2.i = ((int32_t)nFloat + 127) << 23;
+	return(y*powerOf2.f);
+}
+
+#if EXP_SIMD_WIDTH > 1
+static inline expVector exp_vector(expVector x)
+{
+	x = EXP_MIN(EXP_MAX(x,EXP_SET1(EXP_MIN_ARGUMENT)),EXP_SET1(EXP_MAX_ARGUMENT));
+	expVector fx = EXP_ADD(EXP_MUL(x,EXP_SET1(EXP_LOG2E)),EXP_SET1(0.5f));
+	expVector nFloat = EXP_TO_FLOAT(EXP_TRUNCATE(fx));
+	nFloat = EXP_SUB(nFloat,EXP_AND(EXP_GREATER(nFloat,fx),EXP_SET1(1.0f)));
+	expVector r = EXP_SUB(EXP_SUB(x,EXP_MUL(nFloat,EXP_SET1(EXP_LN2_HIGH))),EXP_MUL(nFloat,EXP_SET1(EXP_LN2_LOW)));
+	expVector y = EXP_SET1(EXP_P0);
+	y = EXP_ADD(EXP_MUL(y,r),EXP_SET1(EXP_P1));
+	y = EXP_ADD(EXP_MUL(y,r),EXP_SET1(EXP_P2));
+	y = EXP_ADD(EXP_MUL(y,r),EXP_SET1(EXP_P3));
+	y = EXP_ADD(EXP_MUL(y,r),EXP_SET1(EXP_P4));
+	y = EXP_ADD(EXP_MUL(y,r),EXP_SET1(EXP_P5));
+	y = EXP_ADD(EXP_ADD(EXP_MUL(y,EXP_MUL(r,r)),r),EXP_SET1(1.0f));
+	return(EXP_MUL(y,EXP_POWER_OF_2(EXP_TRUNCATE(nFloat))));
+}
+#endif
+
 int check_shift_map(nTupleImage *shiftMap, nTupleImage *departImage, nTupleImage *arrivalImage)
 {
 	int dispValX,dispValY,hPatchSizeX,hPatchSizeY;
@@ -62,61 +162,40 @@ int check_shift_map(nTupleImage *shiftMap, nTupleImage *departImage, nTupleImage
 	return(returnVal);
 }
 
-/*this function gets the nth percentile of the current weights*/
-float get_adaptive_sigma(float *weights, int weightsLength, float sigmaPercentile)
+/*this function gets the nth percentile of the distances (the 75th percentile of the first weightsLength-1 distances,
+as in the original implementation). The selection reorders a copy of the distances in selectionBuffer*/
+float get_adaptive_sigma(const float *distances, int nDistances, float sigmaPercentile, float *selectionBuffer)
 {
-    int i, weightsInd, percentileInd;
-    float *weightsTemp, adaptiveSigmaOut;
     float percentile = (float)(sigmaPercentile)/((float)100);
+    int nSelection = nDistances-1;
     
-    weightsTemp = (float*)malloc((size_t)weightsLength*sizeof(float));
-    weightsInd = 0;
-    for (i=0; i<weightsLength;i++)
-    {
-        if (weights[i] != -1)   /*we want to use this patch */
-        {
-            weightsTemp[weightsInd] = weights[i];
-            weightsInd = weightsInd+1;
-        }
-    }
-    weightsInd = weightsInd-1;
-    std::sort(weightsTemp,weightsTemp+(weightsInd));
-    
-    percentileInd = (int)floor((float)percentile*weightsInd);
+    std::copy(distances,distances+nDistances,selectionBuffer);
+    int percentileInd = (int)floor((float)percentile*nSelection);
+    std::nth_element(selectionBuffer,selectionBuffer+percentileInd,selectionBuffer+nSelection);
     
-    adaptiveSigmaOut = sqrt(weightsTemp[percentileInd]);
-    free(weightsTemp);
-    return(adaptiveSigmaOut);
+    return(sqrt(selectionBuffer[percentileInd]));
 }
 
-/*this function retieves the highest mode in the colour space of the
- different colours available for reconstructing a pixel*/
-int estimate_best_colour(nTupleImage *imgIn, float *weights, int weightsLength,
-                                float *colours, int i, int j)
+/*index of the smallest distance (the first one in case of equality)*/
+int get_best_patch_index(const float *distances, int nDistances)
 {
-    int ii;
-    int minWeightInd;
-    float minWeight;
-    
-    
-    minWeight = INT_MAX;
-    minWeightInd = 0;
-    for (ii=0; ii<weightsLength; ii++)
-    {
-        if (weights[ii] != -1)
-        {
-			if (weights[ii] < minWeight)
-            {
-                minWeight = weights[ii];
-                minWeightInd = ii;
-            }
-        }
-    }
-
-	for (int colourInd=0; colourInd<(imgIn->nTupleSize); colourInd++)
-	{
-		imgIn->set_value(i,j,colourInd,(imageDataType)(colours[minWeightInd+colourInd*weightsLength]));
-	}
-    
-    return(1);
+    int minWeightInd = 0;
+    for (int ii=1; ii<nDistances; ii++)
+        if (distances[ii] < distances[minWeightInd])
+            minWeightInd = ii;
+    return(minWeightInd);
+}
+
+/*weights = exp( -distances/(2*sigma*sigma)), EXP_SIMD_WIDTH weights at a time*/
+void get_patch_weights(const float *distances, int nDistances, float sigma, float *weights)
+{
+    float denominator = 2*sigma*sigma;
+    int ii = 0;
+#if EXP_SIMD_WIDTH > 1
+    expVector denominatorVector = EXP_SET1(denominator);
+    for ( ; (ii+EXP_SIMD_WIDTH)<=nDistances; ii+=EXP_SIMD_WIDTH)
+        EXP_STORE(weights+ii, exp_vector(EXP_SUB(EXP_SET1(0.0f),EXP_DIV(EXP_LOAD(distances+ii),denominatorVector))));
+#endif
+    for ( ; ii<nDistances; ii++)
+        weights[ii] = exp_scalar(0.0f - ((distances[ii])/denominator));
 }
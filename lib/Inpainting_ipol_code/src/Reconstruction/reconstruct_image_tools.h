@@ -10,9 +10,10 @@
     
     int check_shift_map(nTupleImage *shiftMap, nTupleImage *departImage, nTupleImage *arrivalImage);
     
-    float get_adaptive_sigma(float *weights, int weightsLength, float sigmaPercentile);
+    float get_adaptive_sigma(const float *distances, int nDistances, float sigmaPercentile, float *selectionBuffer);
     
-    int estimate_best_colour(nTupleImage *imgImg, float *weights, int weightsLength,
-                                float *colours, int i, int j);
+    int get_best_patch_index(const float *distances, int nDistances);
+    
+    void get_patch_weights(const float *distances, int nDistances, float sigma, float *weights);
     
 #endif
@@ -0,0 +1,172 @@
+//batch inpainting : the jobs of a manifest file are run in the same process, the largest first
+
+#include <algorithm>
+
+#include "batch_inpainting.h"
+
+static bool compare_job_costs(const batchJob *jobA, const batchJob *jobB)
+{
+	return( (jobA->cost) > (jobB->cost) );
+}
+
+//pixels of the input image (or of its region of interest), times the number of patch sizes. The image is not decoded
+static double estimate_job_cost(const batchJob &job)
+{
+	size_t nx,ny,nc;
+	if (read_image_size(job.arguments[0].c_str(),&nx,&ny,&nc) == -1)
+		return(0);
+	double nPixels = (double)nx*(double)ny;
+	double nPatchSizes = 1;
+	for (size_t i=3; (i+1)<job.arguments.size(); i++)
+	{
+		int regionOfInterest[4];
+		if ( (job.arguments[i] == "-roi") && (sscanf(job.arguments[i+1].c_str(),"%d,%d,%d,%d",&regionOfInterest[0],
+			&regionOfInterest[1],&regionOfInterest[2],&regionOfInterest[3]) == 4) )
+			nPixels = (double)regionOfInterest[2]*(double)regionOfInterest[3];
+		else if (job.arguments[i] == "-patchSizes")
+			nPatchSizes = 1 + (double)std::count(job.arguments[i+1].begin(),job.arguments[i+1].end(),',');
+	}
+	return(nPixels*nPatchSizes);
+}
+
+//threads of the job jobOrder[n] when it starts : the free threads are shared in proportion to their costs between
+//this job and the next ones, which take the other free slots of the pool (the shares are rounded up, so the first
+//jobs, which are the largest, get the larger shares). Each of these jobs keeps at least one thread
+static int share_batch_threads(const std::vector<batchJob*> &jobOrder, int n, int nFreeThreads, int nFreeSlots)
+{
+	int nSharingJobs = max_int(min_int(nFreeSlots, (int)jobOrder.size()-n), 1);
+	double sharingCost = 0;
+	for (int k=n; k<n+nSharingJobs; k++)
+		sharingCost += jobOrder[k]->cost;
+	int nJobThreads;
+	if (sharingCost > 0)
+		nJobThreads = (int)ceil( (double)nFreeThreads*(jobOrder[n]->cost)/sharingCost );
+	else
+		nJobThreads = (nFreeThreads+nSharingJobs-1)/nSharingJobs;
+	return( max_int(min_int(nJobThreads, nFreeThreads-(nSharingJobs-1)), 1) );
+}
+
+int read_batch_manifest(const char *manifestFile, std::vector<batchJob> &jobs)
+{
+	FILE *file = fopen(manifestFile,"r");
+	if (file == NULL)
+	{
+		printf("Error in read_batch_manifest, unable to open %s.\n",manifestFile);
+		return(-1);
+	}
+
+	char line[BATCH_MAX_LINE_LENGTH];
+	int lineNumber = 0;
+	while (fgets(line,BATCH_MAX_LINE_LENGTH,file) != NULL)
+	{
+		lineNumber++;
+		if ( (strchr(line,'\n') == NULL) && (feof(file) == 0) )
+		{
+			printf("Error in read_batch_manifest, the line %d of %s is longer than %d characters.\n",lineNumber,
+				manifestFile,BATCH_MAX_LINE_LENGTH-2);
+			fclose(file);
+			return(-1);
+		}
+		batchJob job;
+		job.lineNumber = lineNumber;
+		job.cost = 0;
+		job.nThreads = 0;
+		job.executionTime = 0;
+		job.status = 0;
+		for (char *argument = strtok(line," \t\r\n"); argument != NULL; argument = strtok(NULL," \t\r\n"))
+			job.arguments.push_back(std::string(argument));
+		if ( (job.arguments.size() == 0) || (job.arguments[0][0] == '#') )
+			continue;
+		if (job.arguments.size() < 3)
+		{
+			printf("Error in read_batch_manifest, the line %d of %s should contain an input image, an occlusion and an output image.\n",
+				lineNumber,manifestFile);
+			fclose(file);
+			return(-1);
+		}
+		jobs.push_back(job);
+	}
+	fclose(file);
+	return(0);
+}
+
+int inpaint_image_batch(const char *manifestFile, int nThreads, inpaintingCommand command)
+{
+	std::vector<batchJob> jobs;
+	if (read_batch_manifest(manifestFile,jobs) == -1)
+		return(-1);
+	int nJobs = (int)jobs.size();
+	if (nJobs == 0)
+	{
+		printf("Error in inpaint_image_batch, the manifest %s does not contain any job.\n",manifestFile);
+		return(-1);
+	}
+
+	//the largest jobs first, so the last jobs to finish are short
+	std::vector<batchJob*> jobOrder(nJobs);
+	for (int n=0; n<nJobs; n++)
+	{
+		jobs[n].cost = estimate_job_cost(jobs[n]);
+		jobOrder[n] = &(jobs[n]);
+	}
+	std::stable_sort(jobOrder.begin(),jobOrder.end(),compare_job_costs);
+	printf("Batch : %d jobs, %d threads\n",nJobs,nThreads);
+
+#ifdef _OPENMP
+	//the jobs, the patch sizes of a job and the PatchMatch searches are nested parallel regions
+	if (omp_get_max_active_levels() < 3)
+		omp_set_max_active_levels(3);
+#endif
+	//at most nSlots jobs run at the same time. The threads of a finished job go back to the pool, and are shared by
+	//the next jobs
+	int nSlots = min_int(nJobs,nThreads);
+	int nThreadsUsed = 0, nJobsRunning = 0;
+	long startTime = getMilliSecs();
+	#pragma omp parallel for schedule(dynamic,1) num_threads(nSlots)
+	for (int n=0; n<nJobs; n++)
+	{
+		batchJob *job = jobOrder[n];
+		#pragma omp critical(batchThreads)
+		{
+			job->nThreads = share_batch_threads(jobOrder, n, nThreads-nThreadsUsed, nSlots-nJobsRunning);
+			nThreadsUsed += job->nThreads;
+			nJobsRunning++;
+		}
+		printf("Job %d/%d (line %d) started : %s, %d threads\n",n+1,nJobs,job->lineNumber,job->arguments[2].c_str(),
+			job->nThreads);
+
+		std::vector<char*> argv;
+		argv.push_back((char*)"inpaint_image");
+		for (size_t i=0; i<job->arguments.size(); i++)
+			argv.push_back(&(job->arguments[i][0]));
+		argv.push_back(NULL);
+		long startTimeJob = getMilliSecs();
+		job->status = command((int)argv.size()-1, &(argv[0]), job->nThreads);
+		job->executionTime = (double)(getMilliSecs()-startTimeJob)/1000;
+
+		#pragma omp critical(batchThreads)
+		{
+			nThreadsUsed -= job->nThreads;
+			nJobsRunning--;
+		}
+		printf("Job %d/%d (line %d) %s in %f s : %s\n",n+1,nJobs,job->lineNumber,
+			(job->status == -1) ? "failed" : "finished",job->executionTime,job->arguments[2].c_str());
+	}
+
+	//timing of the jobs, in the order of the manifest
+	int nFailed = 0;
+	double jobTimes = 0;
+	printf("\nBatch jobs :\n");
+	for (int n=0; n<nJobs; n++)
+	{
+		printf("  line %d : %s, %d threads, %f s%s\n",jobs[n].lineNumber,jobs[n].arguments[2].c_str(),jobs[n].nThreads,
+			jobs[n].executionTime,(jobs[n].status == -1) ? " (failed)" : "");
+		jobTimes += jobs[n].executionTime;
+		if (jobs[n].status == -1)
+			nFailed++;
+	}
+	printf("Batch execution time : %f s (sum of the job times : %f s), %d failed jobs\n",
+		(double)(getMilliSecs()-startTime)/1000,jobTimes,nFailed);
+
+	return( (nFailed > 0) ? -1 : 0 );
+}
@@ -0,0 +1,42 @@
+//batch inpainting : the jobs of a manifest file are run in the same process, the largest first, on a shared pool of
+//threads. Each line of the manifest is a job, with the arguments of the command line : input image, occlusion,
+//output image, then the options (for example -patchSizes 5,7,9 -tvLambda 1000). The empty lines and the lines which
+//begin with # are ignored
+
+#ifndef BATCH_INPAINTING_H
+#define BATCH_INPAINTING_H
+
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include "image_inpainting.h"
+
+//maximum length of a line of the manifest
+#ifndef BATCH_MAX_LINE_LENGTH
+#define BATCH_MAX_LINE_LENGTH 4096
+#endif
+
+	//inpainting of a command line (argv[0] is the name of the program) with nThreads threads, -1 on error
+	typedef int (*inpaintingCommand)(int argc, char *argv[], int nThreads);
+
+	typedef struct batchJobStruct
+	{
+		std::vector<std::string> arguments;	//input, occlusion, output and options
+		int lineNumber;		//line of the job in the manifest
+		double cost;		//estimated cost : pixels inpainted, times the number of patch sizes
+		int nThreads;		//threads given to the job when it starts
+		double executionTime;	//in seconds
+		int status;			//-1 if the job failed
+	}batchJob;
+
+//jobs of a manifest file, in the order of the file. Returns -1 if the file can not be read
+int read_batch_manifest(const char *manifestFile, std::vector<batchJob> &jobs);
+
+//run the jobs of the manifest with command, the largest first. When a job starts, the threads which are not used by
+//the running jobs are shared between this job and the next ones in proportion to their costs, the first jobs getting
+//the larger shares. The threads of a finished job go back to the pool for the next jobs. The execution time of each
+//job is displayed. Returns -1 if the manifest can not be read or if a job failed
+int inpaint_image_batch(const char *manifestFile, int nThreads, inpaintingCommand command);
+
+#endif
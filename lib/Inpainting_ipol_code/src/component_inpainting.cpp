@@ -0,0 +1,218 @@
+//inpainting of the connected components of the occlusion : each component is inpainted on a region of interest
+//around it, with its own number of pyramid levels, and the regions are inpainted concurrently
+
+#include <algorithm>
+
+#include "component_inpainting.h"
+
+static bool regions_overlap(const componentRegion &regionA, const componentRegion &regionB)
+{
+	return( (regionA.xMin <= regionB.xMax) && (regionB.xMin <= regionA.xMax) &&
+		(regionA.yMin <= regionB.yMax) && (regionB.yMin <= regionA.yMax) );
+}
+
+static size_t get_region_area(const componentRegion &region)
+{
+	return( (size_t)(region.xMax-region.xMin+1)*(region.yMax-region.yMin+1) );
+}
+
+static bool compare_region_sizes(const componentRegion &regionA, const componentRegion &regionB)
+{
+	return( get_region_area(regionA) > get_region_area(regionB) );
+}
+
+static bool compare_region_starts(const componentRegion &regionA, const componentRegion &regionB)
+{
+	return( regionA.xMin < regionB.xMin );
+}
+
+//root of the set of a region in the union-find forest (with path halving)
+static int find_region_set(std::vector<int> &parents, int n)
+{
+	while (parents[n] != n)
+	{
+		parents[n] = parents[parents[n]];
+		n = parents[n];
+	}
+	return(n);
+}
+
+std::vector<componentRegion> get_component_regions(nTupleImage *occIn)
+{
+	int xSize = occIn->xSize, ySize = occIn->ySize;
+	std::vector<unsigned char> visited((size_t)xSize*ySize,0);
+	std::vector<int> pixelStack;
+	std::vector<componentRegion> regions;
+
+	//bounding boxes of the connected components
+	for (int y=0; y<ySize; y++)
+		for (int x=0; x<xSize; x++)
+		{
+			if ( (visited[(size_t)y*xSize + x] != 0) || (occIn->get_value(x,y,0) <= 0) )
+				continue;
+			componentRegion region;
+			region.xMin = x; region.xMax = x;
+			region.yMin = y; region.yMax = y;
+			region.nOccluded = 0;
+			region.nComponents = 1;
+			visited[(size_t)y*xSize + x] = 1;
+			pixelStack.push_back(y*xSize + x);
+			while (pixelStack.size() > 0)
+			{
+				int xPixel = pixelStack.back()%xSize, yPixel = pixelStack.back()/xSize;
+				pixelStack.pop_back();
+				region.xMin = min_int(region.xMin,xPixel); region.xMax = max_int(region.xMax,xPixel);
+				region.yMin = min_int(region.yMin,yPixel); region.yMax = max_int(region.yMax,yPixel);
+				region.nOccluded++;
+				for (int yNeighbour=max_int(yPixel-1,0); yNeighbour<=min_int(yPixel+1,ySize-1); yNeighbour++)
+					for (int xNeighbour=max_int(xPixel-1,0); xNeighbour<=min_int(xPixel+1,xSize-1); xNeighbour++)
+						if ( (visited[(size_t)yNeighbour*xSize + xNeighbour] == 0) &&
+							(occIn->get_value(xNeighbour,yNeighbour,0) > 0) )
+						{
+							visited[(size_t)yNeighbour*xSize + xNeighbour] = 1;
+							pixelStack.push_back(yNeighbour*xSize + xNeighbour);
+						}
+			}
+			//context window
+			int margin = max_int(COMPONENT_MIN_CONTEXT, (int)ceil(COMPONENT_CONTEXT_FACTOR*
+				max_int(region.xMax-region.xMin+1, region.yMax-region.yMin+1)));
+			region.xMin = max_int(region.xMin-margin, 0); region.xMax = min_int(region.xMax+margin, xSize-1);
+			region.yMin = max_int(region.yMin-margin, 0); region.yMax = min_int(region.yMax+margin, ySize-1);
+			regions.push_back(region);
+		}
+
+	//merge the overlapping regions : in each pass, the regions sorted by xMin are swept to join the overlapping
+	//ones in a union-find forest, then each set is replaced by its bounding box. The merged boxes may overlap
+	//other regions, so the passes are repeated until no region overlaps another one
+	bool merged = true;
+	while (merged)
+	{
+		merged = false;
+		int nRegions = (int)regions.size();
+		std::sort(regions.begin(), regions.end(), compare_region_starts);
+		std::vector<int> parents(nRegions);
+		for (int i=0; i<nRegions; i++)
+			parents[i] = i;
+		for (int i=0; i<nRegions; i++)
+			for (int j=i+1; (j<nRegions) && (regions[j].xMin <= regions[i].xMax); j++)
+			{
+				int rootI = find_region_set(parents,i), rootJ = find_region_set(parents,j);
+				if ( (rootI == rootJ) || (!regions_overlap(regions[i],regions[j])) )
+					continue;
+				parents[max_int(rootI,rootJ)] = min_int(rootI,rootJ);
+				merged = true;
+			}
+		if (!merged)
+			break;
+		
+		std::vector<componentRegion> mergedRegions;
+		std::vector<int> mergedIndices(nRegions,-1);
+		for (int i=0; i<nRegions; i++)
+		{
+			int root = find_region_set(parents,i);
+			if (mergedIndices[root] == -1)
+			{
+				mergedIndices[root] = (int)mergedRegions.size();
+				mergedRegions.push_back(regions[i]);
+				continue;
+			}
+			componentRegion &mergedRegion = mergedRegions[mergedIndices[root]];
+			mergedRegion.xMin = min_int(mergedRegion.xMin,regions[i].xMin);
+			mergedRegion.xMax = max_int(mergedRegion.xMax,regions[i].xMax);
+			mergedRegion.yMin = min_int(mergedRegion.yMin,regions[i].yMin);
+			mergedRegion.yMax = max_int(mergedRegion.yMax,regions[i].yMax);
+			mergedRegion.nOccluded += regions[i].nOccluded;
+			mergedRegion.nComponents += regions[i].nComponents;
+		}
+		regions.swap(mergedRegions);
+	}
+	return(regions);
+}
+
+//threads of each region (sorted by decreasing area) : each region has one thread, and the other threads are shared
+//in proportion to the areas. The threads left by the rounding go to the largest regions. If there are more regions
+//than threads, the regions are inpainted nThreads at a time, with one thread each
+static std::vector<int> share_region_threads(const std::vector<componentRegion> &regions, int nThreads)
+{
+	int nRegions = (int)regions.size();
+	std::vector<int> regionThreads(nRegions,1);
+	if (nRegions >= nThreads)
+		return(regionThreads);
+	size_t totalArea = 0;
+	for (int n=0; n<nRegions; n++)
+		totalArea += get_region_area(regions[n]);
+	int nShared = nThreads-nRegions;
+	int nLeft = nShared;
+	for (int n=0; n<nRegions; n++)
+	{
+		int nExtra = (int)( (double)nShared*(double)get_region_area(regions[n])/(double)totalArea );
+		regionThreads[n] += nExtra;
+		nLeft -= nExtra;
+	}
+	for (int n=0; nLeft>0; n=(n+1)%nRegions, nLeft--)
+		regionThreads[n]++;
+	return(regionThreads);
+}
+
+nTupleImage* inpaint_image_components(nTupleImage *imgIn, nTupleImage *occIn,
+	patchMatchParameterStruct *patchMatchParams, inpaintingParameterStruct *inpaintingParams)
+{
+	std::vector<componentRegion> regions = get_component_regions(occIn);
+	std::sort(regions.begin(), regions.end(), compare_region_sizes);
+	int nRegions = (int)regions.size();
+	int nComponents = 0;
+	for (int n=0; n<nRegions; n++)
+		nComponents += regions[n].nComponents;
+	printf("Connected components : %d components, in %d regions\n",nComponents,nRegions);
+
+	nTupleImage *imgOut = copy_image_nTuple(imgIn, ROW_FIRST);
+	std::vector<nTupleImage*> regionOutputs(nRegions, (nTupleImage*)NULL);
+	//the PatchMatch searches of the regions are nested parallel regions
+	std::vector<int> regionThreads = share_region_threads(regions, patchMatchParams->nThreads);
+#ifdef _OPENMP
+	if ( (nRegions > 1) && (nRegions < patchMatchParams->nThreads) && (omp_get_max_active_levels() < 2) )
+		omp_set_max_active_levels(2);
+#endif
+	//the regions are independent : each inpainting run seeds the random numbers of its thread
+	#pragma omp parallel for schedule(dynamic,1) num_threads(min_int(nRegions,patchMatchParams->nThreads)) if(nRegions > 1)
+	for (int n=0; n<nRegions; n++)
+	{
+		const componentRegion &region = regions[n];
+		int xSizeRegion = region.xMax-region.xMin+1, ySizeRegion = region.yMax-region.yMin+1;
+		nTupleImage *imgRegion = new nTupleImage(xSizeRegion, ySizeRegion, imgIn->nTupleSize,
+			imgIn->patchSizeX, imgIn->patchSizeY, IMAGE_INDEXING);
+		nTupleImage *occRegion = new nTupleImage(xSizeRegion, ySizeRegion, 1,
+			imgIn->patchSizeX, imgIn->patchSizeY, IMAGE_INDEXING);
+		for (int y=0; y<ySizeRegion; y++)
+			for (int x=0; x<xSizeRegion; x++)
+			{
+				for (int c=0; c<(imgIn->nTupleSize); c++)
+					imgRegion->set_value_fast(x,y,c,imgIn->get_value(region.xMin+x,region.yMin+y,c));
+				occRegion->set_value_fast(x,y,0,occIn->get_value(region.xMin+x,region.yMin+y,0));
+			}
+
+		//inpaint_image modifies and deletes its parameters
+		patchMatchParameterStruct *regionPatchMatchParams = new patchMatchParameterStruct(*patchMatchParams);
+		regionPatchMatchParams->w = max_int(xSizeRegion, ySizeRegion);
+		if (nRegions > 1)
+			regionPatchMatchParams->nThreads = regionThreads[n];
+		inpaintingParameterStruct regionInpaintingParams = *inpaintingParams;
+		regionOutputs[n] = inpaint_image(imgRegion, occRegion, regionPatchMatchParams, &regionInpaintingParams);
+		delete imgRegion;
+		delete occRegion;
+	}
+
+	//the regions do not overlap
+	for (int n=0; n<nRegions; n++)
+	{
+		const componentRegion &region = regions[n];
+		for (int y=region.yMin; y<=region.yMax; y++)
+			for (int x=region.xMin; x<=region.xMax; x++)
+				if (occIn->get_value(x,y,0) > 0)
+					for (int c=0; c<(imgIn->nTupleSize); c++)
+						imgOut->set_value_fast(x,y,c,regionOutputs[n]->get_value_fast(x-region.xMin,y-region.yMin,c));
+		delete regionOutputs[n];
+	}
+	delete patchMatchParams;
+	return(imgOut);
+}
@@ -0,0 +1,37 @@
+//inpainting of the connected components of the occlusion : each component is inpainted on a region of interest
+//around it, with its own number of pyramid levels, and the regions are inpainted concurrently
+
+#ifndef COMPONENT_INPAINTING_H
+#define COMPONENT_INPAINTING_H
+
+#include <stdlib.h>
+
+#include "image_inpainting.h"
+
+//the context window of a component is its bounding box, enlarged on each side by its largest dimension (times
+//this factor), and by at least COMPONENT_MIN_CONTEXT pixels. The patches of the component are taken in this window
+#ifndef COMPONENT_CONTEXT_FACTOR
+#define COMPONENT_CONTEXT_FACTOR 1.0f
+#endif
+#ifndef COMPONENT_MIN_CONTEXT
+#define COMPONENT_MIN_CONTEXT 32
+#endif
+
+	//components whose context windows overlap are inpainted together, on the bounding box of their windows
+	typedef struct componentRegionStruct
+	{
+		int xMin, yMin, xMax, yMax;	//bounds of the region (included)
+		int nOccluded;	//number of occluded pixels
+		int nComponents;
+	}componentRegion;
+
+//connected components (8-connectivity) of the occluded pixels of occIn, grouped into regions which do not overlap
+std::vector<componentRegion> get_component_regions(nTupleImage *occIn);
+
+//inpaint the regions of the components, concurrently on patchMatchParams->nThreads threads (the largest regions
+//first). If inpaintingParams->nLevels is -1, the number of levels is determined for each region. The result does
+//not depend on the number of threads. As inpaint_image, deletes patchMatchParams
+nTupleImage* inpaint_image_components(nTupleImage *imgIn, nTupleImage *occIn,
+	patchMatchParameterStruct *patchMatchParams, inpaintingParameterStruct *inpaintingParams);
+
+#endif
@@ -33,48 +33,68 @@ nTupleImage * create_convolution_kernel(const char * kernelType, int xSizeKernel
 	return(convKernel);
 }
 
-nTupleImage * normalised_convolution_masked(nTupleImage *imgIn, nTupleImage *convKernel, nTupleImage *occlusionMask)
+//validity of the pixels for the masked convolutions : 1 for the unoccluded pixels of the image, 0 for the
+//occluded ones and in the (zero) halo
+static nTupleImage * create_validity_halo_image(nTupleImage *imgIn, nTupleImage *occlusionMask, int haloX, int haloY)
 {
-	nTupleImage * imgConvolved = new nTupleImage(imgIn->xSize, imgIn->ySize, imgIn->nTupleSize,
-	imgIn->patchSizeX, imgIn->patchSizeY, imgIn->indexing);
-
-	for (int p=0; p<imgIn->nTupleSize; p++)
+	nTupleImage *validImg = new nTupleImage(imgIn->xSize, imgIn->ySize, 1, IMAGE_INDEXING);
+	for (int y=0; y<imgIn->ySize; y++)
 		for (int x=0; x<imgIn->xSize; x++)
-			for (int y=0; y<imgIn->ySize; y++)
+			validImg->set_value_fast(x,y,0,(imageDataType)( (occlusionMask == NULL) || (occlusionMask->get_value(x,y,0) == 0) ));
+	
+	nTupleImage *validHalo = create_halo_image(validImg,haloX,haloY,HALO_ZERO);
+	delete validImg;
+	return(validHalo);
+}
+
+//normalised convolution of viewIn over the valid pixels. viewIn and viewValid must have a halo at least as large as
+//half the kernel, so that no bounds checks are needed. viewOut may be equal to viewIn (in-place filtering)
+static void normalised_convolution_view(const nTupleImageView &viewIn, const nTupleImageView &viewValid,
+	nTupleImage *convKernel, const nTupleImageView &viewOut)
+{
+	int hKernelX = (int)floor((convKernel->xSize)/2);
+	int hKernelY = (int)floor((convKernel->ySize)/2);
+	
+	for (int p=0; p<viewIn.nTupleSize; p++)
+		for (int x=0; x<viewIn.xSize; x++)
+			for (int y=0; y<viewIn.ySize; y++)
 			{
 				imageDataType sumConv = 0;
 				imageDataType convTemp = 0;
 				for (int xKernel=0; xKernel<(convKernel->xSize); xKernel++)
 					for (int yKernel=0; yKernel<(convKernel->ySize); yKernel++)
 					{
-						int xShift = x - (int)floor((convKernel->xSize)/2) + xKernel;
-						int yShift = y - (int)floor((convKernel->ySize)/2) + yKernel;
-				
-						if ( xShift>=0 && xShift<(imgIn->xSize) && yShift>=0 && yShift<(imgIn->ySize) )
+						int xShift = x - hKernelX + xKernel;
+						int yShift = y - hKernelY + yKernel;
+						if (viewValid.get_value(xShift,yShift,0) != 0)
 						{
-							if ( occlusionMask != NULL)
-							{
-								if (occlusionMask->get_value(xShift,yShift,0) ==0)
-								{
-									convTemp = convTemp + ( imgIn->get_value(xShift,yShift,p) )*
-									(convKernel->get_value(xKernel,yKernel,0) );
-									sumConv = sumConv + convKernel->get_value(xKernel,yKernel,0);
-								}
-							}
-							else
-							{
-								convTemp = convTemp + ( imgIn->get_value(xShift,yShift,p) )*
-									(convKernel->get_value(xKernel,yKernel,0) );
-								sumConv = sumConv + convKernel->get_value(xKernel,yKernel,0);
-							}
+							convTemp = convTemp + ( viewIn.get_value(xShift,yShift,p) )*
+								(convKernel->get_value_fast(xKernel,yKernel,0) );
+							sumConv = sumConv + convKernel->get_value_fast(xKernel,yKernel,0);
 						}
 					}
 				if (sumConv == 0)	//if no unmasked pixels are available here
-					imgConvolved->set_value(x,y,p,(imageDataType)0);
+					viewOut.set_value(x,y,p,(imageDataType)0);
 				else
-					imgConvolved->set_value(x,y,p,(imageDataType)convTemp/sumConv);
+					viewOut.set_value(x,y,p,(imageDataType)convTemp/sumConv);
 			}
+}
 
+nTupleImage * normalised_convolution_masked(nTupleImage *imgIn, nTupleImage *convKernel, nTupleImage *occlusionMask)
+{
+	nTupleImage * imgConvolved = new nTupleImage(imgIn->xSize, imgIn->ySize, imgIn->nTupleSize,
+	imgIn->patchSizeX, imgIn->patchSizeY, imgIn->indexing);
+	
+	int haloX = (int)floor((convKernel->xSize)/2);
+	int haloY = (int)floor((convKernel->ySize)/2);
+	nTupleImage *imgHalo = create_halo_image(imgIn,haloX,haloY,HALO_ZERO);
+	nTupleImage *validHalo = create_validity_halo_image(imgIn,occlusionMask,haloX,haloY);
+	
+	normalised_convolution_view(get_image_view(imgHalo,haloX,haloY), get_image_view(validHalo,haloX,haloY),
+		convKernel, get_image_view(imgConvolved));
+	
+	delete imgHalo;
+	delete validHalo;
 	return imgConvolved;
 }
 
@@ -82,80 +102,28 @@ nTupleImage * normalised_convolution_masked_separable(nTupleImage *imgIn, nTuple
 {
 	nTupleImage * imgConvolved = new nTupleImage(imgIn->xSize, imgIn->ySize,imgIn->nTupleSize,
 	imgIn->patchSizeX, imgIn->patchSizeY, imgIn->indexing);
-
-	for (int p=0; p<imgIn->nTupleSize; p++)
-		for (int x=0; x<imgIn->xSize; x++)
-			for (int y=0; y<imgIn->ySize; y++)
-			{
-				imageDataType sumConv = 0;
-				imageDataType convTemp = 0;
-				for (int xKernel=0; xKernel<(convKernelX->xSize); xKernel++)
-					for (int yKernel=0; yKernel<(convKernelX->ySize); yKernel++)
-					{
-						int xShift = x - (int)floor((convKernelX->xSize)/2) + xKernel;
-						int yShift = y - (int)floor((convKernelX->ySize)/2) + yKernel;
-				
-						if ( xShift>=0 && xShift<(imgIn->xSize) && yShift>=0 && yShift<(imgIn->ySize) )
-						{
-							if ( occlusionMask != NULL)
-							{
-								if (occlusionMask->get_value(xShift,yShift,0) ==0)
-								{
-									convTemp = convTemp + ( imgIn->get_value(xShift,yShift,p) )*
-									(convKernelX->get_value(xKernel,yKernel,0) );
-									sumConv = sumConv + convKernelX->get_value(xKernel,yKernel,0);
-								}
-							}
-							else
-							{
-								convTemp = convTemp + ( imgIn->get_value(xShift,yShift,p) )*
-									(convKernelX->get_value(xKernel,yKernel,0) );
-								sumConv = sumConv + convKernelX->get_value(xKernel,yKernel,0);
-							}
-						}
-					}
-				if (sumConv == 0)	//if no unmasked pixels are available here
-					imgConvolved->set_value(x,y,p,(imageDataType)0);
-				else
-					imgConvolved->set_value(x,y,p,(imageDataType)convTemp/sumConv);
-			}
-
+	
+	int haloX = max_int((int)floor((convKernelX->xSize)/2),(int)floor((convKernelY->xSize)/2));
+	int haloY = max_int((int)floor((convKernelX->ySize)/2),(int)floor((convKernelY->ySize)/2));
+	nTupleImage *imgHalo = create_halo_image(imgIn,haloX,haloY,HALO_ZERO);
+	nTupleImage *validHalo = create_validity_halo_image(imgIn,occlusionMask,haloX,haloY);
+	//the intermediate result also needs a halo, as the second filter is applied in place
+	nTupleImage *convolvedHalo = create_halo_image(imgConvolved,haloX,haloY,HALO_ZERO);
+	nTupleImageView viewConvolved = get_image_view(convolvedHalo,haloX,haloY);
+	
+	normalised_convolution_view(get_image_view(imgHalo,haloX,haloY), get_image_view(validHalo,haloX,haloY),
+		convKernelX, viewConvolved);
 	//now convolve with the other filter
-	for (int p=0; p<imgConvolved->nTupleSize; p++)
+	normalised_convolution_view(viewConvolved, get_image_view(validHalo,haloX,haloY),
+		convKernelY, viewConvolved);
+	
+	for (int y=0; y<imgConvolved->ySize; y++)
 		for (int x=0; x<imgConvolved->xSize; x++)
-			for (int y=0; y<imgConvolved->ySize; y++)
-			{
-				imageDataType sumConv = 0;
-				imageDataType convTemp = 0;
-				for (int xKernel=0; xKernel<(convKernelY->xSize); xKernel++)
-					for (int yKernel=0; yKernel<(convKernelY->ySize); yKernel++)
-					{
-						int xShift = x - (int)floor((convKernelY->xSize)/2) + xKernel;
-						int yShift = y - (int)floor((convKernelY->ySize)/2) + yKernel;
-				
-						if ( xShift>=0 && xShift<(imgIn->xSize) && yShift>=0 && yShift<(imgIn->ySize) )
-						{
-							if ( occlusionMask != NULL)
-							{
-								if (occlusionMask->get_value(xShift,yShift,0) ==0)
-								{
-									convTemp = convTemp + ( imgConvolved->get_value(xShift,yShift,p) )*
-									(convKernelY->get_value(xKernel,yKernel,0) );
-									sumConv = sumConv + convKernelY->get_value(xKernel,yKernel,0);
-								}
-							}
-							else
-							{
-								convTemp = convTemp + ( imgConvolved->get_value(xShift,yShift,p) )*
-									(convKernelY->get_value(xKernel,yKernel,0) );
-								sumConv = sumConv + convKernelY->get_value(xKernel,yKernel,0);
-							}
-						}
-					}
-				if (sumConv == 0)	//if no unmasked pixels are available here
-					imgConvolved->set_value(x,y,p,(imageDataType)0);
-				else
-					imgConvolved->set_value(x,y,p,(imageDataType)convTemp/sumConv);
-			}
+			for (int p=0; p<imgConvolved->nTupleSize; p++)
+				imgConvolved->set_value_fast(x,y,p,viewConvolved.get_value(x,y,p));
+	
+	delete imgHalo;
+	delete validHalo;
+	delete convolvedHalo;
 	return imgConvolved;
 }
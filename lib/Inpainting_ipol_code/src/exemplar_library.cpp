@@ -0,0 +1,397 @@
+//exemplar library : undamaged regions of several images, stored in a single file which is memory mapped
+//by the inpainting jobs and used as an extra source of patches
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <string>
+
+#include "exemplar_library.h"
+#include "image_inpainting.h"
+#include "patch_match_tools.h"
+
+//libraries opened by get_exemplar_library, by file name
+static std::map<std::string,exemplarLibrary*> sharedLibraries;
+
+typedef struct exemplarEntryStruct
+{
+	float *values;
+	float *occlusion;
+	int xSize, ySize, nTupleSize, nOccTupleSize;
+	int xMin, yMin, xMax, yMax;	//bounding box of the unoccluded pixels
+}exemplarEntry;
+
+static bool is_occluded_entry_pixel(const exemplarEntry *entry, int x, int y)
+{
+	for (int c=0; c<(entry->nOccTupleSize); c++)
+		if (entry->occlusion[ (size_t)c*(entry->xSize)*(entry->ySize) + (size_t)y*(entry->xSize) + x ] > 0)
+			return(true);
+	return(false);
+}
+
+int build_exemplar_library(const char *fileName, const char **imageFiles, const char **occlusionFiles, int nImages)
+{
+	std::vector<exemplarEntry> entries;
+	int xSizeLibrary = 0, ySizeLibrary = 0, nTupleSize = -1;
+	int returnVal = 1;
+
+	//read the images and find their undamaged regions
+	for (int i=0; i<nImages; i++)
+	{
+		exemplarEntry entry;
+		size_t nx,ny,nc,nOccX,nOccY,nOccC;
+		printf("Reading library image %s\n",imageFiles[i]);
+		entry.values = read_image(imageFiles[i],&nx,&ny,&nc);
+		entry.occlusion = read_image(occlusionFiles[i],&nOccX,&nOccY,&nOccC);
+		if ( (entry.values == NULL) || (entry.occlusion == NULL) || (nx != nOccX) || (ny != nOccY) ||
+			( (nTupleSize != -1) && ((int)nc != nTupleSize) ) )
+		{
+			printf("Error in build_exemplar_library, %s and %s can not be added to the library.\n",
+				imageFiles[i],occlusionFiles[i]);
+			free_image(entry.values);
+			free_image(entry.occlusion);
+			returnVal = -1;
+			break;
+		}
+		entry.xSize = (int)nx;
+		entry.ySize = (int)ny;
+		entry.nTupleSize = (int)nc;
+		entry.nOccTupleSize = (int)nOccC;
+		nTupleSize = (int)nc;
+
+		entry.xMin = entry.xSize; entry.yMin = entry.ySize;
+		entry.xMax = -1; entry.yMax = -1;
+		for (int y=0; y<entry.ySize; y++)
+			for (int x=0; x<entry.xSize; x++)
+				if (!is_occluded_entry_pixel(&entry,x,y))
+				{
+					entry.xMin = min_int(entry.xMin,x); entry.xMax = max_int(entry.xMax,x);
+					entry.yMin = min_int(entry.yMin,y); entry.yMax = max_int(entry.yMax,y);
+				}
+		if (entry.xMax < 0)
+		{
+			printf("Warning, %s has no undamaged pixel, it is not added to the library.\n",imageFiles[i]);
+			free_image(entry.values);
+			free_image(entry.occlusion);
+			continue;
+		}
+		xSizeLibrary = max_int(xSizeLibrary, entry.xMax-entry.xMin+1);
+		ySizeLibrary = ySizeLibrary + ( (entries.size() > 0) ? EXEMPLAR_LIBRARY_SEPARATION : 0 ) + entry.yMax-entry.yMin+1;
+		entries.push_back(entry);
+	}
+	if ( (returnVal == 1) && (entries.size() == 0) )
+	{
+		printf("Error in build_exemplar_library, the library is empty.\n");
+		returnVal = -1;
+	}
+
+	//stack the undamaged regions : the separations and the padding replicate the closest pixel of the entry
+	if (returnVal == 1)
+	{
+		size_t nPixels = (size_t)xSizeLibrary*ySizeLibrary;
+		std::vector<float> values(nPixels*nTupleSize);
+		std::vector<unsigned char> valid(nPixels,0);
+		int yEntry = 0;
+		for (size_t n=0; n<entries.size(); n++)
+		{
+			const exemplarEntry &entry = entries[n];
+			int ySizeEntry = entry.yMax-entry.yMin+1;
+			int yStart = (n == 0) ? 0 : yEntry - EXEMPLAR_LIBRARY_SEPARATION/2;
+			int yEnd = (n == entries.size()-1) ? ySizeLibrary : yEntry + ySizeEntry + EXEMPLAR_LIBRARY_SEPARATION/2;
+			for (int y=yStart; y<yEnd; y++)
+				for (int x=0; x<xSizeLibrary; x++)
+				{
+					int xIn = min_int(entry.xMin + x, entry.xMax);
+					int yIn = min_int(max_int(entry.yMin + y - yEntry, entry.yMin), entry.yMax);
+					for (int c=0; c<nTupleSize; c++)
+						values[ (size_t)c*nPixels + (size_t)y*xSizeLibrary + x ] =
+							entry.values[ (size_t)c*(entry.xSize)*(entry.ySize) + (size_t)yIn*(entry.xSize) + xIn ];
+					if ( (xIn == entry.xMin + x) && (yIn == entry.yMin + y - yEntry) )
+						valid[(size_t)y*xSizeLibrary + x] = (unsigned char)(!is_occluded_entry_pixel(&entry,xIn,yIn));
+				}
+			yEntry = yEntry + ySizeEntry + EXEMPLAR_LIBRARY_SEPARATION;
+		}
+
+		//write the file
+		FILE *libraryFile = fopen(fileName,"wb");
+		char header[EXEMPLAR_LIBRARY_HEADER_SIZE];
+		int32_t sizes[4] = {xSizeLibrary, ySizeLibrary, nTupleSize, (int32_t)entries.size()};
+		memset(header,0,EXEMPLAR_LIBRARY_HEADER_SIZE);
+		memcpy(header,EXEMPLAR_LIBRARY_MAGIC,8);
+		memcpy(header+8,sizes,sizeof(sizes));
+		if ( (libraryFile == NULL) ||
+			(fwrite(header,1,EXEMPLAR_LIBRARY_HEADER_SIZE,libraryFile) != EXEMPLAR_LIBRARY_HEADER_SIZE) ||
+			(fwrite(&(values[0]),sizeof(float),values.size(),libraryFile) != values.size()) ||
+			(fwrite(&(valid[0]),1,valid.size(),libraryFile) != valid.size()) )
+		{
+			printf("Error in build_exemplar_library, unable to write %s.\n",fileName);
+			returnVal = -1;
+		}
+		if (libraryFile != NULL)
+			fclose(libraryFile);
+		if (returnVal == 1)
+			printf("Exemplar library %s : %d images, %d x %d pixels\n",fileName,(int)entries.size(),
+				xSizeLibrary,ySizeLibrary);
+	}
+
+	for (size_t n=0; n<entries.size(); n++)
+	{
+		free_image(entries[n].values);
+		free_image(entries[n].occlusion);
+	}
+	return(returnVal);
+}
+
+exemplarLibrary* open_exemplar_library(const char *fileName)
+{
+	int fileDescriptor = open(fileName, O_RDONLY);
+	struct stat fileStatus;
+	if ( (fileDescriptor < 0) || (fstat(fileDescriptor,&fileStatus) != 0) ||
+		(fileStatus.st_size < EXEMPLAR_LIBRARY_HEADER_SIZE) )
+	{
+		printf("Error in open_exemplar_library, unable to read %s.\n",fileName);
+		if (fileDescriptor >= 0)
+			close(fileDescriptor);
+		return(NULL);
+	}
+	size_t mappingSize = (size_t)fileStatus.st_size;
+	void *mapping = mmap(NULL, mappingSize, PROT_READ, MAP_SHARED, fileDescriptor, 0);
+	close(fileDescriptor);
+	if (mapping == MAP_FAILED)
+	{
+		printf("Error in open_exemplar_library, unable to map %s.\n",fileName);
+		return(NULL);
+	}
+
+	//check the header and the size of the file
+	const char *header = (const char*)mapping;
+	int32_t sizes[4];
+	memcpy(sizes,header+8,sizeof(sizes));
+	size_t nPixels = (size_t)(sizes[0] > 0 ? sizes[0] : 0) * (size_t)(sizes[1] > 0 ? sizes[1] : 0);
+	if ( (memcmp(header,EXEMPLAR_LIBRARY_MAGIC,8) != 0) || (nPixels == 0) || (sizes[2] <= 0) ||
+		(mappingSize != EXEMPLAR_LIBRARY_HEADER_SIZE + nPixels*(sizes[2]*sizeof(float) + 1)) )
+	{
+		printf("Error in open_exemplar_library, %s is not a valid exemplar library.\n",fileName);
+		munmap(mapping,mappingSize);
+		return(NULL);
+	}
+
+	exemplarLibrary *library = new exemplarLibrary;
+	library->xSize = sizes[0];
+	library->ySize = sizes[1];
+	library->nTupleSize = sizes[2];
+	library->nEntries = sizes[3];
+	library->values = (const float*)(header + EXEMPLAR_LIBRARY_HEADER_SIZE);
+	library->valid = (const unsigned char*)(header + EXEMPLAR_LIBRARY_HEADER_SIZE + nPixels*sizes[2]*sizeof(float));
+	library->mapping = mapping;
+	library->mappingSize = mappingSize;
+	return(library);
+}
+
+void close_exemplar_library(exemplarLibrary *library)
+{
+	if (library == NULL)
+		return;
+	for (size_t i=0; i<library->imgLevels.size(); i++)
+	{
+		delete library->imgLevels[i];
+		delete library->exclusionLevels[i];
+	}
+	for (std::map<int,featurePyramid>::iterator it=library->features.begin(); it!=library->features.end(); it++)
+		delete_feature_pyramid(it->second);
+	for (std::map<std::vector<int>,validSourceIndex*>::iterator it=library->validSources.begin();
+		it!=library->validSources.end(); it++)
+		delete it->second;
+	munmap(library->mapping,library->mappingSize);
+	delete library;
+}
+
+exemplarLibrary* get_exemplar_library(const char *fileName)
+{
+	exemplarLibrary *library;
+	#pragma omp critical(exemplar_library)
+	{
+		std::map<std::string,exemplarLibrary*>::iterator it = sharedLibraries.find(fileName);
+		if (it != sharedLibraries.end())
+			library = it->second;
+		else
+		{
+			library = open_exemplar_library(fileName);
+			if (library != NULL)
+				sharedLibraries[fileName] = library;
+		}
+	}
+	return(library);
+}
+
+void close_exemplar_libraries()
+{
+	for (std::map<std::string,exemplarLibrary*>::iterator it=sharedLibraries.begin(); it!=sharedLibraries.end(); it++)
+		close_exemplar_library(it->second);
+	sharedLibraries.clear();
+}
+
+//extend the pyramids of the atlas to nLevels levels. The pyramids are built level by level from the coarsest
+//cached level, which gives the levels of a pyramid built at once. Called in the critical section of the library
+static void extend_library_levels(exemplarLibrary *library, int nLevels)
+{
+	if (library->imgLevels.size() == 0)
+	{
+		size_t nPixels = (size_t)(library->xSize)*(library->ySize);
+		nTupleImage *imgLevel = new nTupleImage(library->xSize, library->ySize, library->nTupleSize, 1, 1,
+			INPAINTING_INDEXING);
+		nTupleImage *exclusionLevel = new nTupleImage(library->xSize, library->ySize, 1, 1, 1, INPAINTING_INDEXING);
+		for (int y=0; y<(library->ySize); y++)
+			for (int x=0; x<(library->xSize); x++)
+			{
+				size_t index = (size_t)y*(library->xSize) + x;
+				for (int c=0; c<(library->nTupleSize); c++)
+					imgLevel->set_value_fast(x,y,c,(imageDataType)(library->values[(size_t)c*nPixels + index]));
+				exclusionLevel->set_value_fast(x,y,0,(imageDataType)( (library->valid[index] == 0) ? 1 : 0 ));
+			}
+		library->imgLevels.push_back(imgLevel);
+		library->exclusionLevels.push_back(exclusionLevel);
+	}
+	int nCached = (int)library->imgLevels.size();
+	if (nLevels <= nCached)
+		return;
+	nTupleImagePyramid imgPyramid = create_nTupleImage_pyramid(library->imgLevels[nCached-1], nLevels-nCached+1);
+	nTupleImagePyramid exclusionPyramid = create_nTupleImage_pyramid_binary(library->exclusionLevels[nCached-1],
+		nLevels-nCached+1);
+	delete imgPyramid[0];
+	delete exclusionPyramid[0];
+	for (int i=1; i<=nLevels-nCached; i++)
+	{
+		library->imgLevels.push_back(imgPyramid[i]);
+		library->exclusionLevels.push_back(exclusionPyramid[i]);
+	}
+	free(imgPyramid);
+	free(exclusionPyramid);
+}
+
+void get_exemplar_library_level(exemplarLibrary *library, int level, nTupleImage **imgLevel,
+	nTupleImage **exclusionLevel)
+{
+	#pragma omp critical(exemplar_library)
+	{
+		extend_library_levels(library, level+1);
+		*imgLevel = library->imgLevels[level];
+		*exclusionLevel = library->exclusionLevels[level];
+	}
+}
+
+featurePyramid get_exemplar_library_features(exemplarLibrary *library, int nLevels)
+{
+	featurePyramid features;
+	#pragma omp critical(exemplar_library)
+	{
+		std::map<int,featurePyramid>::iterator it = library->features.find(nLevels);
+		if (it != library->features.end())
+			features = it->second;
+		else
+		{
+			//the invalid pixels do not contribute to the features
+			extend_library_levels(library, 1);
+			features = create_feature_pyramid(library->imgLevels[0], library->exclusionLevels[0], nLevels);
+			library->features[nLevels] = features;
+		}
+	}
+	return(features);
+}
+
+const validSourceIndex* get_exemplar_library_sources(exemplarLibrary *library, int level,
+	const patchMatchParameterStruct *params)
+{
+	std::vector<int> key(3);
+	key[0] = level;
+	key[1] = params->patchSizeX;
+	key[2] = params->patchSizeY;
+	validSourceIndex *validSources;
+	#pragma omp critical(exemplar_library)
+	{
+		std::map<std::vector<int>,validSourceIndex*>::iterator it = library->validSources.find(key);
+		if (it != library->validSources.end())
+			validSources = it->second;
+		else
+		{
+			//the patches which contain excluded pixels are not valid sources
+			extend_library_levels(library, level+1);
+			nTupleImage *imgLevel = copy_image_nTuple(library->imgLevels[level]);
+			imgLevel->set_patch_size(params->patchSizeX, params->patchSizeY);
+			nTupleImage *structElDilate = create_structuring_element("rectangle", params->patchSizeX, params->patchSizeY);
+			nTupleImage *exclusionDilate = imdilate(library->exclusionLevels[level], structElDilate);
+			validSources = create_valid_source_index(imgLevel, exclusionDilate, params);
+			library->validSources[key] = validSources;
+			delete imgLevel;
+			delete structElDilate;
+			delete exclusionDilate;
+		}
+	}
+	return(validSources);
+}
+
+int get_exemplar_library_row(int ySize, int nLevels, int patchSizeY)
+{
+	//the separation keeps the patches of the image to inpaint out of the library at the coarsest level
+	int subSampleFactor = 1 << (nLevels-1);
+	int separation = max_int(max_int(EXEMPLAR_LIBRARY_SEPARATION/subSampleFactor, patchSizeY/2), 1);
+	return( subSampleFactor*( (ySize+subSampleFactor-1)/subSampleFactor + separation ) );
+}
+
+nTupleImage* stack_exemplar_library(nTupleImage *imgIn, nTupleImage *imgLibrary, int yLibrary, int xSize, int ySize,
+	bool replicate)
+{
+	nTupleImage *imgOut = new nTupleImage(xSize, ySize, imgIn->nTupleSize, imgIn->patchSizeX, imgIn->patchSizeY,
+		imgIn->indexing);
+	//the rows above the middle of the separation belong to the image, the others to the library
+	int yMiddle = (imgIn->ySize + yLibrary)/2;
+	for (int y=0; y<ySize; y++)
+	{
+		nTupleImage *imgPart = (y < yMiddle) ? imgIn : imgLibrary;
+		int yPart = (y < yMiddle) ? y : y-yLibrary;
+		for (int x=0; x<xSize; x++)
+		{
+			if (imgPart == NULL)
+			{
+				for (int c=0; c<(imgIn->nTupleSize); c++)
+					imgOut->set_value_fast(x,y,c,(imageDataType)0);
+				continue;
+			}
+			int xIn = min_int(x, imgPart->xSize-1);
+			int yIn = min_int(max_int(yPart,0), imgPart->ySize-1);
+			bool inside = (xIn == x) && (yIn == yPart);
+			for (int c=0; c<(imgIn->nTupleSize); c++)
+				imgOut->set_value_fast(x,y,c, (inside || replicate) ? imgPart->get_value_fast(xIn,yIn,c) : (imageDataType)0);
+		}
+	}
+	return(imgOut);
+}
+
+nTupleImage* stack_exemplar_library_exclusion(nTupleImage *imgIn, nTupleImage *exclusionLibrary, int yLibrary,
+	int xSize, int ySize)
+{
+	nTupleImage *exclusionOut = new nTupleImage(xSize, ySize, 1, imgIn->patchSizeX, imgIn->patchSizeY, imgIn->indexing);
+	for (int y=0; y<ySize; y++)
+		for (int x=0; x<xSize; x++)
+		{
+			bool excluded;
+			if (y < yLibrary)
+				excluded = (x >= imgIn->xSize) || (y >= imgIn->ySize);
+			else
+				excluded = (x >= exclusionLibrary->xSize) || (exclusionLibrary->get_value_fast(x,y-yLibrary,0) > 0);
+			exclusionOut->set_value_fast(x,y,0,(imageDataType)(excluded ? 1 : 0));
+		}
+	return(exclusionOut);
+}
+
+nTupleImage* unstack_exemplar_library(nTupleImage *imgStacked, int xSize, int ySize)
+{
+	nTupleImage *imgOut = new nTupleImage(xSize, ySize, imgStacked->nTupleSize, imgStacked->patchSizeX,
+		imgStacked->patchSizeY, imgStacked->indexing);
+	for (int y=0; y<ySize; y++)
+		for (int x=0; x<xSize; x++)
+			for (int c=0; c<(imgStacked->nTupleSize); c++)
+				imgOut->set_value_fast(x,y,c,imgStacked->get_value_fast(x,y,c));
+	return(imgOut);
+}
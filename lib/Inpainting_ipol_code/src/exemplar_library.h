@@ -0,0 +1,81 @@
+//exemplar library : undamaged regions of several images, stored in a single file which is memory mapped
+//by the inpainting jobs and used as an extra source of patches
+
+#ifndef EXEMPLAR_LIBRARY_H
+#define EXEMPLAR_LIBRARY_H
+
+#include <stdlib.h>
+#include <map>
+#include <vector>
+
+#include "image_structures.h"
+
+//identifier and version of the library files
+#define EXEMPLAR_LIBRARY_MAGIC "EXLIB001"
+//size in bytes of the header (magic, then xSize, ySize, nTupleSize and nEntries as 32-bit integers)
+#define EXEMPLAR_LIBRARY_HEADER_SIZE 64
+
+//number of excluded rows between the entries of the library, and minimum number of excluded rows between the image
+//to inpaint and the library : the pyramid levels are blurred and subsampled, so the separation must survive the
+//subsampling
+#ifndef EXEMPLAR_LIBRARY_SEPARATION
+#define EXEMPLAR_LIBRARY_SEPARATION 16
+#endif
+
+	//the entries are stacked vertically in an atlas of xSize x ySize pixels. The values are stored as floats,
+	//channel by channel and row by row (as returned by read_image), followed by one byte per pixel which is 1
+	//if the pixel may be used as a source, 0 otherwise (damaged pixels, separations, padding). The file is
+	//written in the byte order of the machine. The structures derived from the atlas are built on their first use
+	//and kept with the library, so the jobs which use the same library share them
+	typedef struct exemplarLibraryStruct
+	{
+		int xSize;
+		int ySize;
+		int nTupleSize;
+		int nEntries;
+		const float *values;
+		const unsigned char *valid;
+		void *mapping;		//memory mapping of the file
+		size_t mappingSize;
+		std::vector<nTupleImage*> imgLevels;		//pyramid of the atlas (INPAINTING_INDEXING)
+		std::vector<nTupleImage*> exclusionLevels;	//pyramid of the pixels which are not valid sources
+		std::map<int,featurePyramid> features;		//feature pyramids, by number of levels
+		std::map<std::vector<int>,validSourceIndex*> validSources;	//by level and patch size
+	}exemplarLibrary;
+
+//build a library from the undamaged pixels of nImages images : each image is cropped to the bounding box of
+//its unoccluded pixels. Returns -1 in case of error
+int build_exemplar_library(const char *fileName, const char **imageFiles, const char **occlusionFiles, int nImages);
+
+//memory map a library (read only, the pages are shared by the processes which use the same file), NULL on error
+exemplarLibrary* open_exemplar_library(const char *fileName);
+void close_exemplar_library(exemplarLibrary *library);
+//library of a file shared by the jobs of the process : it is opened by the first call, and stays mapped (with
+//its pyramids) until close_exemplar_libraries. NULL on error
+exemplarLibrary* get_exemplar_library(const char *fileName);
+void close_exemplar_libraries();
+
+//level of the pyramids of the atlas and of its excluded pixels
+void get_exemplar_library_level(exemplarLibrary *library, int level, nTupleImage **imgLevel,
+	nTupleImage **exclusionLevel);
+featurePyramid get_exemplar_library_features(exemplarLibrary *library, int nLevels);
+//valid sources of a level of the atlas, for the patch size of params
+const validSourceIndex* get_exemplar_library_sources(exemplarLibrary *library, int level,
+	const patchMatchParameterStruct *params);
+
+//each pyramid level of the image to inpaint is stacked above the same level of the library : this is the first
+//row of the library at the finest level, it is divided by 2 at each coarser level
+int get_exemplar_library_row(int ySize, int nLevels, int patchSizeY);
+//stack a level of an image (in the top left corner) above the same level of the library (from the row yLibrary),
+//in an image of xSize x ySize pixels. The other pixels replicate the closest pixel of their part if replicate is
+//true, and are 0 otherwise (imgLibrary NULL : the library part is 0)
+nTupleImage* stack_exemplar_library(nTupleImage *imgIn, nTupleImage *imgLibrary, int yLibrary, int xSize, int ySize,
+	bool replicate);
+//pixels of the stacked level which are neither in the image nor valid in the library : they are never used as
+//sources nor inpainted
+nTupleImage* stack_exemplar_library_exclusion(nTupleImage *imgIn, nTupleImage *exclusionLibrary, int yLibrary,
+	int xSize, int ySize);
+//image to inpaint, extracted from the stacked image
+nTupleImage* unstack_exemplar_library(nTupleImage *imgStacked, int xSize, int ySize);
+
+#endif
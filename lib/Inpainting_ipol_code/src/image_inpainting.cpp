@@ -12,6 +12,11 @@
  */
 
 #include "image_inpainting.h"
+#include "streaming_inpainting.h"
+#include "component_inpainting.h"
+
+#include <map>
+#include <string>
 
 patchMatchParameterStruct * initialise_patch_match_parameters(
 	int patchSizeX, int patchSizeY, int imgSizeX, int imgSizeY, bool verboseMode)
@@ -21,12 +26,21 @@ patchMatchParameterStruct * initialise_patch_match_parameters(
 	//set parameter structure
 	patchMatchParams->patchSizeX = patchSizeX;
 	patchMatchParams->patchSizeY = patchSizeY;
-            patchMatchParams->nIters = 12;
+	patchMatchParams->nIters = 12;
+	patchMatchParams->convergenceThreshold = 0;
 	patchMatchParams->w = max_int(imgSizeX,imgSizeY); //maximum search radius
 	patchMatchParams->alpha = 0.5; //search radius shrinkage factor (0.5 in standard PatchMatch)
 	patchMatchParams->maxShiftDistance = -1;
 	patchMatchParams->partialComparison = 0;
 	patchMatchParams->fullSearch = 0;
+	patchMatchParams->nThreads = get_max_threads();
+	patchMatchParams->sequentialScan = 0;
+	patchMatchParams->activePixels = NULL;
+	patchMatchParams->changedMatches = NULL;
+	patchMatchParams->validSources = NULL;
+	patchMatchParams->unOccludedIntegral = NULL;
+	patchMatchParams->quantisedMatching = 0;
+	patchMatchParams->quantisedImages = NULL;
 	//texture attributes
 	patchMatchParams->normGradX = NULL;
 	patchMatchParams->normGradY = NULL;
@@ -45,9 +59,13 @@ void display_patch_match_parameters(patchMatchParameterStruct *patchMatchParams)
 	printf("Patch size X : %d\n",patchMatchParams->patchSizeX);
 	printf("Patch size Y : %d\n",patchMatchParams->patchSizeY);
 	printf("Number of propagation/random search iterations: %d\n",patchMatchParams->nIters);
+	printf("Convergence threshold (fraction of improved matches) : %f\n",patchMatchParams->convergenceThreshold);
 	printf("Random search reduction factor (alpha) : %f\n",patchMatchParams->alpha);
 	printf("Maximum search shift allowed (-1 for whole image) : %f\n",patchMatchParams->maxShiftDistance);
-	printf("Full search (should be activated only for experimental purposes !!) : %d\n",patchMatchParams->fullSearch);
+	printf("Search mode (0 PatchMatch, 1 brute force, 2 FFT, 3 kd-tree) : %d\n",patchMatchParams->fullSearch);
+	printf("Number of threads : %d\n",patchMatchParams->nThreads);
+	printf("Sequential PatchMatch scan : %d\n",patchMatchParams->sequentialScan);
+	printf("Quantised (8-bit) patch comparisons : %d\n",patchMatchParams->quantisedMatching);
 	printf("Verbose mode : %d\n",patchMatchParams->verboseMode);
 }
 
@@ -61,10 +79,44 @@ inpaintingParameterStruct * initialise_inpainting_parameters(int nLevels, bool u
 	inpaintingParams->useFeatures = useFeatures;
 	inpaintingParams->residualThreshold = residualThreshold;
 	inpaintingParams->maxIterations = maxIterations;
+	inpaintingParams->connectedComponents = false;
+	inpaintingParams->tvLambda = -1;
+	inpaintingParams->tvMaxIterations = TV_MAX_ITERATIONS;
+	inpaintingParams->reconstructionType = AGGREGATED_PATCHES;
+	inpaintingParams->freezeThreshold = FREEZE_THRESHOLD;
 	
 	return(inpaintingParams);	
 }
 
+inpaintingOptionStruct * initialise_inpainting_options(int patchSizeX, int patchSizeY, bool useFeatures)
+{
+	inpaintingOptionStruct *options = new inpaintingOptionStruct;
+
+	options->patchSizeX = patchSizeX;
+	options->patchSizeY = patchSizeY;
+	options->nLevels = -1;
+	options->useFeatures = useFeatures;
+	options->verboseMode = false;
+	options->nThreads = -1;
+	options->convergenceThreshold = -1;
+	options->searchMode = -1;
+	options->quantisedMatching = -1;
+	options->nIters = -1;
+	options->sequentialScan = -1;
+	options->exemplarLibraryFile = NULL;
+	options->memoryBudget = -1;
+	options->connectedComponents = -1;
+	options->useRegionOfInterest = false;
+	for (int i=0; i<4; i++)
+		options->regionOfInterest[i] = 0;
+	options->tvLambda = -1;
+	options->tvMaxIterations = -1;
+	options->scatterReconstruction = -1;
+	options->freezeThreshold = -1;
+
+	return(options);
+}
+
 
 void display_inpainting_parameters(inpaintingParameterStruct *inpaintingParams)
 {
@@ -76,6 +128,11 @@ void display_inpainting_parameters(inpaintingParameterStruct *inpaintingParams)
 	printf("Use features : %d\n",inpaintingParams->useFeatures);
 	printf("Residual threshold: %f\n",inpaintingParams->residualThreshold);
 	printf("Maximum number of iterations: %d\n",inpaintingParams->maxIterations);
+	printf("Inpaint the connected components separately : %d\n",inpaintingParams->connectedComponents);
+	printf("TV initialisation fidelity weight (-1 for none) : %f\n",inpaintingParams->tvLambda);
+	printf("Maximum number of TV iterations : %d\n",inpaintingParams->tvMaxIterations);
+	printf("Reconstruction type : %d\n",inpaintingParams->reconstructionType);
+	printf("Threshold of the frozen pixels (0 for none) : %f\n",inpaintingParams->freezeThreshold);
 	
 	printf("*************************\n\n");
 
@@ -123,8 +180,21 @@ float * inpaint_image_wrapper(float *inputImage, int nx, int ny, int nc,
 	return(imgOut->get_data_ptr());
 }
 
-void inpaint_image_wrapper(const char *fileIn,const char *fileOccIn, const char *fileOut,
-			int patchSizeX, int patchSizeY, int nLevels, bool useFeatures, bool verboseMode)
+//release the inputs and the parameters of inpaint_image_wrapper (NULL if they were not created, or if they were
+//released by the inpainting), and return returnVal
+static int release_wrapper_inputs(int returnVal, float *inputImage, float *inputOcc, nTupleImage *imgIn,
+	nTupleImage *occIn, patchMatchParameterStruct *patchMatchParams, inpaintingParameterStruct *inpaintingParams)
+{
+	delete imgIn;
+	delete occIn;
+	free_image(inputImage);
+	free_image(inputOcc);
+	delete patchMatchParams;
+	delete inpaintingParams;
+	return(returnVal);
+}
+
+int inpaint_image_wrapper(const char *fileIn,const char *fileOccIn, const char *fileOut, const inpaintingOptionStruct *options)
 {
 
 	// *************************** //
@@ -133,33 +203,108 @@ void inpaint_image_wrapper(const char *fileIn,const char *fileOccIn, const char
 	//read input image
 	size_t nx,ny,nc;
 	size_t nOccX,nOccY,nOccC;
+	float *inputImage = NULL, *inputOcc = NULL;
 	
-	//read input image
-	printf("Reading input image\n");
-	float *inputImage = read_image(fileIn,&nx,&ny,&nc);
-	
-	//read input occlusion
-	printf("Reading input occlusion\n");
-	float *inputOcc = read_image(fileOccIn,&nOccX,&nOccY,&nOccC);
+	if ( (options->patchSizes.size() > 0) && ( (options->memoryBudget > 0) || (options->exemplarLibraryFile != NULL) || (options->connectedComponents > 0) ) )
+	{
+		printf("Error, the list of patch sizes can not be used with the streaming inpainting, the exemplar library or the connected components.\n");
+		return(-1);
+	}
+	if (options->memoryBudget > 0)
+	{
+		//the images are streamed, the search radius is set for each tile
+		if ( (options->exemplarLibraryFile != NULL) || (options->useRegionOfInterest) )
+		{
+			printf("Error, the exemplar library and the region of interest can not be used with the streaming inpainting.\n");
+			return(-1);
+		}
+		nx = 0;
+		ny = 0;
+	}
+	else if (options->useRegionOfInterest)
+	{
+		//only the region (x0,y0,xSize,ySize) of the image and of the occlusion is read and inpainted
+		printf("Reading input image\n");
+		const int *regionOfInterest = options->regionOfInterest;
+		inputImage = read_image_region(fileIn,regionOfInterest[0],regionOfInterest[1],regionOfInterest[2],
+			regionOfInterest[3],&nc);
+		printf("Reading input occlusion\n");
+		inputOcc = read_image_region(fileOccIn,regionOfInterest[0],regionOfInterest[1],regionOfInterest[2],
+			regionOfInterest[3],&nOccC);
+		nx = nOccX = regionOfInterest[2];
+		ny = nOccY = regionOfInterest[3];
+	}
+	else
+	{
+		//read input image
+		printf("Reading input image\n");
+		inputImage = read_image(fileIn,&nx,&ny,&nc);
+		
+		//read input occlusion
+		printf("Reading input occlusion\n");
+		inputOcc = read_image(fileOccIn,&nOccX,&nOccY,&nOccC);
+	}
+	if ( (options->memoryBudget <= 0) && ( (inputImage == NULL) || (inputOcc == NULL) ) )
+		return(release_wrapper_inputs(-1,inputImage,inputOcc,NULL,NULL,NULL,NULL));
 	
 	// ****************************************** //
 	// **** INITIALISE PATCHMATCH PARAMETERS **** //
 	// ****************************************** //
-	patchMatchParameterStruct *patchMatchParams = initialise_patch_match_parameters(patchSizeX, patchSizeY, nx, ny, verboseMode);
+	patchMatchParameterStruct *patchMatchParams = initialise_patch_match_parameters(options->patchSizeX, options->patchSizeY,
+		nx, ny, options->verboseMode);
+	if (options->nThreads > 0)
+		patchMatchParams->nThreads = options->nThreads;
+	if (options->convergenceThreshold >= 0)
+		patchMatchParams->convergenceThreshold = options->convergenceThreshold;
+	if (options->searchMode >= 0)
+		patchMatchParams->fullSearch = options->searchMode;
+	if (options->quantisedMatching >= 0)
+		patchMatchParams->quantisedMatching = options->quantisedMatching;
+	if (options->nIters > 0)
+		patchMatchParams->nIters = options->nIters;
+	if (options->sequentialScan >= 0)
+		patchMatchParams->sequentialScan = options->sequentialScan;
 	if (check_patch_match_parameters(patchMatchParams) == -1)
-		return;
+		return(release_wrapper_inputs(-1,inputImage,inputOcc,NULL,NULL,patchMatchParams,NULL));
+	for (size_t n=0; n<options->patchSizes.size(); n++)
+	{
+		patchMatchParameterStruct sizePatchMatchParams = *patchMatchParams;
+		sizePatchMatchParams.patchSizeX = options->patchSizes[n];
+		sizePatchMatchParams.patchSizeY = options->patchSizes[n];
+		if (check_patch_match_parameters(&sizePatchMatchParams) == -1)
+			return(release_wrapper_inputs(-1,inputImage,inputOcc,NULL,NULL,patchMatchParams,NULL));
+	}
 	// ****************************************** //
 	// **** INITIALISE INPAINTING PARAMETERS **** //
 	// ****************************************** //
 	float residualThreshold = 0.1;
 	int maxIterations = 10;
 	inpaintingParameterStruct *inpaintingParams =
-		initialise_inpainting_parameters(nLevels, useFeatures, residualThreshold, maxIterations);
+		initialise_inpainting_parameters(options->nLevels, options->useFeatures, residualThreshold, maxIterations);
+	if (options->connectedComponents >= 0)
+		inpaintingParams->connectedComponents = (options->connectedComponents > 0);
+	if (options->tvLambda > 0)
+		inpaintingParams->tvLambda = options->tvLambda;
+	if (options->tvMaxIterations > 0)
+		inpaintingParams->tvMaxIterations = options->tvMaxIterations;
+	if (options->scatterReconstruction > 0)
+		inpaintingParams->reconstructionType = SCATTERED_PATCHES;
+	if (options->freezeThreshold >= 0)
+		inpaintingParams->freezeThreshold = options->freezeThreshold;
+
+	//whole-folio scans : the damaged tiles are inpainted one after the other, in the memory budget
+	if (options->memoryBudget > 0)
+	{
+		int result = inpaint_image_streaming(fileIn, fileOccIn, fileOut, patchMatchParams, inpaintingParams,
+			options->memoryBudget);
+		return(release_wrapper_inputs(result,NULL,NULL,NULL,NULL,patchMatchParams,inpaintingParams));
+	}
 	
 	// ******************************** //
 	// ***** CREATE IMAGE STRUCTURES*** //
 	// ******************************** //
 
+	int patchSizeX = options->patchSizeX, patchSizeY = options->patchSizeY;
 	nTupleImage *imgIn = new nTupleImage(nx,ny,nc,patchSizeX,patchSizeY,IMAGE_INDEXING,inputImage);
 	nTupleImage *occIn;
 	if (nOccC == 3)		//if we need to convert the input occlusion
@@ -173,58 +318,245 @@ void inpaint_image_wrapper(const char *fileIn,const char *fileOccIn, const char
 	
 	occIn->binarise();
 	occIn->display_attributes();
+	
+	//the undamaged pixels of the exemplar library become extra sources (the library stays mapped for the next jobs)
+	exemplarLibrary *library = NULL;
+	if (options->exemplarLibraryFile != NULL)
+	{
+		if (inpaintingParams->connectedComponents)
+		{
+			printf("Error, the exemplar library can not be used with the inpainting of the connected components.\n");
+			return(release_wrapper_inputs(-1,inputImage,inputOcc,imgIn,occIn,patchMatchParams,inpaintingParams));
+		}
+		library = get_exemplar_library(options->exemplarLibraryFile);
+		if (library == NULL)
+			return(release_wrapper_inputs(-1,inputImage,inputOcc,imgIn,occIn,patchMatchParams,inpaintingParams));
+		if (library->nTupleSize != imgIn->nTupleSize)
+		{
+			printf("Error, the image has %d channels and the exemplar library %d.\n",imgIn->nTupleSize,library->nTupleSize);
+			return(release_wrapper_inputs(-1,inputImage,inputOcc,imgIn,occIn,patchMatchParams,inpaintingParams));
+		}
+		printf("Exemplar library : %d images, %d x %d pixels\n",library->nEntries,library->xSize,library->ySize);
+	}
+	//the output is written with the bits per sample of the input image (8 or 16 bits for the TIFF files)
+	size_t nxFile,nyFile,ncFile;
+	int bitDepth = 16;
+	if (read_image_size(fileIn,&nxFile,&nyFile,&ncFile,&bitDepth) == -1)
+		bitDepth = 16;
+
 	// ***** CALL MAIN ROUTINE **** //
 
-	nTupleImage * imgOut = inpaint_image(imgIn, occIn, patchMatchParams, inpaintingParams);
+	//one output per patch size : output_5x5.png, output_7x7.png ...
+	if (options->patchSizes.size() > 0)
+	{
+		std::vector<nTupleImage*> imgOutSizes = inpaint_image_patch_sizes(imgIn, occIn, patchMatchParams,
+			inpaintingParams, options->patchSizes);
+		std::string fileOutString(fileOut);
+		size_t extensionPos = fileOutString.find_last_of('.');
+		if ( (extensionPos == std::string::npos) || (extensionPos < fileOutString.find_last_of('/')+1) )
+			extensionPos = fileOutString.size();
+		for (size_t n=0; n<imgOutSizes.size(); n++)
+		{
+			char sizeSuffix[64];
+			sprintf(sizeSuffix,"_%dx%d",options->patchSizes[n],options->patchSizes[n]);
+			std::string fileOutSize = fileOutString.substr(0,extensionPos) + sizeSuffix + fileOutString.substr(extensionPos);
+			printf("Writing %s\n",fileOutSize.c_str());
+			write_image(imgOutSizes[n],fileOutSize.c_str(),0,bitDepth);
+			delete imgOutSizes[n];
+		}
+		//patchMatchParams was deleted by the inpainting
+		return(release_wrapper_inputs(0,inputImage,inputOcc,imgIn,occIn,NULL,inpaintingParams));
+	}
+
+	nTupleImage * imgOut;
+	if (inpaintingParams->connectedComponents)
+		imgOut = inpaint_image_components(imgIn, occIn, patchMatchParams, inpaintingParams);
+	else
+		imgOut = inpaint_image(imgIn, occIn, patchMatchParams, inpaintingParams, library);
 
 	//write output
 	//write_image(imgOut,fileOut,255);
-	write_image(imgOut,fileOut);
+	write_image(imgOut,fileOut,0,bitDepth);
 
 	delete imgOut;
+	return(release_wrapper_inputs(0,inputImage,inputOcc,imgIn,occIn,NULL,inpaintingParams));
 }
 
-nTupleImage * inpaint_image( nTupleImage *imgInput, nTupleImage *occInput,
-patchMatchParameterStruct *patchMatchParams, inpaintingParameterStruct *inpaintingParams)
+//pixels of occIn, and pixels where exclusion > 0
+static nTupleImage* add_excluded_pixels(nTupleImage *occIn, nTupleImage *exclusion, nTupleImagePool *imagePool)
 {
-	
-	// ******************************************************************** //
-	// **** AUTOMATICALLY DETERMINE NUMBER OF LEVELS, IF NOT SPECIFIED **** //
-	// ******************************************************************** //
+	nTupleImage *occOut = acquire_image_copy(imagePool, occIn);
+	for (int y=0; y<(occOut->ySize); y++)
+		for (int x=0; x<(occOut->xSize); x++)
+			if (exclusion->get_value_fast(x,y,0) > 0)
+				occOut->set_value_fast(x,y,0,(imageDataType)1);
+	return(occOut);
+}
 
+//structures of the inpainting which do not depend on the patch size : the pyramids of the image, of the occlusion
+//and of the excluded pixels, and the feature pyramid. With an exemplar library, each level is stacked above the
+//same level of the library, from the row yLibrary >> level
+typedef struct inpaintingPyramidsStruct
+{
+	nTupleImagePyramid imgPyramid;
+	nTupleImagePyramid occPyramid;
+	nTupleImagePyramid exclusionPyramid;
+	featurePyramid featuresPyramid;
+	int nLevels;
+	exemplarLibrary *library;
+	int yLibrary;
+}inpaintingPyramids;
 
-	if (inpaintingParams->nLevels == -1)
+//replace a level of a pyramid of the image by the level stacked above the library level
+static void stack_pyramid_level(nTupleImagePyramid pyramid, int level, nTupleImage *libraryLevel, int yLibrary,
+	int xSize, int ySize, bool replicate)
+{
+	nTupleImage *imgStacked = stack_exemplar_library(pyramid[level], libraryLevel, yLibrary, xSize, ySize, replicate);
+	delete pyramid[level];
+	pyramid[level] = imgStacked;
+}
+
+//stack the pyramids of the image above the cached pyramids of the library
+static void stack_library_pyramids(inpaintingPyramids *pyramids, int patchSizeY)
+{
+	exemplarLibrary *library = pyramids->library;
+	pyramids->yLibrary = get_exemplar_library_row(pyramids->imgPyramid[0]->ySize, pyramids->nLevels, patchSizeY);
+	pyramids->exclusionPyramid = (nTupleImage**)malloc( (size_t)(pyramids->nLevels)*sizeof(nTupleImage*));
+	featurePyramid libraryFeatures;
+	if (pyramids->featuresPyramid.nLevels >= 0)
+		libraryFeatures = get_exemplar_library_features(library, pyramids->nLevels);
+	for (int level=0; level<(pyramids->nLevels); level++)
 	{
-		inpaintingParams->nLevels =
-			determine_multiscale_level_number(occInput,imgInput->patchSizeX,imgInput->patchSizeY);
+		nTupleImage *libraryLevel, *libraryExclusion;
+		get_exemplar_library_level(library, level, &libraryLevel, &libraryExclusion);
+		int yLibrary = (pyramids->yLibrary) >> level;
+		int xSize = max_int(pyramids->imgPyramid[level]->xSize, libraryLevel->xSize);
+		int ySize = yLibrary + libraryLevel->ySize;
+		pyramids->exclusionPyramid[level] = stack_exemplar_library_exclusion(pyramids->imgPyramid[level],
+			libraryExclusion, yLibrary, xSize, ySize);
+		stack_pyramid_level(pyramids->imgPyramid, level, libraryLevel, yLibrary, xSize, ySize, true);
+		stack_pyramid_level(pyramids->occPyramid, level, NULL, yLibrary, xSize, ySize, false);
+		if (pyramids->featuresPyramid.nLevels >= 0)
+		{
+			stack_pyramid_level(pyramids->featuresPyramid.normGradX, level, libraryFeatures.normGradX[level],
+				yLibrary, xSize, ySize, true);
+			stack_pyramid_level(pyramids->featuresPyramid.normGradY, level, libraryFeatures.normGradY[level],
+				yLibrary, xSize, ySize, true);
+		}
 	}
+}
 
-	display_inpainting_parameters(inpaintingParams);
-	display_patch_match_parameters(patchMatchParams);
-	
-	nTupleImage *imgOut;
-
-	// ************************** //
-	// **** CREATE PYRDAMIDS **** //
-	// ************************** //
-	nTupleImagePyramid imgPyramid = create_nTupleImage_pyramid(imgInput, inpaintingParams->nLevels);
-	nTupleImagePyramid occPyramid = create_nTupleImage_pyramid_binary(occInput, inpaintingParams->nLevels);
-	featurePyramid featuresPyramid;
-	if (inpaintingParams->useFeatures == true)
+static inpaintingPyramids create_inpainting_pyramids(nTupleImage *imgInput, nTupleImage *occInput,
+	exemplarLibrary *library, int nLevels, bool useFeatures)
+{
+	inpaintingPyramids pyramids;
+	pyramids.nLevels = nLevels;
+	pyramids.imgPyramid = create_nTupleImage_pyramid(imgInput, nLevels);
+	pyramids.occPyramid = create_nTupleImage_pyramid_binary(occInput, nLevels);
+	pyramids.exclusionPyramid = NULL;
+	pyramids.library = library;
+	pyramids.yLibrary = -1;
+	if (useFeatures == true)
 	{
 		double t1 = clock();
-		featuresPyramid = create_feature_pyramid(imgInput, occInput, inpaintingParams->nLevels);
+		pyramids.featuresPyramid = create_feature_pyramid(imgInput, occInput, nLevels);
 		MY_PRINTF("\n\nFeatures calculation time: %f\n",((double)(clock()-t1)) / CLOCKS_PER_SEC);
 	}
 	else
 	{
-		featuresPyramid.normGradX = NULL;
-        featuresPyramid.normGradY = NULL;
-        featuresPyramid.nLevels = -1;
+		pyramids.featuresPyramid.normGradX = NULL;
+		pyramids.featuresPyramid.normGradY = NULL;
+		pyramids.featuresPyramid.nLevels = -1;
+	}
+	if (library != NULL)
+		stack_library_pyramids(&pyramids, imgInput->patchSizeY);
+	return(pyramids);
+}
+
+static void delete_inpainting_pyramids(inpaintingPyramids pyramids)
+{
+	for (int i=0; i< (pyramids.nLevels); i++)
+	{
+		delete pyramids.imgPyramid[i];
+		delete pyramids.occPyramid[i];
+		if (pyramids.exclusionPyramid != NULL)
+			delete pyramids.exclusionPyramid[i];
+	}
+	delete pyramids.imgPyramid;
+	delete pyramids.occPyramid;
+	free(pyramids.exclusionPyramid);
+	delete_feature_pyramid(pyramids.featuresPyramid);
+}
+
+//copy of a pyramid level, which carries the patch size of the current inpainting (the pyramids are shared by the
+//inpaintings with several patch sizes)
+static nTupleImage* acquire_pyramid_level(nTupleImagePool *imagePool, nTupleImage *imgLevel,
+	patchMatchParameterStruct *patchMatchParams)
+{
+	nTupleImage *imgOut = imagePool->acquire_copy(imgLevel);
+	imgOut->set_patch_size(patchMatchParams->patchSizeX, patchMatchParams->patchSizeY);
+	return(imgOut);
+}
+
+//set a mask to 0 at the active pixels
+static void reset_active_pixels(nTupleImage *maskIn, const activePixelList *activePixels)
+{
+	for (int j=0; j<(maskIn->ySize); j++)
+		for (int n=get_row_start(activePixels,j); n<get_row_end(activePixels,j,maskIn->xSize); n++)
+			maskIn->set_value_fast(get_active_pixel_x(activePixels,n),j,0,0);
+}
+
+//occluded pixels of reconstructedPixels whose mean absolute change, from their previous values (given by
+//get_occluded_values), is above freezeThreshold. They are set to 1 in unconvergedMask, the other pixels are frozen
+static activePixelList* get_unconverged_pixels(nTupleImage *imgIn, const std::vector<imageDataType> &previousValues,
+	nTupleImage *occIn, const activePixelList *reconstructedPixels, float freezeThreshold, nTupleImage *unconvergedMask)
+{
+	activePixelList *unconvergedPixels = new activePixelList;
+	unconvergedPixels->rowOffsets.resize(imgIn->ySize+1);
+	size_t valueInd = 0;
+	for (int y=0; y<(imgIn->ySize); y++)
+	{
+		unconvergedPixels->rowOffsets[y] = (int)unconvergedPixels->pixels.size();
+		for (int n=get_row_start(reconstructedPixels,y); n<get_row_end(reconstructedPixels,y,imgIn->xSize); n++)
+		{
+			int x = get_active_pixel_x(reconstructedPixels,n);
+			if (occIn->get_value_fast(x,y,0) <= 0)
+				continue;
+			float change = 0;
+			for (int c=0; c<(imgIn->nTupleSize); c++)
+			{
+				change = change + (float)fabs( (float)(imgIn->get_value_fast(x,y,c)) - (float)(previousValues[valueInd]));
+				valueInd++;
+			}
+			if (change > freezeThreshold*(imgIn->nTupleSize))
+			{
+				coord pixelTemp;
+				pixelTemp.x = x;
+				pixelTemp.y = y;
+				unconvergedPixels->pixels.push_back(pixelTemp);
+				unconvergedMask->set_value_fast(x,y,0,1);
+			}
+		}
 	}
+	unconvergedPixels->rowOffsets[imgIn->ySize] = (int)unconvergedPixels->pixels.size();
+	return(unconvergedPixels);
+}
+
+//multi-scale inpainting on the pyramids, with the patch size of patchMatchParams (which is modified, but not deleted)
+static nTupleImage* inpaint_image_pyramids(const inpaintingPyramids &pyramids,
+	patchMatchParameterStruct *patchMatchParams, inpaintingParameterStruct *inpaintingParams)
+{
+	nTupleImagePyramid imgPyramid = pyramids.imgPyramid;
+	nTupleImagePyramid occPyramid = pyramids.occPyramid;
+	nTupleImagePyramid exclusionPyramid = pyramids.exclusionPyramid;
+	featurePyramid featuresPyramid = pyramids.featuresPyramid;
+	
+	nTupleImage *imgOut;
+	//the temporary images of the pyramid levels and iterations are taken from this pool
+	nTupleImagePool imagePool;
 
 	//create structuring element
-	nTupleImage *structElDilate = create_structuring_element("rectangle", imgInput->patchSizeX, imgInput->patchSizeY);
+	nTupleImage *structElDilate = create_structuring_element("rectangle", patchMatchParams->patchSizeX, patchMatchParams->patchSizeY);
 	
 	//show_patch_match_parameters(patchMatchParams);
 	
@@ -232,26 +564,41 @@ patchMatchParameterStruct *patchMatchParams, inpaintingParameterStruct *inpainti
 	// ************* START INPAINTING *********** //
 	// ****************************************** //
 
-	nTupleImage *imgInpaint,*normGradX,*normGradY;
+	nTupleImage *imgInpaint,*normGradX=NULL,*normGradY=NULL;
 	nTupleImage *shiftMap=NULL;
+	//dilated occlusion and active pixels of the next level (needed to upsample the shift map)
+	nTupleImage *occDilateNext = NULL;
+	activePixelList *activePixelsNext = NULL;
 	for (int level=( (inpaintingParams->nLevels)-1); level>=0; level--)
 	{
 		printf("Current pyramid level : %d\n",level);
-		nTupleImage *imgPrevious,*occInpaint,*occDilate;
+		nTupleImage *occInpaint,*occDilate;
+		activePixelList *activePixels;
 
 		if (patchMatchParams->maxShiftDistance != -1)		
 			patchMatchParams->maxShiftDistance =
 			(float)( (patchMatchParams->maxShiftDistance)/( pow((float)SUBSAMPLE_FACTOR,(float)level) ));
 		
-		imgInpaint = copy_image_nTuple(imgPyramid[level]);
-		occInpaint = copy_image_nTuple(occPyramid[level]);
-		//create dilated occlusion
-		occDilate = imdilate(occInpaint, structElDilate);
+		imgInpaint = acquire_pyramid_level(&imagePool, imgPyramid[level], patchMatchParams);
+		occInpaint = acquire_pyramid_level(&imagePool, occPyramid[level], patchMatchParams);
+		//create dilated occlusion : the EM iterations only process the pixels of this band
+		if (occDilateNext == NULL)
+		{
+			occDilateNext = imdilate(occInpaint, structElDilate, &imagePool);
+			activePixelsNext = create_active_pixel_list(occDilateNext);
+		}
+		occDilate = occDilateNext;
+		activePixels = activePixelsNext;
+		occDilateNext = NULL;
+		activePixelsNext = NULL;
+		if (patchMatchParams->verboseMode == true)
+			printf("Active pixels : %d (%.1f%% of the image)\n",(int)activePixels->pixels.size(),
+				100.0*(float)activePixels->pixels.size()/((float)(imgInpaint->xSize)*(imgInpaint->ySize)));
 		
 		if (featuresPyramid.nLevels >= 0)
 		{
-			normGradX = copy_image_nTuple((featuresPyramid.normGradX)[level]);
-			normGradY = copy_image_nTuple((featuresPyramid.normGradY)[level]);
+			normGradX = acquire_pyramid_level(&imagePool, (featuresPyramid.normGradX)[level], patchMatchParams);
+			normGradY = acquire_pyramid_level(&imagePool, (featuresPyramid.normGradY)[level], patchMatchParams);
 			//attach features to patchMatch parameters
 			patchMatchParams->normGradX = normGradX;
 			patchMatchParams->normGradY = normGradY;
@@ -260,96 +607,249 @@ patchMatchParameterStruct *patchMatchParams, inpaintingParameterStruct *inpainti
 		//initialise solution
 		if (level == ((inpaintingParams->nLevels)-1))
 		{
-			shiftMap = new nTupleImage(imgInpaint->xSize,imgInpaint->ySize,3,imgInpaint->patchSizeX,imgInpaint->patchSizeY,IMAGE_INDEXING);
+			shiftMap = new nTupleImage(imgInpaint->xSize,imgInpaint->ySize,3,imgInpaint->patchSizeX,imgInpaint->patchSizeY,imgInpaint->indexing);
 			shiftMap->set_all_image_values(0);
 			printf("\nInitialisation started\n\n\n");
-            initialise_inpainting(imgInpaint,occInpaint,featuresPyramid,shiftMap,patchMatchParams); imgInpaint = copy_image_nTuple(imgPyramid[level]);
+            initialise_inpainting(imgInpaint,occInpaint,featuresPyramid,shiftMap,patchMatchParams,&imagePool,
+            	(exclusionPyramid != NULL) ? exclusionPyramid[level] : NULL);
+            imagePool.release(imgInpaint);
+            imgInpaint = acquire_pyramid_level(&imagePool, imgPyramid[level], patchMatchParams);
 			patchMatchParams->partialComparison = 0;
 			printf("\nInitialisation finished\n\n\n");
 			
 			if (featuresPyramid.nLevels >= 0)	//retrieve features from the pointers in the patchMatch parameters
 			{
+				imagePool.release(normGradX);
+				imagePool.release(normGradY);
 				normGradX = patchMatchParams->normGradX;
 				normGradY = patchMatchParams->normGradY;
 			}
 		}
-		else	//reconstruct current solution
+		//pixels which can not be used as sources : the dilated occlusion, and the pixels whose patches
+		//contain excluded pixels
+		nTupleImage *occSource = occDilate;
+		if (exclusionPyramid != NULL)
+		{
+			nTupleImage *exclusionDilate = imdilate(exclusionPyramid[level], structElDilate, &imagePool);
+			occSource = add_excluded_pixels(occDilate, exclusionDilate, &imagePool);
+			imagePool.release(exclusionDilate);
+		}
+		patchMatchParams->activePixels = activePixels;
+		//the valid sources of the library rows are cached with the library
+		const validSourceIndex *librarySources = NULL;
+		if (pyramids.library != NULL)
+			librarySources = get_exemplar_library_sources(pyramids.library, level, patchMatchParams);
+		patchMatchParams->validSources = create_valid_source_index(imgInpaint, occSource, patchMatchParams,
+			librarySources);
+		
+		if (level != ((inpaintingParams->nLevels)-1))	//reconstruct current solution
 		{
 			if (featuresPyramid.nLevels >= 0)
 			{
 				reconstruct_image_and_features(imgInpaint, occInpaint,
 				normGradX, normGradY,
-				shiftMap, SIGMA_COLOUR);
+				shiftMap, SIGMA_COLOUR, inpaintingParams->reconstructionType, false, activePixels, patchMatchParams->nThreads);
 			}
 			else
 			{
-				reconstruct_image(imgInpaint,occInpaint,shiftMap,SIGMA_COLOUR);
+				reconstruct_image(imgInpaint,occInpaint,shiftMap,SIGMA_COLOUR,inpaintingParams->reconstructionType,false,activePixels,
+					patchMatchParams->nThreads);
 				//write_shift_map(shiftMap,fileOut);
 			}
 		}
 		
 		calclulate_patch_distances(imgInpaint,imgInpaint,shiftMap,occDilate,patchMatchParams);
 		
-		//iterate ANN search and reconstruction
+		//at the coarsest level, the nearest neighbours are searched exactly if it is cheap enough
+		int searchMode = patchMatchParams->fullSearch;
+		if ( (level == ((inpaintingParams->nLevels)-1)) && (searchMode == PATCH_MATCH_SEARCH) &&
+			(get_fft_search_cost(imgInpaint,patchMatchParams) <= FFT_SEARCH_MAX_COST) )
+		{
+			patchMatchParams->fullSearch = FFT_SEARCH;
+			if (patchMatchParams->verboseMode == true)
+				printf("Exact nearest neighbour search at this level\n");
+		}
+		
+		//iterate ANN search and reconstruction. After the first iteration, only the occluded pixels covered by a match
+		//which PatchMatch changed are reconstructed : the sources are not occluded, so the other pixels would get the
+		//same values, and their residual is zero. The scattered reconstruction uses a sigma common to all the patches,
+		//so all the pixels are reconstructed
+		bool trackChangedMatches = (inpaintingParams->reconstructionType != SCATTERED_PATCHES);
+		bool freezePixels = trackChangedMatches && (inpaintingParams->freezeThreshold > 0);
+		nTupleImage *changedMatches = NULL, *unconvergedMask = NULL;
+		activePixelList *unconvergedPixels = NULL;
+		if (trackChangedMatches)
+		{
+			changedMatches = imagePool.acquire(imgInpaint->xSize,imgInpaint->ySize,1,imgInpaint->patchSizeX,
+				imgInpaint->patchSizeY,imgInpaint->indexing);
+			changedMatches->set_all_image_values(0);
+		}
+		if (freezePixels)
+		{
+			unconvergedMask = imagePool.acquire(imgInpaint->xSize,imgInpaint->ySize,1,imgInpaint->patchSizeX,
+				imgInpaint->patchSizeY,imgInpaint->indexing);
+			unconvergedMask->set_all_image_values(0);
+		}
+		std::vector<imageDataType> previousValues;
+		get_occluded_values(imgInpaint,occInpaint,activePixels,previousValues);
+		int nOccludedValues = (int)previousValues.size();
 		int iterationNb = 0;
+		int nPasses = 0;
 		imageDataType residual = FLT_MAX;
+		patchMatchStats patchMatchStatistics;
 		while( (residual > (inpaintingParams->residualThreshold) ) && (iterationNb < (inpaintingParams->maxIterations) ) )
 		{
-			//copy current imgInpaint
-			imgPrevious = copy_image_nTuple(imgInpaint);
-			patch_match_ANN(imgInpaint,imgInpaint,shiftMap,occDilate,occDilate,patchMatchParams);
+			//once pixels are frozen, only the patches which contain an unconverged pixel are searched
+			activePixelList *searchedPatches = activePixels;
+			if (unconvergedPixels != NULL)
+				searchedPatches = create_covered_pixel_list(unconvergedMask,NULL,activePixels,
+					imgInpaint->hPatchSizeX,imgInpaint->hPatchSizeY);
+			patchMatchParams->activePixels = searchedPatches;
+			patchMatchParams->changedMatches = changedMatches;
+			patch_match_ANN(imgInpaint,imgInpaint,shiftMap,occSource,occDilate,patchMatchParams,NULL,&patchMatchStatistics);
+			patchMatchParams->activePixels = activePixels;
+			patchMatchParams->changedMatches = NULL;
+			nPasses = nPasses + (int)patchMatchStatistics.passes.size();
+			if (searchedPatches != activePixels)
+				delete searchedPatches;
+			
+			//pixels to reconstruct (not frozen), and their current values
+			activePixelList *reconstructedPixels = activePixels;
+			if ( trackChangedMatches && (iterationNb > 0) )
+				reconstructedPixels = create_covered_pixel_list(changedMatches,occInpaint,
+					(unconvergedPixels != NULL) ? unconvergedPixels : activePixels,
+					imgInpaint->hPatchSizeX,imgInpaint->hPatchSizeY);
+			get_occluded_values(imgInpaint,occInpaint,reconstructedPixels,previousValues);
 			if (featuresPyramid.nLevels >= 0)
 			{
 				reconstruct_image_and_features(imgInpaint, occInpaint,
         			normGradX, normGradY,
-        			shiftMap, SIGMA_COLOUR);
+        			shiftMap, SIGMA_COLOUR, inpaintingParams->reconstructionType, false, reconstructedPixels,
+        			patchMatchParams->nThreads);
 			}
 			else
-				reconstruct_image(imgInpaint,occInpaint,shiftMap,SIGMA_COLOUR);
-			residual = calculate_residual(imgInpaint,imgPrevious,occInpaint);
+				reconstruct_image(imgInpaint,occInpaint,shiftMap,SIGMA_COLOUR,inpaintingParams->reconstructionType,false,
+					reconstructedPixels,patchMatchParams->nThreads);
+			residual = calculate_residual(imgInpaint,previousValues,occInpaint,reconstructedPixels,nOccludedValues);
 			if (patchMatchParams->verboseMode == true)
-				printf("Iteration number %d, residual = %f\n",iterationNb,residual);
+				printf("Iteration number %d, residual = %f, PatchMatch passes : %d, energy : %f, reconstructed values : %d/%d\n",
+					iterationNb,residual,(int)patchMatchStatistics.passes.size(),patchMatchStatistics.energy,
+					(int)previousValues.size(),nOccludedValues);
+			
+			if (freezePixels)
+			{
+				delete unconvergedPixels;
+				reset_active_pixels(unconvergedMask,activePixels);
+				unconvergedPixels = get_unconverged_pixels(imgInpaint,previousValues,occInpaint,reconstructedPixels,
+					inpaintingParams->freezeThreshold,unconvergedMask);
+			}
+			if (reconstructedPixels != activePixels)
+				delete reconstructedPixels;
+			if (changedMatches != NULL)
+				reset_active_pixels(changedMatches,activePixels);
 			iterationNb++;
 		}
+		delete unconvergedPixels;
+		if (changedMatches != NULL)
+			imagePool.release(changedMatches);
+		if (unconvergedMask != NULL)
+			imagePool.release(unconvergedMask);
+		patchMatchParams->fullSearch = searchMode;
+		if (patchMatchParams->verboseMode == true)
+			printf("PatchMatch passes at this level : %d (maximum %d)\n",nPasses,iterationNb*(patchMatchParams->nIters));
+		
 		//upsample shift volume, if we are not on the finest level
 		if (level >0)
 		{	
-			nTupleImage * shiftMapTemp = up_sample_image(shiftMap, SUBSAMPLE_FACTOR,imgPyramid[level-1]);
+			nTupleImage *occFine = acquire_pyramid_level(&imagePool, occPyramid[level-1], patchMatchParams);
+			occDilateNext = imdilate(occFine, structElDilate, &imagePool);
+			activePixelsNext = create_active_pixel_list(occDilateNext);
+			imagePool.release(occFine);
+			
+			nTupleImage * shiftMapTemp = up_sample_shift_map(shiftMap, SUBSAMPLE_FACTOR,imgPyramid[level-1],activePixelsNext);
 			delete shiftMap;
-			shiftMap = copy_image_nTuple(shiftMapTemp);
-			shiftMap->multiply((imageDataType)SUBSAMPLE_FACTOR);
-			delete shiftMapTemp;
+			shiftMap = shiftMapTemp;
 		}
 		else
 		{
-			reconstruct_image(imgInpaint,occInpaint,shiftMap,SIGMA_COLOUR,3);
-			imgOut = new nTupleImage(imgInpaint);
+			reconstruct_image(imgInpaint,occInpaint,shiftMap,SIGMA_COLOUR,BEST_PATCH,false,activePixels,
+				patchMatchParams->nThreads);
+			imgOut = copy_image_nTuple(imgInpaint,ROW_FIRST);
 		}
-		//destroy structures
-		delete imgInpaint;
-		delete imgPrevious;
-		delete occInpaint;
-		delete occDilate;
+		//give the structures back to the pool
+		imagePool.release(imgInpaint);
+		imagePool.release(occInpaint);
+		imagePool.release(occDilate);
+		if (occSource != occDilate)
+			imagePool.release(occSource);
+		patchMatchParams->activePixels = NULL;
+		delete activePixels;
+		delete patchMatchParams->validSources;
+		patchMatchParams->validSources = NULL;
 		if (featuresPyramid.nLevels >= 0)
 		{
-			delete normGradX;
-			delete normGradY;
+			imagePool.release(normGradX);
+			imagePool.release(normGradY);
 		}
 	}
 	
+	delete structElDilate;
+	delete shiftMap;
+	
+	imagePool.display_statistics();
+	return(imgOut);
+}
+
+nTupleImage * inpaint_image( nTupleImage *imgInputIn, nTupleImage *occInputIn,
+patchMatchParameterStruct *patchMatchParams, inpaintingParameterStruct *inpaintingParams, exemplarLibrary *library)
+{
+	//convert the inputs to the internal memory layout (the output is converted back to row first)
+	nTupleImage *imgInput = copy_image_nTuple(imgInputIn, INPAINTING_INDEXING);
+	nTupleImage *occInput = copy_image_nTuple(occInputIn, INPAINTING_INDEXING);
+	
+	//the TV inpainting of the occlusion initialises the coarsest level (in case of error, the occlusion keeps the
+	//values of the input)
+	if (inpaintingParams->tvLambda > 0)
+		tv_inpaint_image(imgInput, occInput, inpaintingParams->tvLambda, inpaintingParams->tvMaxIterations,
+			patchMatchParams->verboseMode);
+	
+	// ******************************************************************** //
+	// **** AUTOMATICALLY DETERMINE NUMBER OF LEVELS, IF NOT SPECIFIED **** //
+	// ******************************************************************** //
+
+
+	if (inpaintingParams->nLevels == -1)
+	{
+		inpaintingParams->nLevels =
+			determine_multiscale_level_number(occInput,imgInput->patchSizeX,imgInput->patchSizeY);
+	}
+
+	display_inpainting_parameters(inpaintingParams);
+	display_patch_match_parameters(patchMatchParams);
+
 	// ************************** //
-	// **** DELETE STRUCTURES *** //
+	// **** CREATE PYRDAMIDS **** //
 	// ************************** //
-	for (int i=0; i< (inpaintingParams->nLevels); i++)
+	inpaintingPyramids pyramids = create_inpainting_pyramids(imgInput, occInput, library,
+		inpaintingParams->nLevels, inpaintingParams->useFeatures);
+	if (library != NULL)
+		patchMatchParams->w = max_int(patchMatchParams->w,
+			max_int(pyramids.imgPyramid[0]->xSize,pyramids.imgPyramid[0]->ySize));
+	
+	nTupleImage *imgOut = inpaint_image_pyramids(pyramids, patchMatchParams, inpaintingParams);
+	if (library != NULL)
 	{
-		delete imgPyramid[i];
-		delete occPyramid[i];
+		nTupleImage *imgCrop = unstack_exemplar_library(imgOut, imgInput->xSize, imgInput->ySize);
+		delete imgOut;
+		imgOut = imgCrop;
 	}
-	delete imgPyramid;
-	delete occPyramid;
-
-	delete shiftMap;
-	delete_feature_pyramid(featuresPyramid);
+	
+	// ************************** //
+	// **** DELETE STRUCTURES *** //
+	// ************************** //
+	delete_inpainting_pyramids(pyramids);
+	delete imgInput;
+	delete occInput;
 	delete patchMatchParams;
 	
 	printf("Inpainting finished !\n");
@@ -357,30 +857,100 @@ patchMatchParameterStruct *patchMatchParams, inpaintingParameterStruct *inpainti
 	return(imgOut);
 }
 
+std::vector<nTupleImage*> inpaint_image_patch_sizes(nTupleImage *imgInputIn, nTupleImage *occInputIn,
+	patchMatchParameterStruct *patchMatchParams, inpaintingParameterStruct *inpaintingParams,
+	const std::vector<int> &patchSizes)
+{
+	int nSizes = (int)patchSizes.size();
+	nTupleImage *imgInput = copy_image_nTuple(imgInputIn, INPAINTING_INDEXING);
+	nTupleImage *occInput = copy_image_nTuple(occInputIn, INPAINTING_INDEXING);
+	
+	if (inpaintingParams->tvLambda > 0)
+		tv_inpaint_image(imgInput, occInput, inpaintingParams->tvLambda, inpaintingParams->tvMaxIterations,
+			patchMatchParams->verboseMode);
+	
+	//number of levels of each patch size (the occlusion is eroded once)
+	std::vector<int> nLevels(nSizes, inpaintingParams->nLevels);
+	if (inpaintingParams->nLevels == -1)
+	{
+		int nErosions = get_occlusion_erosion_number(occInput);
+		for (int n=0; n<nSizes; n++)
+			nLevels[n] = determine_multiscale_level_number(nErosions, patchSizes[n], patchSizes[n]);
+	}
+	
+	display_inpainting_parameters(inpaintingParams);
+	display_patch_match_parameters(patchMatchParams);
+	
+	//the patch sizes with the same number of levels share the same pyramids
+	std::map<int,inpaintingPyramids> pyramids;
+	for (int n=0; n<nSizes; n++)
+	{
+		printf("Patch size %d x %d : %d pyramid levels\n",patchSizes[n],patchSizes[n],nLevels[n]);
+		if (pyramids.count(nLevels[n]) == 0)
+			pyramids[nLevels[n]] = create_inpainting_pyramids(imgInput, occInput, NULL, nLevels[n],
+				inpaintingParams->useFeatures);
+	}
+	
+	//the threads are shared between the patch sizes, whose PatchMatch searches are nested parallel regions
+	int nThreadsSize = max_int(patchMatchParams->nThreads/nSizes, 1);
+#ifdef _OPENMP
+	if ( (nSizes > 1) && (nThreadsSize > 1) && (omp_get_max_active_levels() < 2) )
+		omp_set_max_active_levels(2);
+#endif
+	std::vector<nTupleImage*> imgOut(nSizes, (nTupleImage*)NULL);
+	//each inpainting run seeds the random numbers of its thread
+	#pragma omp parallel for schedule(dynamic,1) num_threads(min_int(nSizes,patchMatchParams->nThreads)) if(nSizes > 1)
+	for (int n=0; n<nSizes; n++)
+	{
+		patchMatchParameterStruct sizePatchMatchParams = *patchMatchParams;
+		sizePatchMatchParams.patchSizeX = patchSizes[n];
+		sizePatchMatchParams.patchSizeY = patchSizes[n];
+		if (nSizes > 1)
+			sizePatchMatchParams.nThreads = nThreadsSize;
+		inpaintingParameterStruct sizeInpaintingParams = *inpaintingParams;
+		sizeInpaintingParams.nLevels = nLevels[n];
+		imgOut[n] = inpaint_image_pyramids(pyramids.find(nLevels[n])->second, &sizePatchMatchParams,
+			&sizeInpaintingParams);
+	}
+	
+	for (std::map<int,inpaintingPyramids>::iterator it=pyramids.begin(); it!=pyramids.end(); it++)
+		delete_inpainting_pyramids(it->second);
+	delete imgInput;
+	delete occInput;
+	delete patchMatchParams;
+	
+	printf("Inpainting finished !\n");
+	
+	return(imgOut);
+}
+
 
 void initialise_inpainting(nTupleImage *imgIn, nTupleImage *occIn, featurePyramid featuresPyramid,
-				nTupleImage *shiftMap, patchMatchParameterStruct *patchMatchParams)
+				nTupleImage *shiftMap, patchMatchParameterStruct *patchMatchParams, nTupleImagePool *imagePool,
+				nTupleImage *exclusion)
 {
 	int iterNb=0;
 	patchMatchParams->partialComparison = 1;
 	bool initialisation = true;
 	nTupleImage *occIter;
-	occIter = copy_image_nTuple(occIn);
+	occIter = acquire_image_copy(imagePool,occIn);
 	
 	seed_random_numbers((double)3);
 	
 	nTupleImage *structElErode = create_structuring_element("rectangle", 3, 3);
 	nTupleImage *structElDilate = create_structuring_element("rectangle", imgIn->patchSizeX, imgIn->patchSizeY);
 	
-	nTupleImage *occDilate = imdilate(occIn, structElDilate);
+	nTupleImage *occDilate = imdilate(occIn, structElDilate, imagePool);
+	//the patches which contain excluded pixels can not be pointed to
+	nTupleImage *exclusionDilate = (exclusion != NULL) ? imdilate(exclusion, structElDilate, imagePool) : NULL;
 	
 	//extract features images from featuresPyramid (coarsest level)
 	nTupleImage *normGradX,*normGradY;
 	
 	if (featuresPyramid.nLevels >= 0)
 	{
-		normGradX = copy_image_nTuple((featuresPyramid.normGradX)[featuresPyramid.nLevels-1]);
-		normGradY = copy_image_nTuple((featuresPyramid.normGradY)[featuresPyramid.nLevels-1]);
+		normGradX = acquire_image_copy(imagePool,(featuresPyramid.normGradX)[featuresPyramid.nLevels-1]);
+		normGradY = acquire_image_copy(imagePool,(featuresPyramid.normGradY)[featuresPyramid.nLevels-1]);
 		//attach features to patchMatch parameters
 		patchMatchParams->normGradX = normGradX;
 		patchMatchParams->normGradY = normGradY;
@@ -388,8 +958,8 @@ void initialise_inpainting(nTupleImage *imgIn, nTupleImage *occIn, featurePyrami
 	
 	while ( (occIter->sum_nTupleImage()) >0)
 	{
-		nTupleImage *occErode = imerode(occIter, structElErode);
-		nTupleImage *occPatchMatch = copy_image_nTuple(occDilate);
+		nTupleImage *occErode = imerode(occIter, structElErode, imagePool);
+		nTupleImage *occPatchMatch = acquire_image_copy(imagePool,occDilate);
 		
 		/***************************/
 		/*******   NNSEARCH   ******/
@@ -401,16 +971,28 @@ void initialise_inpainting(nTupleImage *imgIn, nTupleImage *occIn, featurePyrami
 			{
 				if ( (occDilate->get_value(x,y,0) - occIter->get_value(x,y,0)) == 1)
 					occPatchMatch->set_value(x,y,0,(imageDataType)2);
+				//the excluded pixels are not compared either
+				if (exclusion == NULL)
+					continue;
+				if (exclusion->get_value(x,y,0) > 0)
+					occPatchMatch->set_value(x,y,0,(imageDataType)1);
+				else if ( (exclusionDilate->get_value(x,y,0) > 0) && (occPatchMatch->get_value(x,y,0) == 0) )
+					occPatchMatch->set_value(x,y,0,(imageDataType)2);
 			}
 			
+		//count the pixels available for the partial patch comparisons of this layer in O(1)
+		patchMatchParams->unOccludedIntegral = create_unoccluded_integral_image(occPatchMatch);
 		//set first guess
-		nTupleImage *firstGuess = copy_image_nTuple(imgIn);
+		nTupleImage *firstGuess = acquire_image_copy(imagePool,imgIn);
 		//carry out patchMatch
 		patch_match_ANN(imgIn,imgIn,shiftMap,occPatchMatch,occDilate,patchMatchParams,firstGuess);
+		release_image(imagePool,firstGuess);
+		delete patchMatchParams->unOccludedIntegral;
+		patchMatchParams->unOccludedIntegral = NULL;
 		/***************************/
 		/****   RECONSTRUCTION   ***/
 		/***************************/
-		nTupleImage *occReconstruct = copy_image_nTuple(occIter);
+		nTupleImage *occReconstruct = acquire_image_copy(imagePool,occIter);
 		//Indicate which pixels are on the current border, and need to be inpainted
 		//Also, we indicate that the pixels inside the occlusion (and not on the border) are occluded (and
 		//therefore not to be used for reconstruction) but should not
@@ -429,22 +1011,28 @@ void initialise_inpainting(nTupleImage *imgIn, nTupleImage *occIn, featurePyrami
 		if (featuresPyramid.nLevels >= 0)
 			reconstruct_image_and_features(imgIn, occReconstruct,
 		    	normGradX, normGradY,
-		    	shiftMap, SIGMA_COLOUR, AGGREGATED_PATCHES,initialisation);
+		    	shiftMap, SIGMA_COLOUR, AGGREGATED_PATCHES,initialisation, NULL, patchMatchParams->nThreads);
 		else
 		{
-			reconstruct_image(imgIn, occReconstruct, shiftMap, SIGMA_COLOUR, AGGREGATED_PATCHES, initialisation);
+			reconstruct_image(imgIn, occReconstruct, shiftMap, SIGMA_COLOUR, AGGREGATED_PATCHES, initialisation, NULL,
+				patchMatchParams->nThreads);
 		}
 		
 		iterNb++;
 		if (patchMatchParams->verboseMode == true)
 			printf("\n Initialisation iteration number : %d \n",iterNb);
-		delete occPatchMatch;
-		delete occReconstruct;
+		release_image(imagePool,occPatchMatch);
+		release_image(imagePool,occReconstruct);
 		
-		//copy the information from the eroded occlusion to the current occlusion (occVolIter)
-		delete occIter;
-		occIter = copy_image_nTuple(occErode);
-		delete occErode;
+		//the eroded occlusion becomes the current occlusion (occVolIter)
+		release_image(imagePool,occIter);
+		occIter = occErode;
 	}
+	release_image(imagePool,occIter);
+	release_image(imagePool,occDilate);
+	if (exclusionDilate != NULL)
+		release_image(imagePool,exclusionDilate);
+	delete structElErode;
+	delete structElDilate;
 }
 
@@ -4,6 +4,7 @@
 #define IMAGE_INPAINTING_H
 
 #include <stdlib.h>
+#include <vector>
 
 #include "io_png.h"
 #include "image_structures.h"
@@ -12,9 +13,21 @@
 #include "reconstruct_image_and_features.h"
 #include "image_operations.h"
 #include "morpho.h"
+#include "exemplar_library.h"
+#include "tv_inpainting.h"
 
 #ifndef SUBSAMPLE_FACTOR
 #define SUBSAMPLE_FACTOR 2
+#endif
+
+//default threshold of the frozen pixels, in grey levels : the residual threshold of the pyramid levels
+#ifndef FREEZE_THRESHOLD
+#define FREEZE_THRESHOLD 0.1
+#endif
+
+//memory layout of the images used internally by the inpainting (PatchMatch and reconstruction)
+#ifndef INPAINTING_INDEXING
+#define INPAINTING_INDEXING PIXEL_INTERLEAVED
 #endif
 
     typedef struct paramInpaint
@@ -23,25 +36,69 @@
 		int maxIterations;	/*!< Maximum number of iterations allowed, in case sufficient convergence is not reached*/
 		int nLevels; /*!< Number of multi-scale pyramid levels*/
 		bool useFeatures; /*!< Boolean parameter to determine whether to use texture attributes in the patch metric*/
+		bool connectedComponents; /*!< Boolean parameter to determine whether the connected components of the occlusion are inpainted separately*/
+		float tvLambda; /*!< Fidelity weight of the TV inpainting which initialises the occlusion (no TV inpainting if it is not positive)*/
+		int tvMaxIterations; /*!< Maximum number of split Bregman iterations of the TV inpainting*/
+		int reconstructionType; /*!< Reconstruction of the iterations : AGGREGATED_PATCHES (gathered for each pixel) or SCATTERED_PATCHES*/
+		float freezeThreshold; /*!< Pixels whose mean absolute change in an iteration is below this value are frozen (not positive : no pixel is frozen)*/
 	}inpaintingParameterStruct;
 
+    //options of inpaint_image_wrapper : the negative values keep the defaults of the parameter structures
+    typedef struct optionsInpaint
+	{
+		int patchSizeX; /*!< Patch size in the x direction*/
+		int patchSizeY; /*!< Patch size in the y direction*/
+		std::vector<int> patchSizes; /*!< Square patch sizes inpainted concurrently, one output per size (empty : patchSizeX x patchSizeY only)*/
+		int nLevels; /*!< Number of multi-scale pyramid levels (-1 : determined automatically)*/
+		bool useFeatures; /*!< Boolean parameter to determine whether to use texture attributes in the patch metric*/
+		bool verboseMode; /*!< Boolean parameter to display the progress of the inpainting*/
+		int nThreads; /*!< Number of threads of PatchMatch and of the reconstruction*/
+		float convergenceThreshold; /*!< PatchMatch stops when the fraction of matches improved by a pass is below this value*/
+		int searchMode; /*!< Nearest neighbour search : 0 PatchMatch, 1 brute force, 2 exact with FFTs, 3 kd-tree*/
+		int quantisedMatching; /*!< Compare the patches on 8-bit copies of the images (0 or 1)*/
+		int nIters; /*!< Maximum number of PatchMatch propagation/random search passes*/
+		int sequentialScan; /*!< Each PatchMatch pass is a single raster scan of the image, as the original algorithm (0 or 1)*/
+		const char *exemplarLibraryFile; /*!< Exemplar library whose undamaged pixels are extra sources (NULL : none)*/
+		float memoryBudget; /*!< Memory budget in megabytes of the streaming inpainting (not positive : the images are read in memory)*/
+		int connectedComponents; /*!< Inpaint the connected components of the occlusion separately (0 or 1)*/
+		bool useRegionOfInterest; /*!< Boolean parameter to determine whether only regionOfInterest is read and inpainted*/
+		int regionOfInterest[4]; /*!< Region x0,y0,xSize,ySize of the image*/
+		float tvLambda; /*!< Fidelity weight of the TV inpainting which initialises the occlusion*/
+		int tvMaxIterations; /*!< Maximum number of split Bregman iterations of the TV inpainting*/
+		int scatterReconstruction; /*!< Reconstruct by scattering the weighted patches (0 or 1)*/
+		float freezeThreshold; /*!< Threshold of the frozen pixels, see inpaintingParameterStruct*/
+	}inpaintingOptionStruct;
+
 patchMatchParameterStruct* initialise_patch_match_parameters(int patchSizeX, int patchSizeY, int imgSizeX, int imgSizeY, bool verboseMode=false);
 inpaintingParameterStruct* initialise_inpainting_parameters(int nLevels, bool useFeatures, float residualThreshold, int maxIterations);
+//options with the default values (-1, NULL or false), except the patch size and the features
+inpaintingOptionStruct* initialise_inpainting_options(int patchSizeX, int patchSizeY, bool useFeatures=true);
 
 void display_inpainting_parameters(inpaintingParameterStruct *inpaintingParams);
 void display_patch_match_parameters(patchMatchParameterStruct *patchMatchParams);
 
 void initialise_inpainting(nTupleImage *imgIn, nTupleImage *occIn, featurePyramid featuresImgPyramid,
-					nTupleImage *shiftMap, patchMatchParameterStruct *patchMatchParams);
+					nTupleImage *shiftMap, patchMatchParameterStruct *patchMatchParams, nTupleImagePool *imagePool = NULL,
+					nTupleImage *exclusion = NULL);
 
-void inpaint_image_wrapper(const char *fileIn,const char *fileOccIn, const char *fileOut,
-			int patchSizeX, int patchSizeY, int nLevels=-1, bool useFeatures=false, bool verboseMode=false);
+//returns -1 in case of error
+int inpaint_image_wrapper(const char *fileIn,const char *fileOccIn, const char *fileOut, const inpaintingOptionStruct *options);
 float *inpaint_image_wrapper(float *inputImage, int nx, int ny, int nc,
 	float *inputOcc, int nOccx, int nOccy, int nOccc,
 	int patchSizeX, int patchSizeY, int nLevels=-1, bool useFeatures=false, bool verboseMode=false);
 						
+//the valid pixels of the exemplar library (if it is not NULL) are extra sources : each pyramid level of the image
+//is stacked above the cached level of the library
 nTupleImage * inpaint_image( nTupleImage *imgIn, nTupleImage *occIn,
-patchMatchParameterStruct *patchMatchParams, inpaintingParameterStruct *inpaintingParameters);
+patchMatchParameterStruct *patchMatchParams, inpaintingParameterStruct *inpaintingParameters,
+exemplarLibrary *library = NULL);
+
+//inpaint the image with each of the (square) patch sizes : the TV inpainting, the pyramids and the features are
+//computed once (once per number of levels, if it is determined automatically), and the patch sizes are inpainted
+//concurrently. Each output is the output of inpaint_image with this patch size. Deletes patchMatchParams
+std::vector<nTupleImage*> inpaint_image_patch_sizes(nTupleImage *imgIn, nTupleImage *occIn,
+	patchMatchParameterStruct *patchMatchParams, inpaintingParameterStruct *inpaintingParameters,
+	const std::vector<int> &patchSizes);
 
 
 #endif
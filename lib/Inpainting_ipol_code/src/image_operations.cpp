@@ -20,7 +20,7 @@
 
 void seed_random_numbers( double inputSeed)
 {
- 	srand ( (unsigned int)inputSeed );   //create random number seed
+ 	set_random_seed( (uint64_t)inputSeed );   //seed of the (counter-based) random numbers of PatchMatch
 }
 
 std::string remove_extension_from_file(const char* fileIn)
@@ -38,11 +38,26 @@ std::string remove_extension_from_file(const char* fileIn)
 
 }
 
+//the PNG images are written from contiguous, row first (planar) buffers : returns the image itself
+//if it is already stored like this, or a row first copy otherwise (to be deleted by the caller)
+nTupleImage * get_planar_image(nTupleImage *imgIn)
+{
+	if ( (imgIn->indexing == ROW_FIRST) && (imgIn->nElsBuffer == (imgIn->nElsTotal)*(imgIn->nTupleSize)) )
+		return(imgIn);
+	else
+		return(copy_image_nTuple(imgIn,ROW_FIRST));
+}
+
 float * read_image(const char *fileIn, size_t *nx, size_t *ny, size_t *nc)
 {
 
 	float * pixel_stream = NULL;
-	pixel_stream = read_png_f32(fileIn,nx,ny,nc);
+	if (is_tiff_file(fileIn))
+		pixel_stream = read_tiff_f32(fileIn,nx,ny,nc);
+	else if (is_raw_float_file(fileIn))
+		pixel_stream = map_raw_float_f32(fileIn,nx,ny,nc);
+	else
+		pixel_stream = read_png_f32(fileIn,nx,ny,nc);
 
 	if (pixel_stream == NULL)
 	{
@@ -57,6 +72,108 @@ float * read_image(const char *fileIn, size_t *nx, size_t *ny, size_t *nc)
 	return(pixel_stream);
 }
 
+float * read_image_region(const char *fileIn, size_t x0, size_t y0, size_t xSize, size_t ySize, size_t *nc)
+{
+	float * pixel_stream = NULL;
+	if (is_tiff_file(fileIn))
+		pixel_stream = read_tiff_region_f32(fileIn,x0,y0,xSize,ySize,nc);
+	else
+	{
+		//only the pages of the region are read from a raw float image
+		size_t nx,ny;
+		float *image = is_raw_float_file(fileIn) ? map_raw_float_f32(fileIn,&nx,&ny,nc) : read_png_f32(fileIn,&nx,&ny,nc);
+		if ( (image != NULL) && (x0+xSize <= nx) && (y0+ySize <= ny) )
+		{
+			pixel_stream = (float*)malloc(xSize*ySize*(*nc)*sizeof(float));
+			for (size_t c=0; c<(*nc); c++)
+				for (size_t y=0; y<ySize; y++)
+					memcpy(pixel_stream + c*xSize*ySize + y*xSize, image + c*nx*ny + (y0+y)*nx + x0, xSize*sizeof(float));
+		}
+		free_image(image);
+	}
+
+	if (pixel_stream == NULL)
+	{
+		printf("Unable to get the region of the image\n");
+		return(NULL);
+	}
+	
+	printf("Region : (%d,%d), xSize : %d, ySize : %d\n",(int)x0,(int)y0,(int)xSize,(int)ySize);
+	printf("nChannels : %d\n",(int)*nc);
+	
+	return(pixel_stream);
+}
+
+int read_image_size(const char *fileIn, size_t *nx, size_t *ny, size_t *nc, int *bitDepth)
+{
+	int bitDepthFile;
+	if (is_tiff_file(fileIn))
+	{
+		tiffImage *tiff = open_tiff_image(fileIn,nx,ny,nc,&bitDepthFile);
+		if (tiff == NULL)
+			return(-1);
+		close_tiff_image(tiff);
+		if (bitDepth != NULL)
+			*bitDepth = bitDepthFile;
+		return(0);
+	}
+	if (is_raw_float_file(fileIn))
+	{
+		//the pages of the values are not read
+		float *values = map_raw_float_f32(fileIn,nx,ny,nc);
+		if (values == NULL)
+			return(-1);
+		unmap_raw_float_f32(values);
+		if (bitDepth != NULL)
+			*bitDepth = 32;
+		return(0);
+	}
+	
+	//PNG : the IHDR chunk follows the 8 bytes of the signature
+	unsigned char header[26];
+	FILE *file = fopen(fileIn,"rb");
+	if ( (file == NULL) || (fread(header,1,26,file) != 26) || (memcmp(header+12,"IHDR",4) != 0) )
+	{
+		printf("Error in read_image_size, unable to read the PNG header of %s.\n",fileIn);
+		if (file != NULL)
+			fclose(file);
+		return(-1);
+	}
+	fclose(file);
+	*nx = ((size_t)header[16] << 24) | ((size_t)header[17] << 16) | ((size_t)header[18] << 8) | (size_t)header[19];
+	*ny = ((size_t)header[20] << 24) | ((size_t)header[21] << 16) | ((size_t)header[22] << 8) | (size_t)header[23];
+	//channels of the colour type (the palettes are expanded to RGB)
+	switch (header[25])
+	{
+		case 0 : *nc = 1; break;
+		case 4 : *nc = 2; break;
+		case 6 : *nc = 4; break;
+		default : *nc = 3; break;
+	}
+	//the palettes and the grey levels of less than 8 bits are read as 8 bits
+	bitDepthFile = (int)header[24];
+	if (bitDepth != NULL)
+		*bitDepth = (bitDepthFile == 16) ? 16 : 8;
+	return(0);
+}
+
+void free_image(float *values)
+{
+	if ( (values != NULL) && (unmap_raw_float_f32(values) == -1) )
+		free(values);
+}
+
+//PNG, TIFF or raw float file, from a row first (planar) buffer. The TIFF files are written with 8 or 16 bits
+static int write_planar_image(const char *fileName, const float *data, size_t nx, size_t ny, size_t nc, int bitDepth)
+{
+	if (is_tiff_file(fileName))
+		return(write_tiff_f32(fileName, data, nx, ny, nc, (bitDepth == 8) ? 8 : 16));
+	else if (is_raw_float_file(fileName))
+		return(write_raw_float_f32(fileName, data, nx, ny, nc));
+	else
+		return(write_png_f32(fileName, data, nx, ny, nc));
+}
+
 nTupleImage *make_colour_wheel()
 {
 
@@ -124,7 +241,7 @@ nTupleImage *make_colour_wheel()
 
 }
 
-void write_image(nTupleImage *imgIn, const char *fileName, imageDataType normalisationScalar)
+void write_image(nTupleImage *imgIn, const char *fileName, imageDataType normalisationScalar, int bitDepth)
 {
 	int readWriteSuccess;
 
@@ -137,8 +254,8 @@ void write_image(nTupleImage *imgIn, const char *fileName, imageDataType normali
 		if (normalisationScalar>0)	//for better visulisation of results
 		{
 			nTupleImage* imgInCopy;
-			//make a copy of the input image, so as not to modify the input
-			imgInCopy = copy_image_nTuple(imgIn);
+			//make a (row first) copy of the input image, so as not to modify the input
+			imgInCopy = copy_image_nTuple(imgIn,ROW_FIRST);
 			//set minimum value to 0
 			imageDataType minValue = imgIn->min_value();
 			imgInCopy->add(-minValue);
@@ -148,8 +265,8 @@ void write_image(nTupleImage *imgIn, const char *fileName, imageDataType normali
 			//set maximum value to normalisationScalar
 			imgInCopy->multiply((imageDataType)normalisationScalar);
 			
-			readWriteSuccess = write_png_f32((char*)stringOut, imgInCopy->get_data_ptr(),
-			  imgInCopy->xSize, imgInCopy->ySize, imgInCopy->nTupleSize);
+			readWriteSuccess = write_planar_image(stringOut, imgInCopy->get_data_ptr(),
+			  imgInCopy->xSize, imgInCopy->ySize, imgInCopy->nTupleSize, bitDepth);
 			if (readWriteSuccess == -1)
 			{
 				printf("Unable to write the image\n");
@@ -160,8 +277,11 @@ void write_image(nTupleImage *imgIn, const char *fileName, imageDataType normali
 		}
 		else //no normalisation
 		{
-			readWriteSuccess = write_png_f32((char*)stringOut, imgIn->get_data_ptr(),
-			  imgIn->xSize, imgIn->ySize, imgIn->nTupleSize);
+			nTupleImage *imgPlanar = get_planar_image(imgIn);
+			readWriteSuccess = write_planar_image(stringOut, imgPlanar->get_data_ptr(),
+			  imgPlanar->xSize, imgPlanar->ySize, imgPlanar->nTupleSize, bitDepth);
+			if (imgPlanar != imgIn)
+				delete imgPlanar;
 			if (readWriteSuccess == -1)
 			{
 				printf("Unable to write the image\n");
@@ -255,7 +375,7 @@ void write_image_pyramid(nTupleImagePyramid imgInPyramid, int nLevels, char *fil
 	int readWriteSuccess;
 	for (int i=0; i<nLevels; i++)
 	{
-		nTupleImage * currImg = imgInPyramid[i];
+		nTupleImage * currImg = get_planar_image(imgInPyramid[i]);
 		
 		std::ostringstream os;
 		os << fileName << "_level_" << int_to_string(i) << ".png";
@@ -276,6 +396,8 @@ void write_image_pyramid(nTupleImagePyramid imgInPyramid, int nLevels, char *fil
 		
 	  	readWriteSuccess = write_png_f32((char*)stringOut, currImg->get_data_ptr(),
 		              currImg->xSize, currImg->ySize, currImg->nTupleSize);
+		if (currImg != imgInPyramid[i])
+			delete currImg;
 		if (readWriteSuccess == -1)
 		{
 			printf("Unable to write the image\n");
@@ -335,6 +457,31 @@ nTupleImage * up_sample_image(nTupleImage *imgIn, float upSampleFactor, nTupleIm
 	return(imgOut);
 }
 
+//nearest neighbour upsampling of a shift map, the shifts are multiplied by upSampleFactor. If activePixels is
+//not NULL, only the active pixels of the fine level are upsampled : the others get a zero shift. The patch
+//distances are set to FLT_MAX, they must be recalculated on the fine level
+nTupleImage * up_sample_shift_map(nTupleImage *shiftMap, float upSampleFactor, nTupleImage *imgFine,
+	activePixelList *activePixels)
+{
+	nTupleImage * shiftMapOut = new nTupleImage(imgFine->xSize,imgFine->ySize,shiftMap->nTupleSize,
+		shiftMap->patchSizeX,shiftMap->patchSizeY,shiftMap->indexing);
+	
+	for (int y=0; y<(shiftMapOut->ySize); y++)
+	{
+		for (int x=0; x<(shiftMapOut->xSize); x++)
+			shiftMapOut->set_value_fast(x,y,2,(imageDataType)FLT_MAX);
+		for (int n=get_row_start(activePixels,y); n<get_row_end(activePixels,y,shiftMapOut->xSize); n++)
+		{
+			int x = get_active_pixel_x(activePixels,n);
+			int xCoarse = (int)(floor((1/upSampleFactor)*x));
+			int yCoarse = (int)(floor((1/upSampleFactor)*y));
+			for (int c=0; c<2; c++)
+				shiftMapOut->set_value_fast(x,y,c,(imageDataType)(upSampleFactor*shiftMap->get_value(xCoarse,yCoarse,c)));
+		}
+	}
+	return(shiftMapOut);
+}
+
 nTupleImage * rgb_to_grey(nTupleImage * imgIn)
 {
 	nTupleImage *imgGreyOut = new nTupleImage(imgIn->xSize,imgIn->ySize,1,imgIn->patchSizeX,imgIn->patchSizeY,imgIn->indexing);
@@ -556,10 +703,12 @@ void delete_feature_pyramid(featurePyramid featurePyramidIn)
 
 int determine_multiscale_level_number(nTupleImage *occImgIn, int patchSizeX, int patchSizeY)
 {
+	return( determine_multiscale_level_number(get_occlusion_erosion_number(occImgIn), patchSizeX, patchSizeY) );
+}
 
-	int nLevels;
+int get_occlusion_erosion_number(nTupleImage *occImgIn)
+{
 	int maxOccDistance=0;
-	int maxPatchSize = (int) max_int(patchSizeX,patchSizeY);
 
 	nTupleImage *structElErode = create_structuring_element("rectangle", 3, 3);
 
@@ -574,8 +723,16 @@ int determine_multiscale_level_number(nTupleImage *occImgIn, int patchSizeX, int
 		delete occImgTemp;
 		maxOccDistance++;
 	}
-	
-	maxOccDistance = 2*maxOccDistance;
+	delete occImg;
+	delete structElErode;
+	return(maxOccDistance);
+}
+
+int determine_multiscale_level_number(int nErosions, int patchSizeX, int patchSizeY)
+{
+	int nLevels;
+	int maxPatchSize = (int) max_int(patchSizeX,patchSizeY);
+	int maxOccDistance = 2*nErosions;
 	nLevels = (int) floor( (float)
 				(
 				log( ((float) maxOccDistance) /((float)maxPatchSize) )
@@ -584,7 +741,6 @@ int determine_multiscale_level_number(nTupleImage *occImgIn, int patchSizeX, int
 					);
 	//the number of levels must be at least 1
 	nLevels = max_int(nLevels,1);
-	delete occImg;
 	return(nLevels);
 
 }
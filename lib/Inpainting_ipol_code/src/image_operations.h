@@ -9,6 +9,8 @@
 
 #include "image_structures.h"
 #include "io_png.h"
+#include "io_tiff.h"
+#include "io_raw_float.h"
 #include "convolution.h"
 #include "morpho.h"
 
@@ -19,13 +21,25 @@ void seed_random_numbers( double inputSeed=0.0);
 nTupleImage *make_colour_wheel();
 
 //reading and writing functions
+nTupleImage * get_planar_image(nTupleImage *imgIn);
+//PNG, TIFF (.tif, .tiff) or raw float (.rawf) images, the TIFF images are written with 8 or 16 bits. The raw float
+//images are memory mapped, without copy
 float * read_image(const char *fileIn, size_t *nx, size_t *ny, size_t *nc);
-void write_image(nTupleImage *imgIn, const char *fileName, imageDataType normalisationScalar=0);
+//region [x0,x0+xSize[ x [y0,y0+ySize[ of the image : only the strips or tiles of the region are decoded (TIFF)
+float * read_image_region(const char *fileIn, size_t x0, size_t y0, size_t xSize, size_t ySize, size_t *nc);
+//size of the image, and bits per sample if bitDepth is not NULL, without decoding it. Returns -1 on error
+int read_image_size(const char *fileIn, size_t *nx, size_t *ny, size_t *nc, int *bitDepth=NULL);
+//release the values returned by read_image or read_image_region
+void free_image(float *values);
+//bitDepth : bits per sample of the TIFF images (8 or 16)
+void write_image(nTupleImage *imgIn, const char *fileName, imageDataType normalisationScalar=0, int bitDepth=16);
 void write_image_pyramid(nTupleImagePyramid imgInPyramid, int nLevels, const char *fileName, imageDataType normalisationScalar=0);
 void write_shift_map(nTupleImage *shiftMap, const char *fileName);
 
 nTupleImage * sub_sample_image(nTupleImage *imgIn, float subSampleFactor);
 nTupleImage * up_sample_image(nTupleImage *imgIn, float upSampleFactor, nTupleImage *imgFine=NULL);
+nTupleImage * up_sample_shift_map(nTupleImage *shiftMap, float upSampleFactor, nTupleImage *imgFine,
+	activePixelList *activePixels=NULL);
 
 nTupleImage * rgb_to_grey(nTupleImage * imgIn);
 
@@ -39,5 +53,8 @@ featurePyramid create_feature_pyramid(nTupleImage * imgIn, nTupleImage * occVol,
 void delete_feature_pyramid(featurePyramid featurePyramidIn);
 
 int determine_multiscale_level_number(nTupleImage *occIn, int patchSizeX, int patchSizeY);
+//number of 3x3 erosions which remove the occlusion, and number of levels given this number
+int get_occlusion_erosion_number(nTupleImage *occIn);
+int determine_multiscale_level_number(int nErosions, int patchSizeX, int patchSizeY);
 
 #endif
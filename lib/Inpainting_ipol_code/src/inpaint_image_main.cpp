@@ -27,6 +27,7 @@
 #include <assert.h>
 
 #include "image_inpainting.h"
+#include "batch_inpainting.h"
 
 static void show_help();
 
@@ -40,11 +41,39 @@ static void show_help() {
               <<7<<")\n"
               << "    -patchSizeY : patch size in the y direction ("
               <<7<<")\n"
+              << "    -patchSizes : list of square patch sizes, for example 5,7,9, inpainted concurrently on the same pyramids, the outputs are imgNameOut_5x5.png ... (none)\n"
               << "    -nLevels : number of pyramid levels (by default, determined automatically by the algorithm)\n"
               << "    -useFeatures : whether to use features, 0 for false, 1 for true ("
               <<1<<")\n"
+              << "    -nThreads : number of threads used by PatchMatch and the reconstruction, the result does not depend on it (all available threads)\n"
+              << "    -convergenceThreshold : PatchMatch stops when the fraction of matches improved by a pass is below this value, for example 0.01 ("
+              <<0<<", all the passes are always carried out)\n"
+              << "    -searchMode : nearest neighbour search, 0 PatchMatch, 1 brute force, 2 exact with FFTs, 3 kd-tree of PCA descriptors ("
+              <<0<<")\n"
+              << "    -quantisedMatching : compare the patches on 8-bit copies of the images, 0 for false, 1 for true ("
+              <<0<<")\n"
+              << "    -exemplarLibrary : exemplar library file, whose undamaged pixels are used as extra sources (none)\n"
+              << "    -connectedComponents : inpaint the connected components of the occlusion separately and concurrently, 0 for false, 1 for true ("
+              <<0<<")\n"
+              << "    -roi : region x0,y0,xSize,ySize of the image which is read and inpainted, only its strips or tiles are decoded for TIFF files (whole image)\n"
+              << "    -memoryBudget : memory budget in megabytes, the PNG images (8 or 16 bits) are then streamed and inpainted in tiles (none, the images are read in memory)\n"
+              << "    -tvLambda : fidelity weight of the TV inpainting which initialises the occlusion, as tvinpaint (none, the occlusion is initialised with the values of the input)\n"
+              << "    -tvMaxIterations : maximum number of iterations of the TV inpainting ("
+              <<TV_MAX_ITERATIONS<<")\n"
+              << "    -nIters : maximum number of PatchMatch propagation/random search passes ("
+              <<12<<")\n"
+              << "    -sequential : each PatchMatch pass is a single raster scan of the image on one thread, as the original algorithm (reference), 0 for false, 1 for true ("
+              <<0<<")\n"
+              << "    -scatterReconstruction : reconstruct by scattering the weighted patches, with a sigma common to all the patches, 0 for false, 1 for true ("
+              <<0<<")\n"
+              << "    -freezeThreshold : the occluded pixels whose mean absolute change in an EM iteration is below this value are frozen, 0 for none ("
+              <<FREEZE_THRESHOLD<<")\n"
               << "    -v : verbose mode, 0 for false, 1 for true ("
               <<0<<")\n"
+              << "\nBuild an exemplar library from the undamaged pixels of several images :\n"
+              << "    inpaint_image -buildExemplarLibrary library.exl img1.png imgOcc1.png [img2.png imgOcc2.png ...]\n"
+              << "\nRun the jobs of a manifest (one job per line : imgIn.png imgOccIn.png imgNameOut.png [options]), largest first :\n"
+              << "    inpaint_image -batch manifest.txt [-nThreads n]\n"
               << std::endl;
 }
 
@@ -63,13 +92,14 @@ bool cmdOptionExists(char** begin, char** end, const std::string& option)
     return std::find(begin, end, option) != end;
 }
 
-/// main function of the inpainting code
-int main(int argc, char* argv[])
+/// inpainting of argv[1] with the occlusion argv[2], written to argv[3], with the options of the command line. If
+/// nThreadsJob > 0, it replaces the option -nThreads (jobs of a batch)
+static int inpaint_command(int argc, char* argv[], int nThreadsJob)
 {
 
 	time_t startTime,stopTime;
-		
-	if(argc < 3) {
+	
+	if(argc < 4) {
         show_help();
         return -1;
     }
@@ -82,6 +112,22 @@ int main(int argc, char* argv[])
 	const char * patchSizeX;
 	const char * patchSizeY;
 	const char * nLevels;
+	const char * nThreads;
+	const char * convergenceThreshold;
+	const char * searchMode;
+	const char * quantisedMatching;
+	const char * exemplarLibraryFile = NULL;
+	const char * memoryBudget;
+	const char * connectedComponents;
+	const char * tvLambda;
+	const char * tvMaxIterations;
+	const char * nIters;
+	const char * sequentialScan;
+	const char * scatterReconstruction;
+	const char * freezeThreshold;
+	int regionOfInterest[4] = {0,0,0,0};
+	bool useRegionOfInterest = false;
+	std::vector<int> patchSizes;
 	const char * useFeatures = (argc >= 8) ? argv[7] : "1";
 	const char * verboseMode = (argc >= 9) ? argv[8] : "0";
 	
@@ -108,6 +154,115 @@ int main(int argc, char* argv[])
 	else
 		nLevels = "-1";
 
+	//number of PatchMatch threads
+	if(cmdOptionExists(argv, argv+argc, "-nThreads"))
+		nThreads = getCmdOption(argv, argv + argc, "-nThreads");
+	else
+		nThreads = "-1";
+	
+	//PatchMatch convergence threshold
+	if(cmdOptionExists(argv, argv+argc, "-convergenceThreshold"))
+		convergenceThreshold = getCmdOption(argv, argv + argc, "-convergenceThreshold");
+	else
+		convergenceThreshold = "-1";
+	
+	//nearest neighbour search mode
+	if(cmdOptionExists(argv, argv+argc, "-searchMode"))
+		searchMode = getCmdOption(argv, argv + argc, "-searchMode");
+	else
+		searchMode = "-1";
+	
+	//patch comparisons on quantised images
+	if(cmdOptionExists(argv, argv+argc, "-quantisedMatching"))
+		quantisedMatching = getCmdOption(argv, argv + argc, "-quantisedMatching");
+	else
+		quantisedMatching = "-1";
+	
+	//exemplar library
+	if(cmdOptionExists(argv, argv+argc, "-exemplarLibrary"))
+		exemplarLibraryFile = getCmdOption(argv, argv + argc, "-exemplarLibrary");
+	
+	//streaming inpainting of large images
+	if(cmdOptionExists(argv, argv+argc, "-memoryBudget"))
+		memoryBudget = getCmdOption(argv, argv + argc, "-memoryBudget");
+	else
+		memoryBudget = "-1";
+	
+	//inpainting of the connected components of the occlusion
+	if(cmdOptionExists(argv, argv+argc, "-connectedComponents"))
+		connectedComponents = getCmdOption(argv, argv + argc, "-connectedComponents");
+	else
+		connectedComponents = "-1";
+	
+	//TV inpainting of the occlusion, used as the initialisation
+	if(cmdOptionExists(argv, argv+argc, "-tvLambda"))
+		tvLambda = getCmdOption(argv, argv + argc, "-tvLambda");
+	else
+		tvLambda = "-1";
+	if(cmdOptionExists(argv, argv+argc, "-tvMaxIterations"))
+		tvMaxIterations = getCmdOption(argv, argv + argc, "-tvMaxIterations");
+	else
+		tvMaxIterations = "-1";
+	
+	//number of PatchMatch passes
+	if(cmdOptionExists(argv, argv+argc, "-nIters"))
+		nIters = getCmdOption(argv, argv + argc, "-nIters");
+	else
+		nIters = "-1";
+	
+	//PatchMatch passes in raster order, without the parallel bands
+	if(cmdOptionExists(argv, argv+argc, "-sequential"))
+		sequentialScan = getCmdOption(argv, argv + argc, "-sequential");
+	else
+		sequentialScan = "-1";
+	
+	//reconstruction by scattering the patches
+	if(cmdOptionExists(argv, argv+argc, "-scatterReconstruction"))
+		scatterReconstruction = getCmdOption(argv, argv + argc, "-scatterReconstruction");
+	else
+		scatterReconstruction = "-1";
+	
+	//threshold of the frozen pixels
+	if(cmdOptionExists(argv, argv+argc, "-freezeThreshold"))
+		freezeThreshold = getCmdOption(argv, argv + argc, "-freezeThreshold");
+	else
+		freezeThreshold = "-1";
+	
+	//list of patch sizes, inpainted in the same run
+	if(cmdOptionExists(argv, argv+argc, "-patchSizes"))
+	{
+		const char *patchSizeList = getCmdOption(argv, argv + argc, "-patchSizes");
+		char *listEnd = (char*)patchSizeList;
+		while ( (listEnd != NULL) && (*listEnd != '\0') )
+		{
+			char *sizeEnd;
+			long patchSize = strtol(listEnd, &sizeEnd, 10);
+			if ( (sizeEnd == listEnd) || (patchSize <= 0) || ( (*sizeEnd != ',') && (*sizeEnd != '\0') ) )
+				break;
+			patchSizes.push_back((int)patchSize);
+			listEnd = (*sizeEnd == ',') ? sizeEnd+1 : sizeEnd;
+		}
+		if ( (listEnd == NULL) || (*listEnd != '\0') || (patchSizes.size() == 0) )
+		{
+			show_help();
+			return -1;
+		}
+	}
+	
+	//region of interest
+	if(cmdOptionExists(argv, argv+argc, "-roi"))
+	{
+		const char *roi = getCmdOption(argv, argv + argc, "-roi");
+		if ( (roi == NULL) || (sscanf(roi,"%d,%d,%d,%d",&regionOfInterest[0],&regionOfInterest[1],
+			&regionOfInterest[2],&regionOfInterest[3]) != 4) || (regionOfInterest[0] < 0) ||
+			(regionOfInterest[1] < 0) || (regionOfInterest[2] <= 0) || (regionOfInterest[3] <= 0) )
+		{
+			show_help();
+			return -1;
+		}
+		useRegionOfInterest = true;
+	}
+
 	//whether to use texture features or not
 	if(cmdOptionExists(argv, argv+argc, "-useFeatures"))
 		useFeatures = getCmdOption(argv, argv + argc, "-useFeatures");
@@ -123,14 +278,85 @@ int main(int argc, char* argv[])
 	
 	time(&startTime);//startTime = clock();
 	
-	inpaint_image_wrapper(fileIn,fileInOcc,fileOut,
-		atoi(patchSizeX), atoi(patchSizeY), atoi(nLevels), (bool)atoi(useFeatures), (bool)atoi(verboseMode));
+	inpaintingOptionStruct *options = initialise_inpainting_options(atoi(patchSizeX), atoi(patchSizeY),
+		(bool)atoi(useFeatures));
+	options->patchSizes = patchSizes;
+	options->nLevels = atoi(nLevels);
+	options->verboseMode = (bool)atoi(verboseMode);
+	options->nThreads = (nThreadsJob > 0) ? nThreadsJob : atoi(nThreads);
+	options->convergenceThreshold = (float)atof(convergenceThreshold);
+	options->searchMode = atoi(searchMode);
+	options->quantisedMatching = atoi(quantisedMatching);
+	options->nIters = atoi(nIters);
+	options->sequentialScan = atoi(sequentialScan);
+	options->exemplarLibraryFile = exemplarLibraryFile;
+	options->memoryBudget = (float)atof(memoryBudget);
+	options->connectedComponents = atoi(connectedComponents);
+	options->useRegionOfInterest = useRegionOfInterest;
+	for (int i=0; i<4; i++)
+		options->regionOfInterest[i] = regionOfInterest[i];
+	options->tvLambda = (float)atof(tvLambda);
+	options->tvMaxIterations = atoi(tvMaxIterations);
+	options->scatterReconstruction = atoi(scatterReconstruction);
+	options->freezeThreshold = (float)atof(freezeThreshold);
+	int result = inpaint_image_wrapper(fileIn,fileInOcc,fileOut,options);
+	delete options;
 	
 	time(&stopTime);
 	printf("\n\nTotal execution time: %f\n",fabs(difftime(startTime,stopTime)));
 	//MY_PRINTF("\n\nTotal execution time: %f\n",((double)(clock()-startTime)) / CLOCKS_PER_SEC);
 
 	
-	return(0);
+	return(result);
+
+}
 
+/// main function of the inpainting code
+int main(int argc, char* argv[])
+{
+	if(argc < 3) {
+        show_help();
+        return -1;
+    }
+    
+	//build an exemplar library instead of inpainting
+	if (strcmp(argv[1],"-buildExemplarLibrary") == 0)
+	{
+		int nImages = (argc-3)/2;
+		if ( (argc < 5) || ((argc-3)%2 != 0) )
+		{
+			show_help();
+			return -1;
+		}
+		std::vector<const char*> imageFiles, occlusionFiles;
+		for (int i=0; i<nImages; i++)
+		{
+			imageFiles.push_back(argv[3+2*i]);
+			occlusionFiles.push_back(argv[4+2*i]);
+		}
+		return( (build_exemplar_library(argv[2], &(imageFiles[0]), &(occlusionFiles[0]), nImages) == -1) ? -1 : 0 );
+	}
+	
+	//run the jobs of a manifest file in this process
+	if (strcmp(argv[1],"-batch") == 0)
+	{
+		int nThreads = get_max_threads();
+		if(cmdOptionExists(argv, argv+argc, "-nThreads"))
+		{
+			const char *nThreadsOption = getCmdOption(argv, argv + argc, "-nThreads");
+			nThreads = (nThreadsOption != NULL) ? atoi(nThreadsOption) : 0;
+		}
+		if (nThreads <= 0)
+		{
+			show_help();
+			return -1;
+		}
+		int result = inpaint_image_batch(argv[2], nThreads, inpaint_command);
+		close_exemplar_libraries();
+		return( (result == -1) ? -1 : 0 );
+	}
+	
+	int result = inpaint_command(argc, argv, -1);
+	close_exemplar_libraries();
+	return( (result == -1) ? -1 : 0 );
 }
@@ -0,0 +1,105 @@
+//raw float images (.rawf), memory mapped by the inpainting
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <map>
+
+#include "io_raw_float.h"
+
+//sizes of the mappings, indexed by the address of their values
+static std::map<float*,size_t> rawFloatMappings;
+
+bool is_raw_float_file(const char *fileName)
+{
+	const char *extension = strrchr(fileName,'.');
+	return( (extension != NULL) && (strcasecmp(extension,".rawf") == 0) );
+}
+
+float* map_raw_float_f32(const char *fileName, size_t *nx, size_t *ny, size_t *nc)
+{
+	int fileDescriptor = open(fileName, O_RDONLY);
+	struct stat fileStatus;
+	if ( (fileDescriptor < 0) || (fstat(fileDescriptor,&fileStatus) != 0) ||
+		(fileStatus.st_size < RAW_FLOAT_HEADER_SIZE) )
+	{
+		printf("Error in map_raw_float_f32, unable to read %s.\n",fileName);
+		if (fileDescriptor >= 0)
+			close(fileDescriptor);
+		return(NULL);
+	}
+	size_t mappingSize = (size_t)fileStatus.st_size;
+	//the images given to the inpainting may be modified (binarised occlusions) : their pages are then copied
+	void *mapping = mmap(NULL, mappingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileDescriptor, 0);
+	close(fileDescriptor);
+	if (mapping == MAP_FAILED)
+	{
+		printf("Error in map_raw_float_f32, unable to map %s.\n",fileName);
+		return(NULL);
+	}
+
+	//check the header and the size of the file
+	const char *header = (const char*)mapping;
+	int32_t sizes[3];
+	memcpy(sizes,header+8,sizeof(sizes));
+	size_t nValues = (size_t)(sizes[0] > 0 ? sizes[0] : 0) * (size_t)(sizes[1] > 0 ? sizes[1] : 0) *
+		(size_t)(sizes[2] > 0 ? sizes[2] : 0);
+	if ( (memcmp(header,RAW_FLOAT_MAGIC,8) != 0) || (nValues == 0) ||
+		(mappingSize != RAW_FLOAT_HEADER_SIZE + nValues*sizeof(float)) )
+	{
+		printf("Error in map_raw_float_f32, %s is not a valid raw float image.\n",fileName);
+		munmap(mapping,mappingSize);
+		return(NULL);
+	}
+	*nx = (size_t)sizes[0];
+	*ny = (size_t)sizes[1];
+	*nc = (size_t)sizes[2];
+
+	float *values = (float*)(header + RAW_FLOAT_HEADER_SIZE);
+	#pragma omp critical(rawFloatMappings)
+	rawFloatMappings[values] = mappingSize;
+	return(values);
+}
+
+int unmap_raw_float_f32(float *values)
+{
+	size_t mappingSize = 0;
+	#pragma omp critical(rawFloatMappings)
+	{
+		std::map<float*,size_t>::iterator mapping = rawFloatMappings.find(values);
+		if (mapping != rawFloatMappings.end())
+		{
+			mappingSize = mapping->second;
+			rawFloatMappings.erase(mapping);
+		}
+	}
+	if (mappingSize == 0)
+		return(-1);
+	munmap((char*)values - RAW_FLOAT_HEADER_SIZE, mappingSize);
+	return(1);
+}
+
+int write_raw_float_f32(const char *fileName, const float *data, size_t nx, size_t ny, size_t nc)
+{
+	FILE *file = fopen(fileName,"wb");
+	char header[RAW_FLOAT_HEADER_SIZE];
+	int32_t sizes[3] = {(int32_t)nx, (int32_t)ny, (int32_t)nc};
+	memset(header,0,RAW_FLOAT_HEADER_SIZE);
+	memcpy(header,RAW_FLOAT_MAGIC,8);
+	memcpy(header+8,sizes,sizeof(sizes));
+	int returnVal = 1;
+	if ( (file == NULL) || (fwrite(header,1,RAW_FLOAT_HEADER_SIZE,file) != RAW_FLOAT_HEADER_SIZE) ||
+		(fwrite(data,sizeof(float),nx*ny*nc,file) != nx*ny*nc) )
+	{
+		printf("Error in write_raw_float_f32, unable to write %s.\n",fileName);
+		returnVal = -1;
+	}
+	if (file != NULL)
+		fclose(file);
+	return(returnVal);
+}
@@ -0,0 +1,26 @@
+//raw float images (.rawf), exchanged with the TV inpainting (tvinpaint) without encoding nor quantisation : a header
+//of RAW_FLOAT_HEADER_SIZE bytes (magic, then xSize, ySize and nChannels as 32-bit integers), followed by the values
+//in [0,255], stored channel after channel and row after row (as returned by read_png_f32), in the byte order of
+//the machine. The header size keeps the values aligned in the memory mapping
+
+#ifndef IO_RAW_FLOAT_H
+#define IO_RAW_FLOAT_H
+
+#include <stdlib.h>
+
+//identifier and version of the raw float files (same as RAWFLOAT_MAGIC in tvinpaint's imageio.h)
+#define RAW_FLOAT_MAGIC "RAWF0001"
+#define RAW_FLOAT_HEADER_SIZE 64
+
+//true if the file name ends with .rawf
+bool is_raw_float_file(const char *fileName);
+
+//memory map the values of a raw float file, NULL on error. The mapping is private : the pages are read from the
+//file when they are first accessed, and copied only if they are modified
+float* map_raw_float_f32(const char *fileName, size_t *nx, size_t *ny, size_t *nc);
+//unmap values returned by map_raw_float_f32, returns -1 if they do not come from a mapping
+int unmap_raw_float_f32(float *values);
+
+int write_raw_float_f32(const char *fileName, const float *data, size_t nx, size_t ny, size_t nc);
+
+#endif
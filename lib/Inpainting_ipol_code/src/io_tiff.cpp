@@ -0,0 +1,398 @@
+//reading and writing of TIFF images (striped or tiled, 8 or 16 bits, classic TIFF or BigTIFF). The TIFF support
+//is compiled when HAVE_LIBTIFF is defined (see the makefile), otherwise the functions report an error
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <math.h>
+#include <vector>
+
+#include "io_tiff.h"
+
+bool is_tiff_file(const char *fileName)
+{
+	const char *extension = strrchr(fileName,'.');
+	return( (extension != NULL) && ( (strcasecmp(extension,".tif") == 0) || (strcasecmp(extension,".tiff") == 0) ) );
+}
+
+#ifdef HAVE_LIBTIFF
+
+#include <tiffio.h>
+
+struct tiffImageStruct
+{
+	TIFF *tif;
+	bool writing;
+	size_t xSize, ySize, nTupleSize;
+	int bitDepth;
+	bool tiled, separatePlanes, minIsWhite;
+	size_t blockWidth, blockHeight;	//tile size, or image width and number of rows per strip
+	std::vector<unsigned char> block;	//decoded tile, strip or scanline
+	std::vector<float> cachedRows;	//interleaved values of the rows [cacheStart, cacheStart+blockHeight[
+	size_t cacheStart;
+	bool cacheValid;
+	size_t nRowsWritten;
+};
+
+//nValues samples of 8 or 16 bits, in [0,255]
+static void convert_tiff_samples(const tiffImage *tiff, const unsigned char *samples, size_t nValues,
+	size_t sampleStep, float *valuesOut, size_t valueStep)
+{
+	for (size_t i=0; i<nValues; i++)
+	{
+		float value;
+		if (tiff->bitDepth == 16)
+		{
+			uint16_t value16;
+			memcpy(&value16, samples + i*sampleStep*2, 2);	//libtiff returns the samples in the byte order of the machine
+			value = (tiff->minIsWhite) ? (float)(65535-value16) : (float)value16;
+			value = value/IMAGE_16_BIT_SCALE;
+		}
+		else
+			value = (tiff->minIsWhite) ? (float)(255-samples[i*sampleStep]) : (float)samples[i*sampleStep];
+		valuesOut[i*valueStep] = value;
+	}
+}
+
+tiffImage* open_tiff_image(const char *fileName, size_t *nx, size_t *ny, size_t *nc, int *bitDepth)
+{
+	TIFF *tif = TIFFOpen(fileName,"r");	//classic TIFF and BigTIFF
+	if (tif == NULL)
+	{
+		printf("Error in open_tiff_image, unable to read %s.\n",fileName);
+		return(NULL);
+	}
+	uint32_t width = 0, height = 0, rowsPerStrip = 0, tileWidth = 0, tileHeight = 0;
+	uint16_t samplesPerPixel = 1, bitsPerSample = 1, sampleFormat = SAMPLEFORMAT_UINT, planarConfig = PLANARCONFIG_CONTIG;
+	uint16_t photometric;
+	TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &width);
+	TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &height);
+	TIFFGetFieldDefaulted(tif, TIFFTAG_SAMPLESPERPIXEL, &samplesPerPixel);
+	TIFFGetFieldDefaulted(tif, TIFFTAG_BITSPERSAMPLE, &bitsPerSample);
+	TIFFGetFieldDefaulted(tif, TIFFTAG_SAMPLEFORMAT, &sampleFormat);
+	TIFFGetFieldDefaulted(tif, TIFFTAG_PLANARCONFIG, &planarConfig);
+	if (TIFFGetField(tif, TIFFTAG_PHOTOMETRIC, &photometric) == 0)
+		photometric = (samplesPerPixel >= 3) ? PHOTOMETRIC_RGB : PHOTOMETRIC_MINISBLACK;
+
+	if ( (width == 0) || (height == 0) || ( (bitsPerSample != 8) && (bitsPerSample != 16) ) ||
+		(sampleFormat != SAMPLEFORMAT_UINT) || ( (photometric != PHOTOMETRIC_MINISBLACK) &&
+		(photometric != PHOTOMETRIC_MINISWHITE) && (photometric != PHOTOMETRIC_RGB) ) )
+	{
+		printf("Error in open_tiff_image, %s is not an 8 or 16-bit unsigned grey or RGB image.\n",fileName);
+		TIFFClose(tif);
+		return(NULL);
+	}
+
+	tiffImage *tiff = new tiffImage;
+	tiff->tif = tif;
+	tiff->writing = false;
+	tiff->xSize = width;
+	tiff->ySize = height;
+	tiff->nTupleSize = samplesPerPixel;
+	tiff->bitDepth = bitsPerSample;
+	tiff->tiled = (TIFFIsTiled(tif) != 0);
+	tiff->separatePlanes = (planarConfig == PLANARCONFIG_SEPARATE);
+	tiff->minIsWhite = (photometric == PHOTOMETRIC_MINISWHITE);
+	if (tiff->tiled)
+	{
+		TIFFGetField(tif, TIFFTAG_TILEWIDTH, &tileWidth);
+		TIFFGetField(tif, TIFFTAG_TILELENGTH, &tileHeight);
+		tiff->blockWidth = tileWidth;
+		tiff->blockHeight = tileHeight;
+		tiff->block.resize((size_t)TIFFTileSize(tif));
+	}
+	else
+	{
+		TIFFGetFieldDefaulted(tif, TIFFTAG_ROWSPERSTRIP, &rowsPerStrip);
+		tiff->blockWidth = width;
+		tiff->blockHeight = (rowsPerStrip < height) ? rowsPerStrip : height;
+		tiff->block.resize( ( (size_t)TIFFStripSize(tif) > (size_t)TIFFScanlineSize(tif) ) ?
+			(size_t)TIFFStripSize(tif) : (size_t)TIFFScanlineSize(tif) );
+	}
+	tiff->cacheStart = 0;
+	tiff->cacheValid = false;
+	tiff->nRowsWritten = 0;
+
+	*nx = tiff->xSize;
+	*ny = tiff->ySize;
+	*nc = tiff->nTupleSize;
+	if (bitDepth != NULL)
+		*bitDepth = tiff->bitDepth;
+	return(tiff);
+}
+
+tiffImage* create_tiff_image(const char *fileName, size_t nx, size_t ny, size_t nc, int bitDepth)
+{
+	bool bigTiff = ( (unsigned long long)nx*ny*nc*(bitDepth/8) > TIFF_BIGTIFF_THRESHOLD );
+	TIFF *tif = TIFFOpen(fileName, bigTiff ? "w8" : "w");
+	if (tif == NULL)
+	{
+		printf("Error in create_tiff_image, unable to write %s.\n",fileName);
+		return(NULL);
+	}
+	TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, (uint32_t)nx);
+	TIFFSetField(tif, TIFFTAG_IMAGELENGTH, (uint32_t)ny);
+	TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, (uint16_t)nc);
+	TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, (uint16_t)bitDepth);
+	TIFFSetField(tif, TIFFTAG_SAMPLEFORMAT, (uint16_t)SAMPLEFORMAT_UINT);
+	TIFFSetField(tif, TIFFTAG_PLANARCONFIG, (uint16_t)PLANARCONFIG_CONTIG);
+	TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, (uint16_t)( (nc >= 3) ? PHOTOMETRIC_RGB : PHOTOMETRIC_MINISBLACK ));
+	if ( (nc == 2) || (nc == 4) )
+	{
+		uint16_t extraSample = EXTRASAMPLE_UNASSALPHA;
+		TIFFSetField(tif, TIFFTAG_EXTRASAMPLES, (uint16_t)1, &extraSample);
+	}
+	TIFFSetField(tif, TIFFTAG_COMPRESSION, (uint16_t)COMPRESSION_LZW);
+	TIFFSetField(tif, TIFFTAG_PREDICTOR, (uint16_t)PREDICTOR_HORIZONTAL);
+	TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, TIFFDefaultStripSize(tif, 0));
+
+	tiffImage *tiff = new tiffImage;
+	tiff->tif = tif;
+	tiff->writing = true;
+	tiff->xSize = nx;
+	tiff->ySize = ny;
+	tiff->nTupleSize = nc;
+	tiff->bitDepth = bitDepth;
+	tiff->tiled = false;
+	tiff->separatePlanes = false;
+	tiff->minIsWhite = false;
+	tiff->blockWidth = nx;
+	tiff->blockHeight = 1;
+	tiff->block.resize(nx*nc*(bitDepth/8));
+	tiff->cacheStart = 0;
+	tiff->cacheValid = false;
+	tiff->nRowsWritten = 0;
+	return(tiff);
+}
+
+int close_tiff_image(tiffImage *tiff)
+{
+	if (tiff == NULL)
+		return(-1);
+	int returnVal = 1;
+	if ( (tiff->writing) && (tiff->nRowsWritten != tiff->ySize) )
+	{
+		printf("Error in close_tiff_image, %d rows of %d were written.\n",(int)tiff->nRowsWritten,(int)tiff->ySize);
+		returnVal = -1;
+	}
+	TIFFClose(tiff->tif);
+	delete tiff;
+	return(returnVal);
+}
+
+//decode the tile or strip whose top left corner is (xBlock,yBlock), in the plane (for separate planes), and copy
+//its intersection with the region
+static int read_tiff_block(tiffImage *tiff, size_t xBlock, size_t yBlock, int plane, size_t x0, size_t y0,
+	size_t xSize, size_t ySize, float *valuesOut, bool interleaved)
+{
+	tmsize_t nBytes;
+	if (tiff->tiled)
+		nBytes = TIFFReadTile(tiff->tif, &(tiff->block[0]), (uint32_t)xBlock, (uint32_t)yBlock, 0, (uint16_t)plane);
+	else
+		nBytes = TIFFReadEncodedStrip(tiff->tif, TIFFComputeStrip(tiff->tif, (uint32_t)yBlock, (uint16_t)plane),
+			&(tiff->block[0]), (tmsize_t)-1);
+	if (nBytes < 0)
+	{
+		printf("Error in read_tiff_block, unable to decode the block at (%d,%d).\n",(int)xBlock,(int)yBlock);
+		return(-1);
+	}
+
+	size_t nSamples = (tiff->separatePlanes) ? 1 : tiff->nTupleSize;
+	size_t bytesPerSample = (size_t)(tiff->bitDepth/8);
+	size_t rowBytes = (tiff->blockWidth)*nSamples*bytesPerSample;
+	size_t xStart = (xBlock > x0) ? xBlock : x0;
+	size_t yStart = (yBlock > y0) ? yBlock : y0;
+	size_t xEnd = xBlock + tiff->blockWidth, yEnd = yBlock + tiff->blockHeight;
+	xEnd = (xEnd < x0+xSize) ? xEnd : x0+xSize;
+	yEnd = (yEnd < y0+ySize) ? yEnd : y0+ySize;
+	for (size_t y=yStart; y<yEnd; y++)
+		for (size_t s=0; s<nSamples; s++)
+		{
+			size_t c = (tiff->separatePlanes) ? (size_t)plane : s;
+			const unsigned char *samples = &(tiff->block[(y-yBlock)*rowBytes + ((xStart-xBlock)*nSamples + s)*bytesPerSample]);
+			if (interleaved)
+				convert_tiff_samples(tiff, samples, xEnd-xStart, nSamples,
+					valuesOut + ((y-y0)*xSize + (xStart-x0))*(tiff->nTupleSize) + c, tiff->nTupleSize);
+			else
+				convert_tiff_samples(tiff, samples, xEnd-xStart, nSamples,
+					valuesOut + c*xSize*ySize + (y-y0)*xSize + (xStart-x0), 1);
+		}
+	return(1);
+}
+
+int read_tiff_region(tiffImage *tiff, size_t x0, size_t y0, size_t xSize, size_t ySize, float *valuesOut,
+	bool interleaved)
+{
+	if ( (tiff->writing) || (x0+xSize > tiff->xSize) || (y0+ySize > tiff->ySize) )
+	{
+		printf("Error in read_tiff_region, the region is not in the image.\n");
+		return(-1);
+	}
+	int nPlanes = (tiff->separatePlanes) ? (int)tiff->nTupleSize : 1;
+	for (int plane=0; plane<nPlanes; plane++)
+		for (size_t yBlock=(y0/tiff->blockHeight)*(tiff->blockHeight); yBlock<y0+ySize; yBlock+=tiff->blockHeight)
+			for (size_t xBlock=(x0/tiff->blockWidth)*(tiff->blockWidth); xBlock<x0+xSize; xBlock+=tiff->blockWidth)
+				if (read_tiff_block(tiff, xBlock, yBlock, plane, x0, y0, xSize, ySize, valuesOut, interleaved) == -1)
+					return(-1);
+	return(1);
+}
+
+int read_tiff_row(tiffImage *tiff, size_t y, float *valuesOut)
+{
+	size_t nValues = (tiff->xSize)*(tiff->nTupleSize);
+	if (y >= tiff->ySize)
+	{
+		printf("Error in read_tiff_row, the row is not in the image.\n");
+		return(-1);
+	}
+	//strips of interleaved samples are decoded row by row, when the rows are read in order
+	if ( (!tiff->tiled) && (!tiff->separatePlanes) )
+	{
+		if (TIFFReadScanline(tiff->tif, &(tiff->block[0]), (uint32_t)y, 0) < 0)
+		{
+			printf("Error in read_tiff_row, unable to decode row %d.\n",(int)y);
+			return(-1);
+		}
+		convert_tiff_samples(tiff, &(tiff->block[0]), nValues, 1, valuesOut, 1);
+		return(1);
+	}
+	if ( (!tiff->cacheValid) || (y < tiff->cacheStart) || (y >= tiff->cacheStart + tiff->blockHeight) )
+	{
+		tiff->cacheStart = (y/tiff->blockHeight)*(tiff->blockHeight);
+		size_t nRows = (tiff->cacheStart + tiff->blockHeight < tiff->ySize) ? tiff->blockHeight : tiff->ySize - tiff->cacheStart;
+		tiff->cachedRows.resize(nRows*nValues);
+		tiff->cacheValid = (read_tiff_region(tiff, 0, tiff->cacheStart, tiff->xSize, nRows, &(tiff->cachedRows[0]), true) == 1);
+		if (!tiff->cacheValid)
+			return(-1);
+	}
+	memcpy(valuesOut, &(tiff->cachedRows[(y - tiff->cacheStart)*nValues]), nValues*sizeof(float));
+	return(1);
+}
+
+int write_tiff_row(tiffImage *tiff, const float *values)
+{
+	size_t nValues = (tiff->xSize)*(tiff->nTupleSize);
+	unsigned char *row = &(tiff->block[0]);
+	for (size_t i=0; i<nValues; i++)
+	{
+		if (tiff->bitDepth == 16)
+		{
+			float value = (float)floor(values[i]*IMAGE_16_BIT_SCALE + 0.5f);
+			uint16_t value16 = (uint16_t)( value < 0.0f ? 0.0f : (value > 65535.0f ? 65535.0f : value) );
+			memcpy(row + 2*i, &value16, 2);
+		}
+		else
+		{
+			float value = (float)floor(values[i] + 0.5f);
+			row[i] = (unsigned char)( value < 0.0f ? 0.0f : (value > 255.0f ? 255.0f : value) );
+		}
+	}
+	if ( (!tiff->writing) || (tiff->nRowsWritten >= tiff->ySize) ||
+		(TIFFWriteScanline(tiff->tif, row, (uint32_t)tiff->nRowsWritten, 0) < 0) )
+	{
+		printf("Error in write_tiff_row, unable to write row %d.\n",(int)tiff->nRowsWritten);
+		return(-1);
+	}
+	tiff->nRowsWritten++;
+	return(1);
+}
+
+#else
+
+struct tiffImageStruct
+{
+	int unused;
+};
+
+static void show_tiff_error()
+{
+	printf("Error, the TIFF files can not be read nor written : the code was compiled without libtiff (make TIFF=1).\n");
+}
+
+tiffImage* open_tiff_image(const char*, size_t*, size_t*, size_t*, int*)
+{
+	show_tiff_error();
+	return(NULL);
+}
+
+tiffImage* create_tiff_image(const char*, size_t, size_t, size_t, int)
+{
+	show_tiff_error();
+	return(NULL);
+}
+
+int close_tiff_image(tiffImage*)
+{
+	return(-1);
+}
+
+int read_tiff_region(tiffImage*, size_t, size_t, size_t, size_t, float*, bool)
+{
+	show_tiff_error();
+	return(-1);
+}
+
+int read_tiff_row(tiffImage*, size_t, float*)
+{
+	show_tiff_error();
+	return(-1);
+}
+
+int write_tiff_row(tiffImage*, const float*)
+{
+	show_tiff_error();
+	return(-1);
+}
+
+#endif
+
+float* read_tiff_region_f32(const char *fileName, size_t x0, size_t y0, size_t xSize, size_t ySize, size_t *nc)
+{
+	size_t nx, ny;
+	tiffImage *tiff = open_tiff_image(fileName, &nx, &ny, nc, NULL);
+	if (tiff == NULL)
+		return(NULL);
+	float *values = (float*)malloc(xSize*ySize*(*nc)*sizeof(float));
+	if ( (values == NULL) || (read_tiff_region(tiff, x0, y0, xSize, ySize, values, false) == -1) )
+	{
+		free(values);
+		values = NULL;
+	}
+	close_tiff_image(tiff);
+	return(values);
+}
+
+float* read_tiff_f32(const char *fileName, size_t *nx, size_t *ny, size_t *nc)
+{
+	tiffImage *tiff = open_tiff_image(fileName, nx, ny, nc, NULL);
+	if (tiff == NULL)
+		return(NULL);
+	float *values = (float*)malloc((*nx)*(*ny)*(*nc)*sizeof(float));
+	if ( (values == NULL) || (read_tiff_region(tiff, 0, 0, *nx, *ny, values, false) == -1) )
+	{
+		free(values);
+		values = NULL;
+	}
+	close_tiff_image(tiff);
+	return(values);
+}
+
+int write_tiff_f32(const char *fileName, const float *data, size_t nx, size_t ny, size_t nc, int bitDepth)
+{
+	tiffImage *tiff = create_tiff_image(fileName, nx, ny, nc, bitDepth);
+	if (tiff == NULL)
+		return(-1);
+	std::vector<float> row(nx*nc);
+	int returnVal = 1;
+	for (size_t y=0; (y<ny) && (returnVal == 1); y++)
+	{
+		for (size_t x=0; x<nx; x++)
+			for (size_t c=0; c<nc; c++)
+				row[x*nc + c] = data[c*nx*ny + y*nx + x];
+		returnVal = write_tiff_row(tiff, &(row[0]));
+	}
+	if (close_tiff_image(tiff) == -1)
+		returnVal = -1;
+	return(returnVal);
+}
@@ -0,0 +1,47 @@
+//reading and writing of TIFF images (striped or tiled, 8 or 16 bits, classic TIFF or BigTIFF). The TIFF support
+//is compiled when HAVE_LIBTIFF is defined (see the makefile), otherwise the functions report an error
+
+#ifndef IO_TIFF_H
+#define IO_TIFF_H
+
+#include <stdlib.h>
+
+//the values of 16-bit images are divided by this factor, so all the images are inpainted in [0,255] and the
+//parameters (SIGMA_COLOUR, residual threshold) do not depend on the bit depth
+#ifndef IMAGE_16_BIT_SCALE
+#define IMAGE_16_BIT_SCALE 257.0f
+#endif
+
+//the TIFF files written are BigTIFF files above this size (uncompressed, in bytes)
+#ifndef TIFF_BIGTIFF_THRESHOLD
+#define TIFF_BIGTIFF_THRESHOLD 2000000000ULL
+#endif
+
+	//opened TIFF file, and decoded rows of the last strip or row of tiles read by read_tiff_row
+	typedef struct tiffImageStruct tiffImage;
+
+//true if the file name ends with .tif or .tiff
+bool is_tiff_file(const char *fileName);
+
+//open a TIFF file for reading, NULL on error (unsupported sample format or photometric interpretation)
+tiffImage* open_tiff_image(const char *fileName, size_t *nx, size_t *ny, size_t *nc, int *bitDepth);
+//create a TIFF file, written row after row (8 or 16 bits, LZW compression), NULL on error
+tiffImage* create_tiff_image(const char *fileName, size_t nx, size_t ny, size_t nc, int bitDepth);
+//for the files created, returns -1 if the rows were not all written
+int close_tiff_image(tiffImage *tiff);
+
+//values of the region [x0,x0+xSize[ x [y0,y0+ySize[, in [0,255] : only the strips or tiles which intersect the region
+//are decoded. The values are stored channel after channel (as read_png_f32), or interleaved. Returns -1 on error
+int read_tiff_region(tiffImage *tiff, size_t x0, size_t y0, size_t xSize, size_t ySize, float *valuesOut,
+	bool interleaved);
+//interleaved values of row y : the strip or row of tiles which contains it is decoded once, for the following rows
+int read_tiff_row(tiffImage *tiff, size_t y, float *valuesOut);
+//write the next row (interleaved values in [0,255], rounded and bounded as in write_png_f32)
+int write_tiff_row(tiffImage *tiff, const float *values);
+
+//whole images, stored channel after channel
+float* read_tiff_f32(const char *fileName, size_t *nx, size_t *ny, size_t *nc);
+float* read_tiff_region_f32(const char *fileName, size_t x0, size_t y0, size_t xSize, size_t ySize, size_t *nc);
+int write_tiff_f32(const char *fileName, const float *data, size_t nx, size_t ny, size_t nc, int bitDepth);
+
+#endif
@@ -45,67 +45,64 @@ nTupleImage* create_structuring_element(const char * structType, int xSize, int
 
 }
 
-nTupleImage* imerode(nTupleImage *imgIn, nTupleImage *structEl)
+//morphological filtering (erosion if dilate is false) : the input is padded with a replicated halo, so the
+//structuring element can be applied without bounds checks. For a rectangular structuring element containing
+//the origin, this gives the same result as ignoring the pixels outside the image
+static nTupleImage* morphological_filter(nTupleImage *imgIn, nTupleImage *structEl, bool dilate, nTupleImagePool *imagePool)
 {
-	//create output (eroded) image
-	nTupleImage *imgEroded =
-	new nTupleImage(imgIn->xSize,imgIn->ySize,1,imgIn->patchSizeX,imgIn->patchSizeY,imgIn->indexing);
+	//create output image
+	nTupleImage *imgOut =
+	acquire_image(imagePool,imgIn->xSize,imgIn->ySize,1,imgIn->patchSizeX,imgIn->patchSizeY,imgIn->indexing);
 	
-	//erosion
-	for (int x=0;x<imgIn->xSize;x++)
-		for (int y=0;y<imgIn->ySize;y++)
+	//size of the halo needed by the structuring element
+	int haloX = 0, haloY = 0;
+	for (int xStructEl=0;xStructEl<structEl->xSize;xStructEl++)
+		for (int yStructEl=0;yStructEl<structEl->ySize;yStructEl++)
 		{
-			imageDataType newValue = imgIn->get_value(x,y,0);
-			for (int xStructEl=0;xStructEl<structEl->xSize;xStructEl++)
-			{
-				for (int yStructEl=0;yStructEl<structEl->ySize;yStructEl++)
-				{
-					int xShift = x+structEl->get_value(xStructEl,yStructEl,0);
-					int yShift = y+structEl->get_value(xStructEl,yStructEl,1);
-					if (xShift>=0 && xShift<(imgIn->xSize) && yShift>=0 && yShift<(imgIn->ySize))
-					{
-						imageDataType currValue = imgIn->get_value(xShift,yShift,0);
-				  		if (currValue<newValue)
-				  			newValue=currValue;	  
-					}
-				}
-			}
-			//set eroded value
-			imgEroded->set_value(x,y,0,newValue);
+			haloX = max_int(haloX,abs((int)structEl->get_value(xStructEl,yStructEl,0)));
+			haloY = max_int(haloY,abs((int)structEl->get_value(xStructEl,yStructEl,1)));
 		}
-	return(imgEroded);
-}
-
-nTupleImage* imdilate(nTupleImage *imgIn, nTupleImage *structEl)
-{
-
-	//create output (eroded) image
-	nTupleImage *imgDilated =
-	new nTupleImage(imgIn->xSize,imgIn->ySize,1,imgIn->patchSizeX,imgIn->patchSizeY,imgIn->indexing);
+	nTupleImage *imgHalo = create_halo_image(imgIn,haloX,haloY,HALO_REPLICATE,imagePool);
+	nTupleImageView viewIn = get_image_view(imgHalo,haloX,haloY);
+	nTupleImageView viewOut = get_image_view(imgOut);
+	
+	//offsets of the structuring element in the halo buffer
+	int nbOffsets = (structEl->xSize)*(structEl->ySize);
+	std::vector<int> offsets(nbOffsets);
+	for (int xStructEl=0;xStructEl<structEl->xSize;xStructEl++)
+		for (int yStructEl=0;yStructEl<structEl->ySize;yStructEl++)
+			offsets[yStructEl*(structEl->xSize)+xStructEl] =
+				((int)structEl->get_value(xStructEl,yStructEl,0))*(viewIn.nX) +
+				((int)structEl->get_value(xStructEl,yStructEl,1))*(viewIn.nY);
 	
-	//dilation
-	for (int x=0;x<imgIn->xSize;x++)
-		for (int y=0;y<imgIn->ySize;y++)
+	for (int y=0;y<viewIn.ySize;y++)
+		for (int x=0;x<viewIn.xSize;x++)
 		{
-			imageDataType newValue = imgIn->get_value(x,y,0);
-			for (int xStructEl=0;xStructEl<structEl->xSize;xStructEl++)
+			const imageDataType *pixelPtr = viewIn.get_value_ptr(x,y,0);
+			imageDataType newValue = *pixelPtr;
+			if (dilate)
 			{
-				for (int yStructEl=0;yStructEl<structEl->ySize;yStructEl++)
-				{
-					int xShift = x+structEl->get_value(xStructEl,yStructEl,0);
-					int yShift = y+structEl->get_value(xStructEl,yStructEl,1);
-					if (xShift>=0 && xShift<(imgIn->xSize) && yShift>=0 && yShift<(imgIn->ySize))
-					{
-						imageDataType currValue = imgIn->get_value(xShift,yShift,0);
-				  		if (currValue>newValue)
-				  			newValue=currValue;	  
-					}
-				}
+				for (int k=0; k<nbOffsets; k++)
+					newValue = (pixelPtr[offsets[k]] > newValue) ? pixelPtr[offsets[k]] : newValue;
 			}
-			//set eroded value
-			imgDilated->set_value(x,y,0,newValue);
+			else
+			{
+				for (int k=0; k<nbOffsets; k++)
+					newValue = (pixelPtr[offsets[k]] < newValue) ? pixelPtr[offsets[k]] : newValue;
+			}
+			viewOut.set_value(x,y,0,newValue);
 		}
-	return(imgDilated);
+	
+	release_image(imagePool,imgHalo);
+	return(imgOut);
+}
 
+nTupleImage* imerode(nTupleImage *imgIn, nTupleImage *structEl, nTupleImagePool *imagePool)
+{
+	return(morphological_filter(imgIn,structEl,false,imagePool));
 }
 
+nTupleImage* imdilate(nTupleImage *imgIn, nTupleImage *structEl, nTupleImagePool *imagePool)
+{
+	return(morphological_filter(imgIn,structEl,true,imagePool));
+}
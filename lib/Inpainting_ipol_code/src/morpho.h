@@ -9,8 +9,9 @@
 
 nTupleImage* create_structuring_element(const char * structType, int xSize, int ySize);
 
-nTupleImage* imerode(nTupleImage* imgIn, nTupleImage* structEl);
+//the output (and the temporaries) are taken from imagePool if it is not NULL
+nTupleImage* imerode(nTupleImage* imgIn, nTupleImage* structEl, nTupleImagePool *imagePool = NULL);
 
-nTupleImage* imdilate(nTupleImage* imgIn, nTupleImage* structEl);
+nTupleImage* imdilate(nTupleImage* imgIn, nTupleImage* structEl, nTupleImagePool *imagePool = NULL);
 
 #endif
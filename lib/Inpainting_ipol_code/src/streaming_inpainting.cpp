@@ -0,0 +1,445 @@
+//streaming inpainting of images which do not fit in memory (whole-folio scans) : the images are read and written
+//row by row, and the damaged tiles are inpainted one after the other, with a halo of known pixels around them
+
+#include <png.h>
+#include <setjmp.h>
+
+#include "streaming_inpainting.h"
+#include "component_inpainting.h"
+
+//PNG files are read and written with libpng, TIFF files (tiff != NULL) with io_tiff
+typedef struct imageRowReaderStruct
+{
+	FILE *file;
+	png_structp png;
+	png_infop info;
+	tiffImage *tiff;
+	int xSize, ySize, nTupleSize, bitDepth;
+	int nextRow;
+	std::vector<unsigned char> row;
+}imageRowReader;
+
+typedef struct imageRowWriterStruct
+{
+	FILE *file;
+	png_structp png;
+	png_infop info;
+	tiffImage *tiff;
+	int xSize, nTupleSize, bitDepth;
+	std::vector<unsigned char> row;
+}imageRowWriter;
+
+//rows of the image and of the occlusion kept in memory : row y is stored in row (y % nRows) of the buffers
+typedef struct streamingBandStruct
+{
+	std::vector<float> values;	//interleaved values
+	std::vector<unsigned char> occlusion;
+	int nRows, xSize, nTupleSize;
+	size_t get_index(int x, int y) const { return( (size_t)(y % nRows)*xSize + x ); }
+}streamingBand;
+
+static int open_png_row_reader(imageRowReader *reader, const char *fileName)
+{
+	reader->png = NULL;
+	reader->info = NULL;
+	reader->file = fopen(fileName,"rb");
+	if (reader->file != NULL)
+		reader->png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+	if (reader->png != NULL)
+		reader->info = png_create_info_struct(reader->png);
+	if (reader->info == NULL)
+	{
+		printf("Error in open_png_row_reader, unable to read %s.\n",fileName);
+		return(-1);
+	}
+	if (setjmp(png_jmpbuf(reader->png)))
+	{
+		printf("Error in open_png_row_reader, %s is not a valid PNG file.\n",fileName);
+		return(-1);
+	}
+	png_init_io(reader->png, reader->file);
+	png_read_info(reader->png, reader->info);
+	if (png_get_interlace_type(reader->png, reader->info) != PNG_INTERLACE_NONE)
+	{
+		printf("Error in open_png_row_reader, %s is interlaced and can not be read row by row.\n",fileName);
+		return(-1);
+	}
+	int colourType = png_get_color_type(reader->png, reader->info);
+	if (colourType == PNG_COLOR_TYPE_PALETTE)
+		png_set_palette_to_rgb(reader->png);
+	if ( (colourType == PNG_COLOR_TYPE_GRAY) && (png_get_bit_depth(reader->png, reader->info) < 8) )
+		png_set_expand_gray_1_2_4_to_8(reader->png);
+	png_read_update_info(reader->png, reader->info);
+
+	reader->xSize = (int)png_get_image_width(reader->png, reader->info);
+	reader->ySize = (int)png_get_image_height(reader->png, reader->info);
+	reader->nTupleSize = (int)png_get_channels(reader->png, reader->info);
+	reader->bitDepth = (int)png_get_bit_depth(reader->png, reader->info);
+	reader->row.resize(png_get_rowbytes(reader->png, reader->info));
+	return(1);
+}
+
+//interleaved values of the next row, in [0,255]
+static int read_png_row(imageRowReader *reader, float *values)
+{
+	if (setjmp(png_jmpbuf(reader->png)))
+	{
+		printf("Error in read_png_row, the file is corrupted.\n");
+		return(-1);
+	}
+	png_read_row(reader->png, &(reader->row[0]), NULL);
+	const unsigned char *row = &(reader->row[0]);
+	size_t nValues = (size_t)(reader->xSize)*(reader->nTupleSize);
+	if (reader->bitDepth == 16)
+		for (size_t i=0; i<nValues; i++)
+			values[i] = (float)( (row[2*i] << 8) | row[2*i+1] )/IMAGE_16_BIT_SCALE;
+	else
+		for (size_t i=0; i<nValues; i++)
+			values[i] = (float)row[i];
+	return(1);
+}
+
+static void close_png_row_reader(imageRowReader *reader)
+{
+	if (reader->png != NULL)
+		png_destroy_read_struct(&(reader->png), (reader->info != NULL) ? &(reader->info) : NULL, NULL);
+	if (reader->file != NULL)
+		fclose(reader->file);
+	reader->png = NULL;
+	reader->info = NULL;
+	reader->file = NULL;
+}
+
+static int open_png_row_writer(imageRowWriter *writer, const char *fileName, int xSize, int ySize, int nTupleSize,
+	int bitDepth)
+{
+	const int colourTypes[4] = {PNG_COLOR_TYPE_GRAY, PNG_COLOR_TYPE_GRAY_ALPHA, PNG_COLOR_TYPE_RGB,
+		PNG_COLOR_TYPE_RGB_ALPHA};
+	writer->png = NULL;
+	writer->info = NULL;
+	writer->file = fopen(fileName,"wb");
+	if (writer->file != NULL)
+		writer->png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+	if (writer->png != NULL)
+		writer->info = png_create_info_struct(writer->png);
+	if (writer->info == NULL)
+	{
+		printf("Error in open_png_row_writer, unable to write %s.\n",fileName);
+		return(-1);
+	}
+	if (setjmp(png_jmpbuf(writer->png)))
+	{
+		printf("Error in open_png_row_writer, unable to write %s.\n",fileName);
+		return(-1);
+	}
+	png_init_io(writer->png, writer->file);
+	png_set_IHDR(writer->png, writer->info, (png_uint_32)xSize, (png_uint_32)ySize, bitDepth,
+		colourTypes[nTupleSize-1], PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+	png_write_info(writer->png, writer->info);
+
+	writer->xSize = xSize;
+	writer->nTupleSize = nTupleSize;
+	writer->bitDepth = bitDepth;
+	writer->row.resize((size_t)xSize*nTupleSize*(bitDepth/8));
+	return(1);
+}
+
+//the values are rounded and bounded as in write_png_f32
+static int write_png_row(imageRowWriter *writer, const float *values)
+{
+	unsigned char *row = &(writer->row[0]);
+	size_t nValues = (size_t)(writer->xSize)*(writer->nTupleSize);
+	if (writer->bitDepth == 16)
+		for (size_t i=0; i<nValues; i++)
+		{
+			float value = (float)floor(values[i]*IMAGE_16_BIT_SCALE + 0.5f);
+			int valueInt = (int)( value < 0.0f ? 0.0f : (value > 65535.0f ? 65535.0f : value) );
+			row[2*i] = (unsigned char)(valueInt >> 8);
+			row[2*i+1] = (unsigned char)(valueInt & 255);
+		}
+	else
+		for (size_t i=0; i<nValues; i++)
+		{
+			float value = (float)floor(values[i] + 0.5f);
+			row[i] = (unsigned char)( value < 0.0f ? 0.0f : (value > 255.0f ? 255.0f : value) );
+		}
+	if (setjmp(png_jmpbuf(writer->png)))
+	{
+		printf("Error in write_png_row, unable to write the row.\n");
+		return(-1);
+	}
+	png_write_row(writer->png, row);
+	return(1);
+}
+
+static int write_png_end(imageRowWriter *writer)
+{
+	if (setjmp(png_jmpbuf(writer->png)))
+	{
+		printf("Error in write_png_end, unable to finish the file.\n");
+		return(-1);
+	}
+	png_write_end(writer->png, NULL);
+	return(1);
+}
+
+static int close_png_row_writer(imageRowWriter *writer, bool finished)
+{
+	int returnVal = 1;
+	if ( (writer->png != NULL) && (writer->info != NULL) && finished )
+		returnVal = write_png_end(writer);
+	if (writer->png != NULL)
+		png_destroy_write_struct(&(writer->png), (writer->info != NULL) ? &(writer->info) : NULL);
+	if (writer->file != NULL)
+		fclose(writer->file);
+	writer->png = NULL;
+	writer->info = NULL;
+	writer->file = NULL;
+	return(returnVal);
+}
+
+static int open_image_row_reader(imageRowReader *reader, const char *fileName)
+{
+	reader->tiff = NULL;
+	reader->nextRow = 0;
+	if (!is_tiff_file(fileName))
+		return(open_png_row_reader(reader, fileName));
+	reader->file = NULL;
+	reader->png = NULL;
+	reader->info = NULL;
+	size_t nx, ny, nc;
+	reader->tiff = open_tiff_image(fileName, &nx, &ny, &nc, &(reader->bitDepth));
+	if (reader->tiff == NULL)
+		return(-1);
+	reader->xSize = (int)nx;
+	reader->ySize = (int)ny;
+	reader->nTupleSize = (int)nc;
+	return(1);
+}
+
+static int read_image_row(imageRowReader *reader, float *values)
+{
+	if (reader->tiff != NULL)
+		return(read_tiff_row(reader->tiff, (size_t)(reader->nextRow++), values));
+	return(read_png_row(reader, values));
+}
+
+static void close_image_row_reader(imageRowReader *reader)
+{
+	if (reader->tiff != NULL)
+		close_tiff_image(reader->tiff);
+	reader->tiff = NULL;
+	close_png_row_reader(reader);
+}
+
+static int open_image_row_writer(imageRowWriter *writer, const char *fileName, int xSize, int ySize, int nTupleSize,
+	int bitDepth)
+{
+	writer->tiff = NULL;
+	if (!is_tiff_file(fileName))
+		return(open_png_row_writer(writer, fileName, xSize, ySize, nTupleSize, bitDepth));
+	writer->file = NULL;
+	writer->png = NULL;
+	writer->info = NULL;
+	writer->tiff = create_tiff_image(fileName, xSize, ySize, nTupleSize, bitDepth);
+	return( (writer->tiff == NULL) ? -1 : 1 );
+}
+
+static int write_image_row(imageRowWriter *writer, const float *values)
+{
+	if (writer->tiff != NULL)
+		return(write_tiff_row(writer->tiff, values));
+	return(write_png_row(writer, values));
+}
+
+static int close_image_row_writer(imageRowWriter *writer, bool finished)
+{
+	if (writer->tiff != NULL)
+	{
+		int returnVal = close_tiff_image(writer->tiff);
+		writer->tiff = NULL;
+		return( finished ? returnVal : 1 );
+	}
+	return(close_png_row_writer(writer, finished));
+}
+
+//memory used by the rows of the band and by the inpainting of a tile, in bytes
+static double get_streaming_memory(int xSize, int ySize, int nTupleSize, int tileSize)
+{
+	int nRows = min_int(tileSize + 2*STREAMING_TILE_HALO, ySize);
+	int nCols = min_int(tileSize + 2*STREAMING_TILE_HALO, xSize);
+	double bandMemory = (double)nRows*xSize*(nTupleSize*sizeof(float) + 1);
+	double tileMemory = (double)nRows*nCols*STREAMING_TILE_BYTES_PER_PIXEL;
+	return(bandMemory + tileMemory);
+}
+
+//largest tile size which fits in the memory budget (in megabytes)
+static int determine_tile_size(int xSize, int ySize, int nTupleSize, float memoryBudget)
+{
+	double budget = (double)memoryBudget*1024.0*1024.0;
+	int tileSize = max_int(xSize,ySize);
+	while ( (tileSize > STREAMING_MIN_TILE_SIZE) && (get_streaming_memory(xSize,ySize,nTupleSize,tileSize) > budget) )
+		tileSize = max_int(tileSize - STREAMING_MIN_TILE_SIZE, STREAMING_MIN_TILE_SIZE);
+	if (get_streaming_memory(xSize,ySize,nTupleSize,tileSize) > budget)
+		printf("Warning, the memory budget is too small, the smallest tiles are used.\n");
+	return(tileSize);
+}
+
+//inpaint the core [xCore,xCoreEnd[ x [yCore,yCoreEnd[ of a tile with its halo, the inpainted pixels of the core
+//become known pixels of the band
+static void inpaint_tile(streamingBand *band, int ySize, int xCore, int yCore, int xCoreEnd, int yCoreEnd,
+	const patchMatchParameterStruct *patchMatchParams, const inpaintingParameterStruct *inpaintingParams)
+{
+	int xStart = max_int(xCore - STREAMING_TILE_HALO, 0);
+	int yStart = max_int(yCore - STREAMING_TILE_HALO, 0);
+	int xEnd = min_int(xCoreEnd + STREAMING_TILE_HALO, band->xSize);
+	int yEnd = min_int(yCoreEnd + STREAMING_TILE_HALO, ySize);
+	int nTupleSize = band->nTupleSize;
+	int patchSizeX = patchMatchParams->patchSizeX;
+	int patchSizeY = patchMatchParams->patchSizeY;
+
+	nTupleImage *imgTile = new nTupleImage(xEnd-xStart, yEnd-yStart, nTupleSize, patchSizeX, patchSizeY, IMAGE_INDEXING);
+	nTupleImage *occTile = new nTupleImage(xEnd-xStart, yEnd-yStart, 1, patchSizeX, patchSizeY, IMAGE_INDEXING);
+	for (int y=yStart; y<yEnd; y++)
+		for (int x=xStart; x<xEnd; x++)
+		{
+			size_t index = band->get_index(x,y);
+			for (int c=0; c<nTupleSize; c++)
+				imgTile->set_value_fast(x-xStart,y-yStart,c,(imageDataType)(band->values[index*nTupleSize + c]));
+			occTile->set_value_fast(x-xStart,y-yStart,0,(imageDataType)(band->occlusion[index]));
+		}
+
+	//inpaint_image modifies and deletes its parameters
+	patchMatchParameterStruct *tilePatchMatchParams = new patchMatchParameterStruct(*patchMatchParams);
+	tilePatchMatchParams->w = max_int(xEnd-xStart, yEnd-yStart);
+	inpaintingParameterStruct tileInpaintingParams = *inpaintingParams;
+	nTupleImage *imgOut;
+	if (tileInpaintingParams.connectedComponents)
+		imgOut = inpaint_image_components(imgTile, occTile, tilePatchMatchParams, &tileInpaintingParams);
+	else
+		imgOut = inpaint_image(imgTile, occTile, tilePatchMatchParams, &tileInpaintingParams);
+
+	for (int y=yCore; y<yCoreEnd; y++)
+		for (int x=xCore; x<xCoreEnd; x++)
+		{
+			size_t index = band->get_index(x,y);
+			if (band->occlusion[index] == 0)
+				continue;
+			for (int c=0; c<nTupleSize; c++)
+				band->values[index*nTupleSize + c] = (float)imgOut->get_value_fast(x-xStart,y-yStart,c);
+			band->occlusion[index] = 0;
+		}
+	delete imgTile;
+	delete occTile;
+	delete imgOut;
+}
+
+int inpaint_image_streaming(const char *fileIn, const char *fileOccIn, const char *fileOut,
+	const patchMatchParameterStruct *patchMatchParams, const inpaintingParameterStruct *inpaintingParams,
+	float memoryBudget)
+{
+	imageRowReader imgReader, occReader;
+	imageRowWriter imgWriter;
+	imgWriter.png = NULL; imgWriter.info = NULL; imgWriter.file = NULL; imgWriter.tiff = NULL;
+	occReader.png = NULL; occReader.info = NULL; occReader.file = NULL; occReader.tiff = NULL;
+	int returnVal = 1;
+
+	if ( (open_image_row_reader(&imgReader, fileIn) == -1) || (open_image_row_reader(&occReader, fileOccIn) == -1) )
+		returnVal = -1;
+	else if ( (imgReader.xSize != occReader.xSize) || (imgReader.ySize != occReader.ySize) )
+	{
+		printf("Error in inpaint_image_streaming, the image and the occlusion have different sizes.\n");
+		returnVal = -1;
+	}
+	else if (open_image_row_writer(&imgWriter, fileOut, imgReader.xSize, imgReader.ySize, imgReader.nTupleSize,
+		imgReader.bitDepth) == -1)
+		returnVal = -1;
+	if (returnVal == -1)
+	{
+		close_image_row_reader(&imgReader);
+		close_image_row_reader(&occReader);
+		close_image_row_writer(&imgWriter, false);
+		return(-1);
+	}
+
+	int xSize = imgReader.xSize, ySize = imgReader.ySize, nTupleSize = imgReader.nTupleSize;
+	int tileSize = determine_tile_size(xSize, ySize, nTupleSize, memoryBudget);
+	int nTilesX = (xSize + tileSize - 1)/tileSize, nTilesY = (ySize + tileSize - 1)/tileSize;
+	printf("Streaming inpainting : %d x %d pixels, %d bits, tiles of %d x %d pixels (halo %d), estimated memory %.1f MB\n",
+		xSize, ySize, imgReader.bitDepth, tileSize, tileSize, STREAMING_TILE_HALO,
+		get_streaming_memory(xSize,ySize,nTupleSize,tileSize)/(1024.0*1024.0));
+
+	streamingBand band;
+	band.nRows = min_int(tileSize + 2*STREAMING_TILE_HALO, ySize);
+	band.xSize = xSize;
+	band.nTupleSize = nTupleSize;
+	band.values.resize((size_t)band.nRows*xSize*nTupleSize);
+	band.occlusion.resize((size_t)band.nRows*xSize);
+	std::vector<float> occRow((size_t)xSize*occReader.nTupleSize);
+	//the alpha channel of the occlusion is ignored
+	int nOccColours = ( (occReader.nTupleSize == 2) || (occReader.nTupleSize == 4) ) ?
+		occReader.nTupleSize - 1 : occReader.nTupleSize;
+
+	int nRowsRead = 0, nTilesInpainted = 0;
+	for (int yCore=0; (yCore<ySize) && (returnVal == 1); yCore+=tileSize)
+	{
+		int yCoreEnd = min_int(yCore + tileSize, ySize);
+		//read the rows of the band and of its halo (the rows above the band are still in the buffers)
+		for ( ; (nRowsRead < min_int(yCoreEnd + STREAMING_TILE_HALO, ySize)) && (returnVal == 1); nRowsRead++)
+		{
+			size_t index = band.get_index(0,nRowsRead);
+			if ( (read_image_row(&imgReader, &(band.values[index*nTupleSize])) == -1) ||
+				(read_image_row(&occReader, &(occRow[0])) == -1) )
+			{
+				returnVal = -1;
+				break;
+			}
+			for (int x=0; x<xSize; x++)
+			{
+				band.occlusion[index + x] = 0;
+				for (int c=0; c<nOccColours; c++)
+					if (occRow[(size_t)x*(occReader.nTupleSize) + c] > 0)
+						band.occlusion[index + x] = 1;
+			}
+		}
+		if (returnVal == -1)
+			break;
+
+		//inpaint the damaged tiles of the band
+		for (int xCore=0; xCore<xSize; xCore+=tileSize)
+		{
+			int xCoreEnd = min_int(xCore + tileSize, xSize);
+			bool damaged = false;
+			for (int y=yCore; (y<yCoreEnd) && (!damaged); y++)
+				for (int x=xCore; x<xCoreEnd; x++)
+					if (band.occlusion[band.get_index(x,y)] > 0)
+					{
+						damaged = true;
+						break;
+					}
+			if (!damaged)
+				continue;
+			printf("Streaming inpainting : tile (%d,%d) of %d x %d\n",xCore/tileSize,yCore/tileSize,nTilesX,nTilesY);
+			inpaint_tile(&band, ySize, xCore, yCore, xCoreEnd, yCoreEnd, patchMatchParams, inpaintingParams);
+			nTilesInpainted++;
+		}
+
+		//the rows of the band are finished
+		for (int y=yCore; y<yCoreEnd; y++)
+			if (write_image_row(&imgWriter, &(band.values[band.get_index(0,y)*nTupleSize])) == -1)
+			{
+				returnVal = -1;
+				break;
+			}
+	}
+
+	close_image_row_reader(&imgReader);
+	close_image_row_reader(&occReader);
+	if (close_image_row_writer(&imgWriter, returnVal == 1) == -1)
+		returnVal = -1;
+	if (returnVal == 1)
+		printf("Streaming inpainting finished : %d of %d tiles inpainted\n",nTilesInpainted,nTilesX*nTilesY);
+	else
+		printf("Error in inpaint_image_streaming, %s could not be inpainted.\n",fileIn);
+	return(returnVal);
+}
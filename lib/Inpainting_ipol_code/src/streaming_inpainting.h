@@ -0,0 +1,36 @@
+//streaming inpainting of images which do not fit in memory (whole-folio scans) : the images are read and written
+//row by row, and the damaged tiles are inpainted one after the other, with a halo of known pixels around them
+
+#ifndef STREAMING_INPAINTING_H
+#define STREAMING_INPAINTING_H
+
+#include <stdlib.h>
+
+#include "image_inpainting.h"
+
+//number of pixels added on each side of a tile : the patches of the tile are taken in the tile and its halo
+#ifndef STREAMING_TILE_HALO
+#define STREAMING_TILE_HALO 64
+#endif
+
+//smallest tile size, and step with which the tile size is reduced to fit in the memory budget
+#ifndef STREAMING_MIN_TILE_SIZE
+#define STREAMING_MIN_TILE_SIZE 64
+#endif
+
+//approximate memory used by the inpainting of a tile, in bytes per pixel of the tile and its halo (pyramids,
+//features, shift maps and temporaries, measured on RGB images with features)
+#ifndef STREAMING_TILE_BYTES_PER_PIXEL
+#define STREAMING_TILE_BYTES_PER_PIXEL 256
+#endif
+
+//inpaint the PNG or TIFF file fileIn (8 or 16 bits) in tiles chosen such that the rows kept in memory and the
+//inpainting of one tile use less than memoryBudget megabytes (plus one strip or row of tiles of a tiled TIFF file).
+//The tiles are processed row after row, and the inpainted pixels of a tile are known pixels for the following tiles,
+//so the seams are continuous. The output (PNG or TIFF) has the bit depth of the input. patchMatchParams and
+//inpaintingParams are copied for each tile. Returns -1 in case of error
+int inpaint_image_streaming(const char *fileIn, const char *fileOccIn, const char *fileOut,
+	const patchMatchParameterStruct *patchMatchParams, const inpaintingParameterStruct *inpaintingParams,
+	float memoryBudget);
+
+#endif
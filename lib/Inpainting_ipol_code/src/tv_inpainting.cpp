@@ -0,0 +1,60 @@
+//TV inpainting of the occlusion, used as the initialisation of the patch-based inpainting
+
+#include <vector>
+
+extern "C" {
+#include "tvreg.h"
+}
+
+#include "tv_inpainting.h"
+
+int tv_inpaint_image(nTupleImage *imgIn, nTupleImage *occIn, float lambda, int maxIterations, bool verboseMode)
+{
+	int xSize = imgIn->xSize, ySize = imgIn->ySize, nTupleSize = imgIn->nTupleSize;
+	size_t nPixels = (size_t)xSize*ySize;
+
+	//planar values in [0,1], and spatially varying fidelity weight, 0 in the occlusion where u starts at 0.5
+	std::vector<num> f(nPixels*nTupleSize), u(nPixels*nTupleSize), lambdaMap(nPixels);
+	for (int y=0; y<ySize; y++)
+		for (int x=0; x<xSize; x++)
+		{
+			size_t i = (size_t)y*xSize + x;
+			bool occluded = (occIn->get_value(x,y,0) > 0);
+			lambdaMap[i] = occluded ? (num)0 : (num)lambda;
+			for (int c=0; c<nTupleSize; c++)
+			{
+				f[c*nPixels + i] = (num)(imgIn->get_value(x,y,c)/255.0f);
+				u[c*nPixels + i] = occluded ? (num)0.5 : f[c*nPixels + i];
+			}
+		}
+
+	tvregopt *opt = TvRegNewOpt();
+	if (opt == NULL)
+	{
+		printf("Error in tv_inpaint_image, unable to allocate the TV options.\n");
+		return(-1);
+	}
+	TvRegSetVaryingLambda(opt, &(lambdaMap[0]), xSize, ySize);
+	TvRegSetMaxIter(opt, maxIterations);
+	TvRegSetTol(opt, (num)TV_TOLERANCE);
+	if (verboseMode == false)
+		TvRegSetPlotFun(opt, NULL, NULL);
+	int success = TvRestore(&(u[0]), &(f[0]), xSize, ySize, nTupleSize, opt);
+	TvRegFreeOpt(opt);
+	if (!success)
+	{
+		printf("Error in tv_inpaint_image, the TV inpainting failed.\n");
+		return(-1);
+	}
+
+	//the whole TV image is kept, as in the published pipeline (where the image written by tvinpaint was inpainted),
+	//with the rounding and the clamping of its 8-bit output
+	for (int y=0; y<ySize; y++)
+		for (int x=0; x<xSize; x++)
+			for (int c=0; c<nTupleSize; c++)
+			{
+				float value = (float)floor(255.0f*(float)u[c*nPixels + (size_t)y*xSize + x] + 0.5f);
+				imgIn->set_value(x,y,c,(imageDataType)min_float(max_float(value,0.0f),255.0f));
+			}
+	return(1);
+}
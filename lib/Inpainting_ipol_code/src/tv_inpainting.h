@@ -0,0 +1,27 @@
+//TV inpainting of the occlusion (split Bregman, with the solver of lib/tvinpaint_20120701), used as the
+//initialisation of the patch-based inpainting in the same process
+
+#ifndef TV_INPAINTING_H
+#define TV_INPAINTING_H
+
+#include <stdlib.h>
+
+#include "image_structures.h"
+
+//convergence tolerance of the split Bregman iterations (as in tvinpaint)
+#ifndef TV_TOLERANCE
+#define TV_TOLERANCE 1e-5
+#endif
+
+//default maximum number of split Bregman iterations
+#ifndef TV_MAX_ITERATIONS
+#define TV_MAX_ITERATIONS 5000
+#endif
+
+//replace the values of imgIn by its TV inpainting, with the fidelity weight lambda outside of the occlusion
+//(occIn > 0). The values are scaled to [0,1] as in tvinpaint, so lambda has the same meaning. The pixels outside
+//of the occlusion are also replaced (regularised), and all the values are rounded to integers in [0,255], as in
+//the output of tvinpaint. Returns -1 in case of error
+int tv_inpaint_image(nTupleImage *imgIn, nTupleImage *occIn, float lambda, int maxIterations, bool verboseMode=false);
+
+#endif
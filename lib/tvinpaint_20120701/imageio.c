@@ -4,7 +4,7 @@
  * @author Pascal Getreuer <getreuer@gmail.com>
  *
  * Two high-level functions are provided, \c ReadImage and \c WriteImage, for
- * reading and writing image BMP, JPEG, PNG, and TIFF files.  The desired 
+ * reading and writing image BMP, JPEG, PNG, TIFF, and raw float files.  The desired 
  * format of the image data can be specified to \c ReadImage for how to return
  * the data (and similarly to \c WriteImage for how it should interpret the 
  * data).  Formatting options allow specifying the datatype of the components, 
@@ -22,7 +22,8 @@
  * Support for BMP reading and writing is native: BMP reading supports 1-, 2-, 
  * 4-, 8-, 16-, 32-bit uncompressed, RLE, and bitfield images; BMP writing is
  * limited to 24-bit uncompressed.  The implementation calls libjpeg, libpng,
- * and libtiff to handle JPEG, PNG, and TIFF images.
+ * and libtiff to handle JPEG, PNG, and TIFF images.  Raw float images 
+ * (.rawf) are read and written natively, without quantization to 8 bits.
  * 
  * 
  * Copyright (c) 2010-2012, Pascal Getreuer
@@ -1504,6 +1505,231 @@ static int WriteTiff(const uint32_t *Image, int Width, int Height,
 #endif /* USE_LIBTIFF */
 
 
+/* 
+ * Raw float images (.rawf): a header of RAWFLOAT_HEADER_SIZE bytes (the
+ * magic RAWFLOAT_MAGIC, then the width, the height and the number of 
+ * channels as 32-bit integers), followed by the float components stored 
+ * plane after plane, row after row, with range 0 to 255.  This is the 
+ * layout of the images of the patch-based inpainting code, which maps the
+ * file in memory.  The file is written in the byte order of the machine.
+ */
+
+/** @brief Get the number of channels, the strides and the channel order of a format */
+static int GetFormatLayout(int *PixelStride, int *RowStride, 
+    int *ChannelStride, int *Order, int Width, int Height, unsigned Format)
+{
+    const int NumChannels = (Format & IMAGEIO_GRAYSCALE) ? 
+        1 : ((Format & IMAGEIO_STRIP_ALPHA) ? 3 : 4);
+    
+    
+    *ChannelStride = (Format & IMAGEIO_PLANAR) ? Width*Height : 1;
+    *PixelStride = (Format & IMAGEIO_PLANAR) ? 1 : NumChannels;
+    
+    if(Format & IMAGEIO_COLUMNMAJOR)
+    {
+        *RowStride = *PixelStride;
+        *PixelStride *= Height;
+    }
+    else
+        *RowStride = Width*(*PixelStride);
+    
+    Order[0] = 0;
+    Order[1] = 1;
+    Order[2] = 2;
+    Order[3] = 3;
+    
+    if(Format & IMAGEIO_BGRFLIP)
+    {
+        Order[0] = 2;
+        Order[2] = 0;
+    }
+    
+    if((Format & IMAGEIO_AFLIP) && !(Format & IMAGEIO_STRIP_ALPHA))
+    {
+        Order[3] = Order[2];
+        Order[2] = Order[1];
+        Order[1] = Order[0];
+        Order[0] = 3;
+    }
+    
+    return NumChannels;
+}
+
+
+/** @brief Read a raw float image, converted to the specified format */
+static int ReadRawFloat(void **Image, int *Width, int *Height, FILE *File,
+    unsigned Format)
+{
+    char Header[RAWFLOAT_HEADER_SIZE];
+    int32_t Sizes[3];
+    float *Src = NULL, Pixel[4];
+    double Value;
+    long NumPixels;
+    int NumChannels, FileChannels, PixelStride, RowStride, ChannelStride;
+    int Order[4], i, k, x, y, Success = 0;
+    
+    
+    *Image = NULL;
+    
+    if(fread(Header, 1, RAWFLOAT_HEADER_SIZE, File) != RAWFLOAT_HEADER_SIZE
+        || memcmp(Header, RAWFLOAT_MAGIC, 8))
+        return 0;
+    
+    memcpy(Sizes, Header + 8, sizeof(Sizes));
+    *Width = Sizes[0];
+    *Height = Sizes[1];
+    FileChannels = Sizes[2];
+    
+    if(*Width <= 0 || *Height <= 0 || *Width > MAX_IMAGE_SIZE 
+        || *Height > MAX_IMAGE_SIZE || (FileChannels != 1 
+        && FileChannels != 3 && FileChannels != 4))
+    {
+        ErrorMessage("Invalid raw float image header.\n");
+        return 0;
+    }
+    
+    NumPixels = ((long)*Width) * ((long)*Height);
+    NumChannels = GetFormatLayout(&PixelStride, &RowStride, &ChannelStride,
+        Order, *Width, *Height, Format);
+    
+    if(!(Src = (float *)Malloc(sizeof(float)*FileChannels*NumPixels)))
+        goto Catch;
+    
+    if(fread(Src, sizeof(float), FileChannels*NumPixels, File) 
+        != (size_t)(FileChannels*NumPixels))
+    {
+        ErrorMessage("Error reading raw float data.\n");
+        goto Catch;
+    }
+    
+    switch(Format & (IMAGEIO_U8 | IMAGEIO_SINGLE | IMAGEIO_DOUBLE))
+    {
+    case IMAGEIO_U8:
+        *Image = Malloc(sizeof(uint8_t)*NumChannels*NumPixels);
+        break;
+    case IMAGEIO_SINGLE:
+        *Image = Malloc(sizeof(float)*NumChannels*NumPixels);
+        break;
+    case IMAGEIO_DOUBLE:
+        *Image = Malloc(sizeof(double)*NumChannels*NumPixels);
+        break;
+    default:
+        goto Catch;
+    }
+    
+    if(!*Image)
+        goto Catch;
+    
+    for(y = 0; y < *Height; y++)
+        for(x = 0; x < *Width; x++)
+        {
+            /* RGBA components of the pixel, with range 0 to 255 */
+            for(k = 0; k < 4; k++)
+                Pixel[k] = (k < FileChannels) ? 
+                    Src[k*NumPixels + ((long)*Width)*y + x] : 
+                    ((k == 3) ? 255.0f : Src[((long)*Width)*y + x]);
+            
+            for(k = 0; k < NumChannels; k++)
+            {
+                if(NumChannels == 1)
+                    Value = (FileChannels == 1) ? Pixel[0] : 
+                        0.299f*Pixel[0] + 0.587f*Pixel[1] + 0.114f*Pixel[2];
+                else
+                    Value = Pixel[Order[k]];
+                
+                i = RowStride*y + PixelStride*x + ChannelStride*k;
+                
+                switch(Format & (IMAGEIO_U8 | IMAGEIO_SINGLE | IMAGEIO_DOUBLE))
+                {
+                case IMAGEIO_U8:
+                    ((uint8_t *)*Image)[i] = ROUNDCLAMP(Value/255.0);
+                    break;
+                case IMAGEIO_SINGLE:
+                    ((float *)*Image)[i] = (float)(Value/255.0);
+                    break;
+                case IMAGEIO_DOUBLE:
+                    ((double *)*Image)[i] = Value/255.0;
+                    break;
+                }
+            }
+        }
+    
+    Success = 1;
+Catch:
+    if(Src)
+        Free(Src);
+    if(!Success && *Image)
+    {
+        Free(*Image);
+        *Image = NULL;
+    }
+    return Success;
+}
+
+
+/** @brief Write a raw float image, without quantization to 8 bits */
+static int WriteRawFloat(void *Image, int Width, int Height, FILE *File,
+    unsigned Format)
+{
+    char Header[RAWFLOAT_HEADER_SIZE];
+    int32_t Sizes[3];
+    float *Row;
+    int NumChannels, PixelStride, RowStride, ChannelStride;
+    int Order[4], Plane[4], i, k, x, y, Success = 0;
+    
+    
+    NumChannels = GetFormatLayout(&PixelStride, &RowStride, &ChannelStride,
+        Order, Width, Height, Format);
+    
+    /* Channel of Image stored in each plane of the file (RGBA order) */
+    for(k = 0; k < NumChannels; k++)
+        Plane[(NumChannels == 1) ? 0 : Order[k]] = k;
+    
+    memset(Header, 0, RAWFLOAT_HEADER_SIZE);
+    memcpy(Header, RAWFLOAT_MAGIC, 8);
+    Sizes[0] = Width;
+    Sizes[1] = Height;
+    Sizes[2] = NumChannels;
+    memcpy(Header + 8, Sizes, sizeof(Sizes));
+    
+    if(fwrite(Header, 1, RAWFLOAT_HEADER_SIZE, File) != RAWFLOAT_HEADER_SIZE
+        || !(Row = (float *)Malloc(sizeof(float)*Width)))
+        return 0;
+    
+    for(k = 0; k < NumChannels; k++)
+        for(y = 0; y < Height; y++)
+        {
+            for(x = 0; x < Width; x++)
+            {
+                i = RowStride*y + PixelStride*x + ChannelStride*Plane[k];
+                
+                switch(Format & (IMAGEIO_U8 | IMAGEIO_SINGLE | IMAGEIO_DOUBLE))
+                {
+                case IMAGEIO_U8:
+                    Row[x] = (float)((uint8_t *)Image)[i];
+                    break;
+                case IMAGEIO_SINGLE:
+                    Row[x] = 255.0f*((float *)Image)[i];
+                    break;
+                case IMAGEIO_DOUBLE:
+                    Row[x] = (float)(255.0*((double *)Image)[i]);
+                    break;
+                default:
+                    goto Catch;
+                }
+            }
+            
+            if(fwrite(Row, sizeof(float), Width, File) != (size_t)Width)
+                goto Catch;
+        }
+    
+    Success = 1;
+Catch:
+    Free(Row);
+    return Success;
+}
+
+
 /** @brief Convert from RGBA U8 to a specified format */
 static void *ConvertToFormat(uint32_t *Src, int Width, int Height, 
     unsigned Format)
@@ -1882,6 +2108,8 @@ int IdentifyImageType(char *Type, const char *FileName)
     else if((Magic & 0xF0FF00FFL) == 0x0001000AL            /* PCX */
         && ((Magic >> 8) & 0xFF) < 6)   
         strcpy(Type, "PCX");
+    else if(Magic == 0x46574152L)                           /* Raw float */
+        strcpy(Type, "RAWF");
     else
         return 0;
     
@@ -2029,6 +2257,12 @@ void *ReadImage(int *Width, int *Height,
                      FileName);
 #endif
     }
+    else if(!strcmp(Type, "RAWF"))
+    {
+        /* Converted directly from the float data */
+        if(!(ReadRawFloat(&Image, Width, Height, File, Format)))
+            ErrorMessage("Failed to read \"%s\".\n", FileName);
+    }
     else
     {
         /* File format is unsupported. */
@@ -2047,7 +2281,7 @@ void *ReadImage(int *Width, int *Height,
         Image = ConvertToFormat(ImageU8, *Width, *Height, Format);
         Free(ImageU8);
     }
-    else
+    else if(ImageU8)
         Image = ImageU8;
     
     return Image;
@@ -2077,8 +2311,9 @@ int WriteImage(void *Image, int Width, int Height,
     const char *FileName, unsigned Format, int Quality)
 {
     FILE *File;
-    uint32_t *ImageU8;
-    enum {BMP_FORMAT, JPEG_FORMAT, PNG_FORMAT, TIFF_FORMAT} FileFormat;
+    uint32_t *ImageU8 = NULL;
+    enum {BMP_FORMAT, JPEG_FORMAT, PNG_FORMAT, TIFF_FORMAT, 
+        RAWF_FORMAT} FileFormat;
     int Success = 0;
     
     if(!Image || Width <= 0 || Height <= 0)
@@ -2119,6 +2354,8 @@ int WriteImage(void *Image, int Width, int Height,
         return 0;
 #endif
     }
+    else if(StringEndsWith(FileName, ".rawf"))
+        FileFormat = RAWF_FORMAT;
     else 
     {
         ErrorMessage("Failed to write \"%s\".\n", FileName);
@@ -2142,7 +2379,9 @@ int WriteImage(void *Image, int Width, int Height,
         return 0;
     }
     
-    if(!(ImageU8 = ConvertFromFormat(Image, Width, Height, Format)))
+    /* Raw float images are written without quantization to 8 bits */
+    if(FileFormat != RAWF_FORMAT 
+        && !(ImageU8 = ConvertFromFormat(Image, Width, Height, Format)))
         return 0;
     
     switch(FileFormat)
@@ -2172,12 +2411,16 @@ int WriteImage(void *Image, int Width, int Height,
         File = 0;
 #endif
         break;
+    case RAWF_FORMAT:
+        Success = WriteRawFloat(Image, Width, Height, File, Format);
+        break;
     }
     
     if(!Success)
         ErrorMessage("Failed to write \"%s\".\n", FileName);
     
-    Free(ImageU8);
+    if(ImageU8)
+        Free(ImageU8);
     
     if(File)
         fclose(File);
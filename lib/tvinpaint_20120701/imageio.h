@@ -22,6 +22,11 @@
 /** @brief Limit on the maximum allowed image width or height (security). */
 #define MAX_IMAGE_SIZE 10000
 
+/** @brief Identifier and version of the raw float (.rawf) images */
+#define RAWFLOAT_MAGIC          "RAWF0001"
+/** @brief Size in bytes of the header of the raw float images */
+#define RAWFLOAT_HEADER_SIZE    64
+
 
 #ifndef DOXYGEN
 
@@ -73,11 +78,11 @@
 @endcode
  */
 #define READIMAGE_FORMATS_SUPPORTED	\
-    "BMP" SUPPORTEDSTRING_JPEG SUPPORTEDSTRING_PNG SUPPORTEDSTRING_TIFF
+    "BMP" SUPPORTEDSTRING_JPEG SUPPORTEDSTRING_PNG SUPPORTEDSTRING_TIFF "/RAWF"
     
 /** @brief String macro listing supported formats for \c WriteImage */
 #define WRITEIMAGE_FORMATS_SUPPORTED	\
-    "BMP" SUPPORTEDSTRING_JPEG SUPPORTEDSTRING_PNG SUPPORTEDSTRING_TIFF
+    "BMP" SUPPORTEDSTRING_JPEG SUPPORTEDSTRING_PNG SUPPORTEDSTRING_TIFF "/RAWF"
 
 #ifndef _CRT_SECURE_NO_WARNINGS
 /** @brief Avoid MSVC warnings on using fopen */
@@ -24,38 +24,19 @@ LAMBDA=1000
 MAXITER=5000
 ## PATCHMATCH
 NITERS="12"
-PS="5 7 9" # PATCHSIZE
+PS="5,7,9" # PATCHSIZE
+## THREADS SHARED BY THE JOBS OF THE BATCH
+NTHREADS=$(nproc)
 
 ## -------------------------------------- DO NOT TOUCH FROM HERE
 
-# EXTRACT FILE TO BE MODIFIED FROM PACKAGES 
-cd zip
-tar -xf tvinpaint_20120701.tar.gz  -C ./../lib
-tar -xf Inpainting_ipol_code.tar.gz -C ./../lib
-#tar -xf tvinpaint_20120701.tar.gz $(tvinpaint_20120701/tvinpaint.c) -C ./../
-#tar -xf Inpainting_ipol_code.tar.gz $(Inpainting_ipol_code/src/image_inpainting.cpp) -C ./../Inpainting_ipol_code/src
-cd ..
+# COMPILE THE INPAINTING WITH OPENMP (the parameters are given at runtime, the sources are not modified)
+make -C ./lib/Inpainting_ipol_code OMP=1
 
-# CUSTOMIZATION OF tvinpaint.c AND image_inpainting.cpp 
-cd ./lib/tvinpaint_20120701
-sed -i_bak "183s/.*/    TvRegSetMaxIter(Opt, $MAXITER);/" tvinpaint.c
-make -f makefile.gcc
-cd ../..
+# ONE JOB PER TEST, ALL RUN BY THE SAME PROCESS (the largest first, on all the cores)
+MANIFEST=./results/paper_results/manifest.txt
+echo "# input mask output options" > $MANIFEST
 
-cd ./lib/Inpainting_ipol_code/
-cd ./src
-ROW24="            patchMatchParams->nIters = $NITERS;/"
-ROW266="            initialise_inpainting(imgInpaint,occInpaint,featuresPyramid,shiftMap,patchMatchParams); imgInpaint = copy_image_nTuple(imgPyramid[level]);/"
-ROW407="		nTupleImage *firstGuess = copy_image_nTuple(imgIn);/"
-ROW266ORIGINAL="            initialise_inpainting(imgInpaint,occInpaint,featuresPyramid,shiftMap,patchMatchParams);/"
-ROW407ORIGINAL="             nTupleImage *firstGuess = copy_image_nTuple(shiftMap);/"
-sed -i_bak "24s/.*/$ROW24" image_inpainting.cpp 
-sed -i_bak "266s/.*/$ROW266" image_inpainting.cpp 
-sed -i_bak "407s/.*/$ROW407" image_inpainting.cpp 
-cd ..
-make
-cd ../..
-	
 for T in $TS 
 	do
 
@@ -65,22 +46,12 @@ for T in $TS
 	INPUT=$localpath"input_orig"$T".png"
 	MASK=$localpath"mask"$T".png"
 
-	MASKED=$localpath"masked"$T".png"
-	TVINPAINTED=$localpath"TVinpainted"$T".png"
-
-	### TV INITIALIZATION
-	# Set the image to gray within the inpainting domain to create masked.bmp
-	./lib/tvinpaint_20120701/applymask $INPUT $MASK $MASKED
-	# Inpaint masked.png using the inpainting domain D.bmp with lambda = LAMBDA.
-	./lib/tvinpaint_20120701/tvinpaint $MASK $LAMBDA $MASKED $TVINPAINTED
-
-	# EXEMPLAR BASED INPAINTING
-	for P in $PS
-		do
-
-		PATCHINPAINTED=$localpath"PATCHinpainted"$T"_"$P"x"$P".png"
-		./lib/Inpainting_ipol_code/bin/inpaint_image $TVINPAINTED $MASK $PATCHINPAINTED -patchSizeX $P -patchSizeY $P
-
-	done
+	# TV INITIALIZATION AND EXEMPLAR BASED INPAINTING, IN THE SAME PROCESS
+	# (the TV inpainting alone is still given by ./lib/tvinpaint_20120701/tvinpaint)
+	# ALL THE PATCH SIZES SHARE THE TV INITIALIZATION AND THE PYRAMIDS : PATCHinpainted<T>_<P>x<P>.png
+	PATCHINPAINTED=$localpath"PATCHinpainted"$T".png"
+	echo "$INPUT $MASK $PATCHINPAINTED -patchSizes $PS -tvLambda $LAMBDA -tvMaxIterations $MAXITER -nIters $NITERS" >> $MANIFEST
 
 done
+
+./lib/Inpainting_ipol_code/bin/inpaint_image -batch $MANIFEST -nThreads $NTHREADS